@@ -0,0 +1,86 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _HALF_FLOAT_H_
+#define _HALF_FLOAT_H_
+#include <cstdint>
+#include <cstring>
+namespace tgr {
+	//IEEE 754 binary16 conversions, rounding to nearest even. Used by fp16 shards and fp16 history frames.
+	inline uint16_t FloatToHalf(float f) {
+		uint32_t x;
+		std::memcpy(&x, &f, sizeof(float));
+		uint32_t sign = (x >> 16) & 0x8000;
+		uint32_t mant = x & 0x7FFFFF;
+		int exp = (int)((x >> 23) & 0xFF);
+		if (exp == 255) {
+			return (uint16_t)(sign | 0x7C00 | ((mant != 0) ? 0x200 : 0));
+		}
+		int e = exp - 127 + 15;
+		if (e >= 31) {
+			return (uint16_t)(sign | 0x7C00);
+		}
+		//Round to nearest even in both the normal and subnormal range.
+		if (e <= 0) {
+			if (e < -10)return (uint16_t)sign;
+			mant |= 0x800000;
+			int shift = 14 - e;
+			uint32_t half = mant >> shift;
+			uint32_t rem = mant & ((1u << shift) - 1);
+			uint32_t mid = 1u << (shift - 1);
+			if (rem > mid || (rem == mid && (half & 1)))half++;
+			return (uint16_t)(sign | half);
+		}
+		uint32_t half = ((uint32_t)e << 10) | (mant >> 13);
+		uint32_t rem = mant & 0x1FFF;
+		if (rem > 0x1000 || (rem == 0x1000 && (half & 1)))half++;
+		return (uint16_t)(sign | half);
+	}
+	inline float HalfToFloat(uint16_t h) {
+		uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+		int exp = (h >> 10) & 0x1F;
+		uint32_t mant = h & 0x3FF;
+		uint32_t bits;
+		if (exp == 0) {
+			if (mant == 0) {
+				bits = sign;
+			}
+			else {
+				exp = 1;
+				while ((mant & 0x400) == 0) {
+					mant <<= 1;
+					exp--;
+				}
+				mant &= 0x3FF;
+				bits = sign | ((uint32_t)(exp + 112) << 23) | (mant << 13);
+			}
+		}
+		else if (exp == 31) {
+			bits = sign | 0x7F800000 | (mant << 13);
+		}
+		else {
+			bits = sign | ((uint32_t)(exp + 112) << 23) | (mant << 13);
+		}
+		float f;
+		std::memcpy(&f, &bits, sizeof(float));
+		return f;
+	}
+}
+#endif
@@ -0,0 +1,74 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _IDX_DATASET_H_
+#define _IDX_DATASET_H_
+#include "MappedFile.h"
+#include <AlloyImage.h>
+#include <vector>
+#include <memory>
+namespace tgr {
+	class NeuralLayer;
+	/*
+	 * Memory mapped IDX file (the MNIST container format). Samples stay as
+	 * uint8 in the mapping. Images are padded and rescaled to
+	 * [scaleMin, scaleMax] only when they are copied out, so a 60k sample
+	 * training set costs its file size and loads without reading the file.
+	 */
+	class IDXDataset {
+	protected:
+		MappedFile file;
+		const uint8_t* samples;
+		std::vector<int> dimensions;
+		size_t sampleSize;
+		int count;
+		int xPadding;
+		int yPadding;
+		float scaleMin;
+		float scaleMax;
+	public:
+		IDXDataset();
+		IDXDataset(const std::string& file, float scaleMin = 0.0f, float scaleMax = 1.0f, int xPadding = 0, int yPadding = 0);
+		void open(const std::string& file, float scaleMin = 0.0f, float scaleMax = 1.0f, int xPadding = 0, int yPadding = 0);
+		int size() const {
+			return count;
+		}
+		//Padded image size. Rows and columns are the last two IDX dimensions.
+		int width() const;
+		int height() const;
+		size_t getSampleSize() const {
+			return sampleSize;
+		}
+		const uint8_t* getSample(int idx) const {
+			return samples + idx*sampleSize;
+		}
+		uint8_t getLabel(int idx) const {
+			return samples[idx];
+		}
+		void copyTo(int idx, float* dst) const;
+		void copyTo(int idx, aly::Image1f& img) const;
+		//Writes straight into the layer's responses, which must be width() x height().
+		void copyTo(int idx, NeuralLayer& layer) const;
+	};
+	typedef std::shared_ptr<IDXDataset> IDXDatasetPtr;
+	//Converts N bytes to scale*byte+offset.
+	void ConvertBytes(const uint8_t* src, float* dst, int N, float scale, float offset);
+}
+#endif
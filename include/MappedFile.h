@@ -0,0 +1,59 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+#include <string>
+#include <cstdint>
+#include <cstddef>
+namespace tgr {
+	//Read-only memory mapping of a whole file. Pages are loaded by the OS on first touch.
+	class MappedFile {
+	protected:
+		const uint8_t* data;
+		size_t length;
+#ifdef _WIN32
+		void* fileHandle;
+		void* mappingHandle;
+#else
+		int fileDescriptor;
+#endif
+	public:
+		MappedFile();
+		MappedFile(const std::string& file);
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile();
+		void open(const std::string& file);
+		void close();
+		bool isOpen() const {
+			return (data != nullptr);
+		}
+		const uint8_t* ptr() const {
+			return data;
+		}
+		size_t size() const {
+			return length;
+		}
+		//Asks the OS to start reading a range in the background. It is a hint only and may be ignored.
+		void prefetch(size_t offset, size_t count) const;
+	};
+}
+#endif
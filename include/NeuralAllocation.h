@@ -0,0 +1,84 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _NEURAL_ALLOCATION_H_
+#define _NEURAL_ALLOCATION_H_
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+/*
+ * Counts heap allocations so a code path can be checked to run without
+ * allocating. Counting replaces the global operator new and is compiled in
+ * only when TGR_AUDIT_ALLOCATIONS is defined. Otherwise isSupported() is
+ * false and every count stays zero.
+ *
+ * Allocations are counted on every thread while at least one
+ * AllocationScope is alive, so work done by OpenMP teams is included. Set a
+ * breakpoint in AllocationAudit::record() to find where an allocation
+ * comes from. Threads whose work is meant to allocate, such as the
+ * checkpoint writer, opt out with ignoreCurrentThread().
+ */
+namespace tgr {
+	class AllocationAudit {
+	protected:
+		static std::atomic<int> depth;
+		static std::atomic<uint64_t> count;
+		static std::atomic<uint64_t> bytes;
+	public:
+		static bool isSupported();
+		static void record(size_t size);
+		//Allocations made on the calling thread are no longer counted.
+		static void ignoreCurrentThread();
+		static void begin() {
+			depth.fetch_add(1);
+		}
+		static void end() {
+			depth.fetch_sub(1);
+		}
+		static uint64_t getCount() {
+			return count.load();
+		}
+		static uint64_t getBytes() {
+			return bytes.load();
+		}
+	};
+	class AllocationScope {
+	protected:
+		uint64_t startCount;
+		uint64_t startBytes;
+	public:
+		AllocationScope() :startCount(AllocationAudit::getCount()), startBytes(AllocationAudit::getBytes()) {
+			AllocationAudit::begin();
+		}
+		~AllocationScope() {
+			AllocationAudit::end();
+		}
+		AllocationScope(const AllocationScope&) = delete;
+		AllocationScope& operator=(const AllocationScope&) = delete;
+		//Allocations made since the scope was opened.
+		uint64_t getCount() const {
+			return AllocationAudit::getCount() - startCount;
+		}
+		uint64_t getBytes() const {
+			return AllocationAudit::getBytes() - startBytes;
+		}
+	};
+}
+#endif
@@ -0,0 +1,130 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _NEURAL_ARENA_H_
+#define _NEURAL_ARENA_H_
+#include "NeuralOptimization.h"
+#include "NeuralKnowledge.h"
+#include <memory>
+#include <vector>
+#include <map>
+namespace tgr {
+	class NeuralLayer;
+	struct ArenaBlock {
+		size_t offset;
+		size_t weights;
+		size_t biasWeights;
+		ArenaBlock(size_t offset = 0, size_t weights = 0, size_t biasWeights = 0) :offset(offset), weights(weights), biasWeights(biasWeights) {
+		}
+		size_t size() const {
+			return weights + biasWeights;
+		}
+	};
+	/*
+	 * Single 64-byte aligned allocation that holds every trainable parameter
+	 * of a NeuralSystem. It is laid out as
+	 *
+	 *   [weights | changes | state 0 | ... | state K-1]
+	 *
+	 * and every segment has the same stride. Inside a segment, each layer
+	 * owns a block of [weights | bias weights] padded to a multiple of
+	 * ALIGNMENT floats. Trainable layers come first, so one optimizer pass
+	 * over [0, getTrainableSize()) updates the whole network.
+	 *
+	 * Weights and optimizer state are tracked in KnowledgeStore sized chunks.
+	 * A chunk stays clean until markDirty() flags it, and a snapshot only
+	 * copies dirty chunks and shares the clean ones. Restoring a snapshot
+	 * skips chunks that already hold its values. Everything that writes
+	 * weights or state must call markDirty(). A dirty chunk's buffer is
+	 * refilled in place once no snapshot references it any more, so a
+	 * steady stream of snapshots stops allocating.
+	 */
+	class NeuralArena {
+	protected:
+		std::unique_ptr<float[]> storage;
+		float* data;
+		size_t stride;
+		size_t trainableSize;
+		int stateSize;
+		std::map<int, ArenaBlock> blocks;
+		std::vector<KnowledgeChunkPtr> weightChunks;
+		std::vector<KnowledgeChunkPtr> stateChunks;
+		//Buffers behind the chunks last taken by a snapshot, kept for reuse after the chunks are marked dirty.
+		std::vector<std::shared_ptr<std::vector<float>>> weightBuffers;
+		std::vector<std::shared_ptr<std::vector<float>>> stateBuffers;
+	public:
+		static const size_t ALIGNMENT = 16;
+		NeuralArena();
+		NeuralArena(const NeuralArena&) = delete;
+		NeuralArena& operator=(const NeuralArena&) = delete;
+		//Lays out all layers and rebinds their signals to the new storage. Current weight values are preserved and state is zeroed.
+		void build(const std::vector<std::shared_ptr<NeuralLayer>>& layers, int stateSize);
+		int getStateSize() const {
+			return stateSize;
+		}
+		size_t getStride() const {
+			return stride;
+		}
+		size_t getTrainableSize() const {
+			return trainableSize;
+		}
+		size_t getCapacity() const {
+			return stride*(2 + stateSize);
+		}
+		bool isAllocated() const {
+			return (data != nullptr);
+		}
+		float* getWeights() {
+			return data;
+		}
+		const float* getWeights() const {
+			return data;
+		}
+		float* getChanges() {
+			return data + stride;
+		}
+		float* getState(int k) {
+			return data + (2 + k)*stride;
+		}
+		const float* getState(int k) const {
+			return data + (2 + k)*stride;
+		}
+		const ArenaBlock& getBlock(const NeuralLayer& layer) const;
+		const std::map<int, ArenaBlock>& getBlocks() const {
+			return blocks;
+		}
+		ParameterRange getRange();
+		ParameterRange getRange(const NeuralLayer& layer);
+		//Points the layers' weights back at the arena after they were bound elsewhere.
+		void rebindWeights(const std::vector<std::shared_ptr<NeuralLayer>>& layers);
+		void zeroChanges();
+		void zeroState();
+		//Flags [offset, offset + count) of the weights and every state slot as written since the last snapshot.
+		void markDirty(size_t offset, size_t count);
+		void markDirty();
+		//Points store at the current chunks. Passing the same store every time reuses its chunk table.
+		void snapshotWeights(KnowledgeStore& store);
+		void snapshotState(KnowledgeStore& store);
+		//Copies only the chunks that differ from the arena and optionally lists them. Returns false if the store does not match the arena's size.
+		bool restoreWeights(const KnowledgeStore& store, std::vector<size_t>* changed = nullptr);
+		bool restoreState(const KnowledgeStore& store);
+	};
+}
+#endif
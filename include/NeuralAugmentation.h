@@ -0,0 +1,103 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _NEURAL_AUGMENTATION_H_
+#define _NEURAL_AUGMENTATION_H_
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+namespace tgr {
+	/*
+	 * Random geometric and photometric distortion of single channel samples:
+	 * shift, rotation about the image center, elastic distortion (Simard et al.
+	 * 2003) and additive gaussian noise. Every sample draws from its own
+	 * generator seeded by (seed, iteration, index), so an augmented batch is
+	 * reproducible regardless of which thread produced it.
+	 */
+	class NeuralAugmentation {
+	protected:
+		float maxShift;
+		float maxRotation;
+		float elasticAlpha;
+		float elasticSigma;
+		float noise;
+		uint64_t seed;
+		std::atomic<uint64_t> sampleCount;
+		std::atomic<int64_t> busyTime;
+		void makeDisplacement(std::vector<float>& field, int width, int height, uint64_t sampleSeed) const;
+	public:
+		//maxShift in pixels, maxRotation in degrees.
+		NeuralAugmentation(float maxShift = 2.0f, float maxRotation = 10.0f, float elasticAlpha = 0.0f, float elasticSigma = 4.0f, float noise = 0.0f, uint64_t seed = 0);
+		void setShift(float s) {
+			maxShift = s;
+		}
+		void setRotation(float degrees) {
+			maxRotation = degrees;
+		}
+		void setElastic(float alpha, float sigma) {
+			elasticAlpha = alpha;
+			elasticSigma = sigma;
+		}
+		void setNoise(float n) {
+			noise = n;
+		}
+		void setSeed(uint64_t s) {
+			seed = s;
+		}
+		float getShift() const {
+			return maxShift;
+		}
+		float getRotation() const {
+			return maxRotation;
+		}
+		float getElasticAlpha() const {
+			return elasticAlpha;
+		}
+		float getElasticSigma() const {
+			return elasticSigma;
+		}
+		float getNoise() const {
+			return noise;
+		}
+		uint64_t getSeed() const {
+			return seed;
+		}
+		bool isIdentity() const {
+			return maxShift <= 0.0f&&maxRotation <= 0.0f&&elasticAlpha <= 0.0f&&noise <= 0.0f;
+		}
+		//Distorts a row major width x height image in place. Safe to call from several threads at once.
+		void apply(float* image, int width, int height, int iteration, int idx);
+		void apply(float* image, int width, int height, uint64_t sampleSeed);
+		uint64_t getSampleCount() const {
+			return sampleCount.load();
+		}
+		//Time spent inside apply() summed over all threads.
+		double getBusySeconds() const {
+			return 1E-9*busyTime.load();
+		}
+		//Samples per second of a single thread. Multiply by the producer thread count for the stage's capacity.
+		double getSamplesPerSecond() const;
+		void resetStats();
+	};
+	typedef std::shared_ptr<NeuralAugmentation> NeuralAugmentationPtr;
+	void ResampleBilinear(const float* src, float* dst, int width, int height, const float* transform, const float* dx, const float* dy);
+}
+#endif
@@ -1,50 +1,79 @@
 #ifndef _NEURAL_CACHE_H_
 #define _NEURAL_CACHE_H_
 #include "NeuralKnowledge.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
-#include <tuple>
-#include <set>
+#include <thread>
+#include <vector>
 namespace tgr {
-	class CacheElement {
+	/*
+	 * Memory-budgeted LRU cache of decoded frames in front of a slower loader,
+	 * such as a NeuralHistory. The set of resident frames is an immutable map
+	 * that writers replace as a whole, so find() on a resident frame never
+	 * takes the cache's mutex. Misses are loaded outside the lock. Neighbors
+	 * of the frame being viewed can be loaded ahead of time on a background
+	 * thread.
+	 */
+	class NeuralCache {
+	public:
+		typedef std::function<std::shared_ptr<NeuralKnowledge>(int frame)> Loader;
 	protected:
-		bool loaded;
-		bool writeOnce;
-		std::string knowledgeFile;
-		std::shared_ptr<NeuralKnowledge> neuralKnowledge;
-		std::mutex accessLock;
+		struct Entry {
+			std::shared_ptr<NeuralKnowledge> knowledge;
+			size_t bytes;
+			std::atomic<uint64_t> lastUse;
+			Entry(const std::shared_ptr<NeuralKnowledge>& knowledge, size_t bytes, uint64_t time) :knowledge(knowledge), bytes(bytes), lastUse(time) {
+			}
+		};
+		typedef std::map<int, std::shared_ptr<Entry>> Index;
+		std::shared_ptr<const Index> index;
+		std::mutex writeLock;
+		Loader loader;
+		size_t maxBytes;
+		size_t usedBytes;
+		std::atomic<uint64_t> clock;
+		std::atomic<uint64_t> generation;
+		std::atomic<uint64_t> hits;
+		std::atomic<uint64_t> misses;
+		std::thread prefetcher;
+		std::mutex prefetchLock;
+		std::condition_variable prefetchSignal;
+		std::deque<int> prefetchQueue;
+		bool running;
+		void insert(int frame, const std::shared_ptr<NeuralKnowledge>& knowledge, uint64_t gen);
+		//Loads and inserts a frame without touching the hit and miss counts.
+		std::shared_ptr<NeuralKnowledge> load(int frame);
+		void prefetchLoop();
 	public:
-		bool isLoaded() {
-			std::lock_guard<std::mutex> lockMe(accessLock);
-			return loaded;
-		}
-		CacheElement() :loaded(false), writeOnce(true) {
+		NeuralCache(const Loader& loader = nullptr, size_t maxBytes = 256 * 1024 * 1024);
+		~NeuralCache();
+		void setLoader(const Loader& l);
+		void setBudget(size_t bytes);
+		size_t getBudget() const {
+			return maxBytes;
 		}
-		~CacheElement();
-		std::string getFile() const {
-			return knowledgeFile;
+		//Returns the frame if it is resident, without loading it.
+		std::shared_ptr<NeuralKnowledge> find(int frame);
+		//Returns the frame, loading it on a miss.
+		std::shared_ptr<NeuralKnowledge> get(int frame);
+		void set(int frame, const std::shared_ptr<NeuralKnowledge>& knowledge);
+		//Replaces the pending prefetch list. Frames are loaded in the order given.
+		void prefetch(const std::vector<int>& frames);
+		void clear();
+		size_t getUsedBytes();
+		//Counts only get() calls. Prefetched frames are neither hits nor misses.
+		uint64_t getHitCount() const {
+			return hits.load();
 		}
-		void load();
-		void unload();
-		void set(const NeuralKnowledge& neuralKnowledge);
-		std::shared_ptr<NeuralKnowledge> getKnowledge();
-	};
-	struct CacheCompare {
-		inline bool operator() (const std::pair<uint64_t, int>& lhs, const std::pair<uint64_t, int>& rhs) const {
-			return lhs.first < rhs.first;
+		uint64_t getMissCount() const {
+			return misses.load();
 		}
 	};
-	class NeuralCache {
-	protected:
-		std::map<int, std::shared_ptr<CacheElement>> cache;
-		std::set<std::pair<uint64_t, int>, CacheCompare> loadedList;
-		std::mutex accessLock;
-		int maxElements = 32;
-		uint64_t counter = 0;
-	public:
-		std::shared_ptr<CacheElement> set(int frame, const NeuralKnowledge& springl);
-		std::shared_ptr<CacheElement> get(int frame);
-		void clear();
-	};
+	typedef std::shared_ptr<NeuralCache> NeuralCachePtr;
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,103 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _NEURAL_CHECKPOINT_H_
+#define _NEURAL_CHECKPOINT_H_
+#include "NeuralKnowledge.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+namespace tgr {
+	//When to snapshot. A snapshot is taken if any enabled condition holds; zero or false disables a condition.
+	struct CheckpointPolicy {
+		int everyIterations;
+		double everySeconds;
+		bool onImprovement;
+		CheckpointPolicy(int everyIterations = 1, double everySeconds = 0.0, bool onImprovement = false) :everyIterations(everyIterations), everySeconds(everySeconds), onImprovement(onImprovement) {
+		}
+	};
+	/*
+	 * Moves checkpointing off the training thread. The trainer copies its
+	 * parameters into a snapshot and submits it. A writer thread hands
+	 * snapshots to the sink, which compresses or serializes them on that
+	 * thread. The queue is a fixed ring. When the writer falls behind, the
+	 * oldest pending snapshot is dropped so the trainer never waits on disk
+	 * and submitting never allocates.
+	 */
+	class NeuralCheckpointWriter {
+	public:
+		typedef std::chrono::steady_clock Clock;
+		typedef std::function<void(int iteration, const std::shared_ptr<NeuralKnowledge>& knowledge)> Sink;
+	protected:
+		struct Checkpoint {
+			int iteration;
+			std::shared_ptr<NeuralKnowledge> knowledge;
+		};
+		Sink sink;
+		CheckpointPolicy policy;
+		std::vector<Checkpoint> queue;
+		size_t head;
+		size_t queued;
+		bool running;
+		bool busy;
+		std::thread writer;
+		std::mutex lock;
+		std::condition_variable pending;
+		std::condition_variable drained;
+		int lastIteration;
+		Clock::time_point lastTime;
+		double bestResidual;
+		std::atomic<uint64_t> writtenCount;
+		std::atomic<uint64_t> droppedCount;
+		void run();
+	public:
+		NeuralCheckpointWriter(const Sink& sink, size_t capacity = 4);
+		~NeuralCheckpointWriter();
+		void setPolicy(const CheckpointPolicy& p) {
+			policy = p;
+		}
+		const CheckpointPolicy& getPolicy() const {
+			return policy;
+		}
+		void start();
+		//Writes all pending snapshots, then joins the writer thread.
+		void stop();
+		//Blocks until every submitted snapshot has been passed to the sink.
+		void flush();
+		//Forgets the policy's last snapshot time, iteration and best residual.
+		void reset();
+		//Evaluates the policy. If a snapshot is due, it also records this iteration as the last snapshot.
+		bool isDue(int iteration, double residual);
+		void submit(int iteration, const std::shared_ptr<NeuralKnowledge>& knowledge);
+		uint64_t getWrittenCount() const {
+			return writtenCount.load();
+		}
+		uint64_t getDroppedCount() const {
+			return droppedCount.load();
+		}
+	};
+	typedef std::shared_ptr<NeuralCheckpointWriter> NeuralCheckpointWriterPtr;
+}
+#endif
@@ -25,6 +25,8 @@
 
 #include "AlloyUI.h"
 #include "AvoidanceRouting.h"
+#include <map>
+#include <set>
 namespace aly {
 	class NeuralFlowPane;
 	class NeuralConnection: public dataflow::AvoidanceConnection {
@@ -67,6 +69,10 @@ namespace aly {
 		ImageGlyphPtr backgroundImage;
 		bool dragEnabled;
 		tgr::NeuralLayer* selectedLayer;
+		//Obstacle bounds of each region when connections were last routed.
+		std::map<NeuralLayerRegion*, box2px> routedBounds;
+		//Reroutes only connections that touch a moved or added region, or whose path crosses where one was or is now.
+		void route();
 	public:
 		std::function<void(tgr::NeuralLayer*, const InputEvent& e)> onSelect;
 		void setSelected(tgr::NeuralLayer* layer, const InputEvent& e) {
@@ -0,0 +1,135 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _NEURAL_FOOTPRINT_H_
+#define _NEURAL_FOOTPRINT_H_
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+/*
+ * Memory accounting for a network, broken down per layer and per filter.
+ * Object counts are exact. Byte counts are payload: object sizes, vector
+ * capacities and map nodes, without allocator overhead. They are a lower
+ * bound on what the heap holds.
+ *
+ * NeuralSystem::getFootprint() measures a built network. FootprintEstimator
+ * computes the same figures from filter parameters without creating any
+ * neurons or signals. A network that will not fit can then be rejected
+ * before NeuralSystem::add() runs out of memory.
+ */
+namespace tgr {
+	struct LayerFootprint {
+		std::string name;
+		int id;
+		//Neurons including bias neurons.
+		size_t neurons;
+		//Distinct weights, including bias weights.
+		size_t signals;
+		//Neuron to neuron links through a signal.
+		size_t connections;
+		//Neuron objects and the signal lists they hold.
+		size_t neuronBytes;
+		//Signal objects and their shared_ptr control blocks.
+		size_t signalBytes;
+		//Nodes and neuron lists of the signals' forward and backward maps.
+		size_t mappingBytes;
+		//Responses and their changes, and weights and their changes.
+		size_t knowledgeBytes;
+		//Optimizer state kept in the arena.
+		size_t stateBytes;
+		//Buffers published for the UI.
+		size_t snapshotBytes;
+		LayerFootprint(const std::string& name = "", int id = -1) :name(name), id(id), neurons(0), signals(0), connections(0), neuronBytes(0), signalBytes(0), mappingBytes(0), knowledgeBytes(0), stateBytes(0), snapshotBytes(0) {
+		}
+		size_t getGraphBytes() const {
+			return neuronBytes + signalBytes + mappingBytes;
+		}
+		size_t getBytes() const {
+			return getGraphBytes() + knowledgeBytes + stateBytes + snapshotBytes;
+		}
+		LayerFootprint& operator+=(const LayerFootprint& r);
+	};
+	struct FilterFootprint {
+		std::string name;
+		//Indexes of the filter's output layers in SystemFootprint::layers.
+		std::vector<int> layers;
+		LayerFootprint total;
+	};
+	struct SystemFootprint {
+		std::vector<LayerFootprint> layers;
+		std::vector<FilterFootprint> filters;
+		LayerFootprint total;
+		//Chunks of the system's own NeuralKnowledge snapshot.
+		size_t knowledgeBytes;
+		//Knowledge held by a history cache. Filled in by whoever owns the cache, e.g. from NeuralCache::getUsedBytes().
+		size_t cacheBytes;
+		SystemFootprint() :total("Total"), knowledgeBytes(0), cacheBytes(0) {
+		}
+		size_t getBytes() const {
+			return total.getBytes() + knowledgeBytes + cacheBytes;
+		}
+	};
+	/*
+	 * Dry run of a network build. Each add call mirrors the filter of the
+	 * same name and returns handles to its output layers, which are passed
+	 * on as inputs to later calls, like NeuralLayerPtrs are when building.
+	 */
+	class FootprintEstimator {
+	protected:
+		struct Shape {
+			int width;
+			int height;
+			int bins;
+			bool bias;
+			//Entries in the neurons' input and output signal lists.
+			size_t inputEntries;
+			size_t outputEntries;
+			//Entries in the signals' forward and backward maps.
+			size_t forwardEntries;
+			size_t backwardEntries;
+		};
+		std::vector<LayerFootprint> layers;
+		std::vector<Shape> shapes;
+		std::vector<FilterFootprint> filters;
+		int stateSize;
+		int addLayer(const std::string& name, int width, int height, int bins, bool bias);
+		void addSignals(int layer, size_t signals, size_t connections, size_t forwardEntries, size_t backwardEntries, size_t inputEntries);
+		void addFilter(const std::string& name, const std::vector<int>& outputs);
+		const Shape& getShape(int layer) const;
+	public:
+		//stateSize is the optimizer's NeuralOptimization::getStateSize().
+		FootprintEstimator(int stateSize = 0);
+		void setStateSize(int s) {
+			stateSize = s;
+		}
+		int addInput(const std::string& name, int width, int height, int bins = 1);
+		std::vector<int> addConvolution(const std::string& name, const std::vector<int>& inputs, int kernelSize, int features, bool bias, const std::vector<std::pair<int, int>>& connectionMap = std::vector<std::pair<int, int>>());
+		std::vector<int> addAveragePool(const std::string& name, const std::vector<int>& inputs, int kernelSize, bool bias);
+		int addFullyConnected(const std::string& name, const std::vector<int>& inputs, int width, int height, bool bias);
+		SystemFootprint getFootprint() const;
+	};
+	//Payload of one std::map entry mapping a neuron to a list of neurons, without the list's elements.
+	size_t GetMappingEntryBytes();
+	size_t GetSignalBytes();
+	void WriteFootprintReport(std::ostream& os, const SystemFootprint& footprint);
+}
+#endif
@@ -0,0 +1,67 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _NEURAL_HEATMAP_H_
+#define _NEURAL_HEATMAP_H_
+#include "AlloyImage.h"
+#include "AlloyColor.h"
+#include <cstdint>
+#include <vector>
+namespace tgr {
+	class NeuralLayer;
+}
+namespace aly {
+	/*
+	 * Draws a layer's responses directly into an RGBA image, one glyph per
+	 * neuron, without NanoVG, a framebuffer or a texture read back. The
+	 * neuron glyph is supersampled once into a stamp. Each pixel of the stamp
+	 * is split into a constant color and the weight of the neuron's fill
+	 * color, so drawing a cell is one multiply-add per channel in SSE. Fill
+	 * colors come from a RedToBlue lookup table indexed by the normalized
+	 * response.
+	 *
+	 * Large layers are drawn through a window of neurons, optionally averaged
+	 * into square tiles, so the image never needs more pixels than the
+	 * screen shows.
+	 */
+	class NeuralHeatmap {
+	protected:
+		int cellSize;
+		//Constant color per stamp channel in 8.8 fixed point.
+		std::vector<uint16_t> base;
+		//Fill color weight per stamp channel, from 0 to 256.
+		std::vector<uint16_t> weight;
+		std::vector<uint16_t> lut;
+	public:
+		static const int LUT_SIZE = 256;
+		NeuralHeatmap(int cellSize, const Color& background, const Color& ring = Color(92, 92, 92), const Color& stroke = Color(220, 220, 220));
+		//Flat cells filled with the response color, for cells too small to show the glyph.
+		explicit NeuralHeatmap(int cellSize);
+		int getCellSize() const {
+			return cellSize;
+		}
+		//Resizes the image to the layer's dimensions times the cell size. Values are the layer's responses, normally from its published snapshot.
+		bool rasterize(const tgr::NeuralLayer& layer, const std::vector<float>& values, ImageRGBA& image) const;
+		//Rasterizes neurons [start,end) only, one cell per tile x tile block of neurons showing the block's mean response.
+		bool rasterize(const tgr::NeuralLayer& layer, const std::vector<float>& values, int2 start, int2 end, int tile, ImageRGBA& image) const;
+	};
+	typedef std::shared_ptr<NeuralHeatmap> NeuralHeatmapPtr;
+}
+#endif
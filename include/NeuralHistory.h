@@ -0,0 +1,107 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _NEURAL_HISTORY_H_
+#define _NEURAL_HISTORY_H_
+#include "NeuralKnowledge.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+namespace tgr {
+	struct NeuralHistoryOptions {
+		//A full copy is stored every keyframeInterval frames. Frames in between are deltas against the previous frame.
+		int keyframeInterval;
+		//zlib level, 1 is fastest.
+		int compressionLevel;
+		//Stores the weights of non-keyframes at half precision, so reconstructed weights are exact to fp16 only. Optimizer state is always kept at full precision.
+		bool halfPrecision;
+		NeuralHistoryOptions(int keyframeInterval = 16, int compressionLevel = 1, bool halfPrecision = false) :keyframeInterval(keyframeInterval), compressionLevel(compressionLevel), halfPrecision(halfPrecision) {
+		}
+	};
+	/*
+	 * Compressed training history. Each frame holds the weights and optimizer
+	 * state of one checkpoint. Keyframes store the float bits. Other frames
+	 * store the zigzag encoded difference between their bit patterns and the
+	 * previous frame's. Consecutive checkpoints share sign, exponent and the
+	 * high mantissa bits, so the high bytes of each difference are zero. The
+	 * bytes are split into planes by significance before zlib, which groups
+	 * those zeros into long runs.
+	 *
+	 * A frame is reconstructed from its keyframe plus at most
+	 * keyframeInterval-1 deltas. The last reconstructed frame is kept, so
+	 * scrubbing forward costs a single delta per frame.
+	 */
+	class NeuralHistory {
+	protected:
+		struct Frame {
+			int keyframe;
+			bool half;
+			size_t count;
+			size_t weightCount;
+			//Shared so readers can decode a frame after releasing accessLock.
+			std::shared_ptr<const std::vector<uint8_t>> data;
+			std::shared_ptr<NeuralKnowledge> header;
+		};
+		NeuralHistoryOptions options;
+		std::map<int, Frame> frames;
+		//Encoder state, guarded by encodeLock.
+		std::vector<float> last;
+		int lastFrame;
+		int lastKeyframe;
+		int sinceKeyframe;
+		//Last reconstruction, guarded by decodeLock.
+		std::vector<float> cursor;
+		int cursorFrame;
+		//Stores of the last frame returned. Unchanged chunks are reused, so the arena can skip them on restore.
+		KnowledgeStore cursorWeights;
+		KnowledgeStore cursorState;
+		size_t rawBytes;
+		size_t storedBytes;
+		//Locks are taken in the order encodeLock, decodeLock, accessLock. accessLock is never held while compressing or decoding.
+		std::mutex encodeLock;
+		std::mutex decodeLock;
+		mutable std::mutex accessLock;
+		void decode(const Frame& frame, bool keyframe, std::vector<float>& values);
+	public:
+		NeuralHistory(const NeuralHistoryOptions& options = NeuralHistoryOptions());
+		void setOptions(const NeuralHistoryOptions& opts);
+		const NeuralHistoryOptions& getOptions() const {
+			return options;
+		}
+		//Frames must be added in increasing order.
+		void add(int frame, const NeuralKnowledge& knowledge);
+		bool contains(int frame) const;
+		//Latest stored frame at or before frame, or -1 if there is none.
+		int getFloor(int frame) const;
+		//Up to radius stored frames on each side of frame, ordered by distance from it.
+		std::vector<int> getNeighbors(int frame, int radius) const;
+		bool get(int frame, NeuralKnowledge& knowledge);
+		std::shared_ptr<NeuralKnowledge> get(int frame);
+		void clear();
+		size_t size() const;
+		//Bytes the frames would take as uncompressed float copies.
+		size_t getRawBytes() const;
+		//Compressed bytes actually held.
+		size_t getStoredBytes() const;
+	};
+	typedef std::shared_ptr<NeuralHistory> NeuralHistoryPtr;
+}
+#endif
@@ -5,19 +5,151 @@
 #include <cereal/types/vector.hpp>
 #include <cereal/types/string.hpp>
 #include <cereal/types/map.hpp>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
 
 namespace tgr {
 	class NeuralLayer;
 	class NeuralSystem;
 	typedef aly::Vec<float> Knowledge;
+	//Non-owning window onto weights that live in a layer's local storage or in the system's NeuralArena.
+	struct KnowledgeView {
+	protected:
+		float* data;
+		size_t count;
+	public:
+		KnowledgeView() :data(nullptr), count(0) {
+		}
+		KnowledgeView(float* data, size_t count) :data(data), count(count) {
+		}
+		explicit KnowledgeView(Knowledge& k) :data(k.ptr()), count(k.size()) {
+		}
+		size_t size() const {
+			return count;
+		}
+		float* ptr() {
+			return data;
+		}
+		const float* ptr() const {
+			return data;
+		}
+		float& operator[](const size_t i) {
+			return data[i];
+		}
+		const float& operator[](const size_t i) const {
+			return data[i];
+		}
+		void setZero() {
+			if (count > 0)std::memset(data, 0, count * sizeof(float));
+		}
+		void set(const float* src, size_t n) {
+			if (n != count) {
+				throw std::runtime_error("Knowledge size does not match layer.");
+			}
+			if (count > 0)std::memcpy(data, src, count * sizeof(float));
+		}
+		void set(const Knowledge& k) {
+			set(k.ptr(), k.size());
+		}
+		void set(const KnowledgeView& k) {
+			set(k.ptr(), k.size());
+		}
+		void get(Knowledge& k) const {
+			k.resize(count);
+			if (count > 0)std::memcpy(k.ptr(), data, count * sizeof(float));
+		}
+	};
+	typedef std::shared_ptr<const std::vector<float>> KnowledgeChunkPtr;
+	/*
+	 * Flat float array held as fixed size chunks that are never modified once
+	 * created. Copying a store only copies chunk pointers, so snapshots share
+	 * every chunk that did not change between them and with the NeuralArena
+	 * they were taken from.
+	 */
+	class KnowledgeStore {
+	protected:
+		std::vector<KnowledgeChunkPtr> chunks;
+		size_t count;
+	public:
+		static const size_t CHUNK_SIZE = 16384;
+		static size_t GetChunkCount(size_t n) {
+			return (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		}
+		KnowledgeStore() :count(0) {
+		}
+		KnowledgeStore(const std::vector<KnowledgeChunkPtr>& chunks, size_t count);
+		size_t size() const {
+			return count;
+		}
+		bool empty() const {
+			return (count == 0);
+		}
+		size_t getChunkCount() const {
+			return chunks.size();
+		}
+		const KnowledgeChunkPtr& getChunk(size_t c) const {
+			return chunks[c];
+		}
+		float operator[](const size_t i) const {
+			return (*chunks[i / CHUNK_SIZE])[i % CHUNK_SIZE];
+		}
+		void clear() {
+			chunks.clear();
+			count = 0;
+		}
+		void assign(const std::vector<KnowledgeChunkPtr>& c, size_t n);
+		void assign(const float* data, size_t n);
+		void assign(const std::vector<float>& data) {
+			assign(data.data(), data.size());
+		}
+		//Keeps the chunks of previous that already hold these values, so stores rebuilt one after another still share them.
+		void assign(const float* data, size_t n, const KnowledgeStore& previous);
+		//Copies n values starting at offset into dst.
+		void copyTo(float* dst, size_t offset, size_t n) const;
+		void copyTo(float* dst) const {
+			copyTo(dst, 0, count);
+		}
+		std::vector<float> toVector() const;
+	};
+	struct KnowledgeLayout {
+		uint64_t offset;
+		uint64_t weights;
+		uint64_t biasWeights;
+		//Shape of the layer the block belongs to, so a model file describes its network.
+		uint32_t width;
+		uint32_t height;
+		uint32_t bins;
+		//NeuronFunctionType of the layer's neurons, or -1 if unknown.
+		int32_t neuronType;
+		KnowledgeLayout(uint64_t offset = 0, uint64_t weights = 0, uint64_t biasWeights = 0) :offset(offset), weights(weights), biasWeights(biasWeights), width(0), height(0), bins(0), neuronType(-1) {
+		}
+		template<class Archive> void serialize(Archive & ar)
+		{
+			ar(CEREAL_NVP(offset), CEREAL_NVP(weights), CEREAL_NVP(biasWeights), CEREAL_NVP(width), CEREAL_NVP(height), CEREAL_NVP(bins), CEREAL_NVP(neuronType));
+		}
+	};
+	/*
+	 * Snapshot of a system's trainable parameters. The weights are stored flat,
+	 * in the same layout as the NeuralArena they were taken from, and the
+	 * layout table maps layer ids to their range in the flat store. Optimizer
+	 * state slots are stored the same way, one stride per slot, so training
+	 * can resume from a snapshot. Both stores share unchanged chunks with the
+	 * arena, so copying a NeuralKnowledge is cheap.
+	 */
 	class NeuralKnowledge {
 	protected:
-		std::map<int, Knowledge> weights;
-		std::map<int, Knowledge> biasWeights;
+		KnowledgeStore weights;
+		KnowledgeStore state;
+		std::map<int, KnowledgeLayout> layout;
 		std::string name;
 		std::string file;
+		int optimizer;
+		int stateSize;
+		int64_t step;
 	public:
-		NeuralKnowledge(const std::string& name=""):name(name) {}
+		NeuralKnowledge(const std::string& name=""):name(name),optimizer(-1),stateSize(0),step(0) {}
 		std::string getName() const {
 			return name;
 		}
@@ -30,27 +162,84 @@ namespace tgr {
 		void setFile(const std::string& f) {
 			file = f;
 		}
-		Knowledge& getWeights(const NeuralLayer& layer);
-		const Knowledge& getWeights(const NeuralLayer& layer) const;
-
-		Knowledge& getBiasWeights(const NeuralLayer& layer);
-		const Knowledge& getBiasWeights(const NeuralLayer& layer) const;
+		const KnowledgeLayout& getLayout(const NeuralLayer& layer) const;
+		//Copies the weights and bias weights for a layer into its current storage.
+		void copyTo(NeuralLayer& layer) const;
+		//Copies optimizer state slot k for a layer, laid out as weights followed by bias weights.
+		void copyState(const NeuralLayer& layer, int k, float* dst) const;
+		KnowledgeStore& getData() {
+			return weights;
+		}
+		const KnowledgeStore& getData() const {
+			return weights;
+		}
+		size_t size() const {
+			return weights.size();
+		}
+		//Optimizer state slots, one arena stride per slot.
+		KnowledgeStore& getStateData() {
+			return state;
+		}
+		const KnowledgeStore& getStateData() const {
+			return state;
+		}
+		//NeuralOptimizer type that produced the state, or -1 if there was no optimizer.
+		int getOptimizer() const {
+			return optimizer;
+		}
+		int getStateSize() const {
+			return stateSize;
+		}
+		int64_t getStep() const {
+			return step;
+		}
+		void setOptimizerState(int type, int size, int64_t s) {
+			optimizer = type;
+			stateSize = size;
+			step = s;
+		}
+		std::map<int, KnowledgeLayout>& getLayouts() {
+			return layout;
+		}
+		const std::map<int, KnowledgeLayout>& getLayouts() const {
+			return layout;
+		}
 		void clear() {
 			weights.clear();
+			state.clear();
+			layout.clear();
+			optimizer = -1;
+			stateSize = 0;
+			step = 0;
+		}
+		//Shares the system's arena chunks. Only chunks written since the last snapshot are copied.
+		void set(NeuralSystem& sys);
+		//Copies everything but the weight and state data.
+		void setHeader(const NeuralKnowledge& other) {
+			name = other.name;
+			file = other.file;
+			layout = other.layout;
+			optimizer = other.optimizer;
+			stateSize = other.stateSize;
+			step = other.step;
 		}
-		void add(const NeuralLayer& layer);
-		void set(const NeuralSystem& sys);
 		template<class Archive> void save(Archive & ar) const
 		{
-			ar(CEREAL_NVP(name), CEREAL_NVP(file), CEREAL_NVP(weights), CEREAL_NVP(biasWeights));
+			std::vector<float> weights = this->weights.toVector();
+			std::vector<float> state = this->state.toVector();
+			ar(CEREAL_NVP(name), CEREAL_NVP(file), CEREAL_NVP(layout), CEREAL_NVP(weights), CEREAL_NVP(optimizer), CEREAL_NVP(stateSize), CEREAL_NVP(step), CEREAL_NVP(state));
 		}
 		template<class Archive> void load(Archive & ar)
 		{
-			ar(CEREAL_NVP(name), CEREAL_NVP(file), CEREAL_NVP(weights), CEREAL_NVP(biasWeights));
+			std::vector<float> weights;
+			std::vector<float> state;
+			ar(CEREAL_NVP(name), CEREAL_NVP(file), CEREAL_NVP(layout), CEREAL_NVP(weights), CEREAL_NVP(optimizer), CEREAL_NVP(stateSize), CEREAL_NVP(step), CEREAL_NVP(state));
+			this->weights.assign(weights);
+			this->state.assign(state);
 		}
 	};
 	void WriteNeuralKnowledgeToFile(const std::string& file, const NeuralKnowledge& params);
 	void ReadNeuralKnowledgeFromFile(const std::string& file, NeuralKnowledge& params);
 
 }
-#endif
\ No newline at end of file
+#endif
@@ -29,6 +29,8 @@
 #include "NeuralLayerRegion.h"
 #include "NeuralOptimization.h"
 #include "NeuralKnowledge.h"
+#include "NeuralSnapshot.h"
+#include "NeuralFootprint.h"
 #include <vector>
 #include <set>
 
@@ -94,20 +96,30 @@ namespace tgr {
 			bool compiled;
 			bool visited;
 			bool trainable;
+			bool dirty;
+			//Bumped whenever responses or weights change, so publish() can skip layers that are unchanged.
+			uint64_t revision;
+			uint64_t publishedRevision;
+			SnapshotBufferPtr snapshots;
 			double residualError;
 			aly::NeuralLayerRegionPtr layerRegion;
 			aly::GraphDataPtr graph;
 			
 			NeuralSystem* sys;
 			int id;
+			//Backing store used between compile() and the system binding the layer to its NeuralArena.
+			Knowledge weightStorage;
+			Knowledge weightChangeStorage;
+			Knowledge biasWeightStorage;
+			Knowledge biasWeightChangeStorage;
 		public:
 			int width;
 			int height;
 			int bins;
-			Knowledge weights;
-			Knowledge weightChanges;
-			Knowledge biasWeights;
-			Knowledge biasWeightChanges;
+			KnowledgeView weights;
+			KnowledgeView weightChanges;
+			KnowledgeView biasWeights;
+			KnowledgeView biasWeightChanges;
 			Knowledge responses;
 			Knowledge responseChanges;
 			Knowledge biasResponses;
@@ -120,29 +132,37 @@ namespace tgr {
 				return id;
 			}
 			void setId(int id);
-			void set(const Knowledge& k,const Knowledge& bk);
-			Knowledge& getWeights() {
+			void set(const KnowledgeView& k,const KnowledgeView& bk);
+			void bind(float* weightData, float* changeData);
+			//Points weights and signals at external storage without copying, e.g. a mapped model file.
+			void bindWeights(float* weightData);
+			//Call after writing the layer's weights. Flags its arena block for the next snapshot and its responses as stale.
+			void markDirty();
+			KnowledgeView& getWeights() {
 				return weights;
 			}
+			KnowledgeView& getBiasWeights() {
+				return biasWeights;
+			}
 			Knowledge& getResponses() {
 				return responses;
 			}
-			Knowledge& getWeightChanges() {
+			KnowledgeView& getWeightChanges() {
 				return weightChanges;
 			}
 			Knowledge& getResponseChanges() {
 				return responseChanges;
 			}
-			const Knowledge& getWeights() const {
+			const KnowledgeView& getWeights() const {
 				return weights;
 			}
-			const Knowledge& getBiasWeights() const {
+			const KnowledgeView& getBiasWeights() const {
 				return biasWeights;
 			}
 			const Knowledge& getResponses() const {
 				return responses;
 			}
-			const Knowledge& getWeightChanges() const {
+			const KnowledgeView& getWeightChanges() const {
 				return weightChanges;
 			}
 			const Knowledge& getResponseChanges() const {
@@ -194,7 +214,27 @@ namespace tgr {
 			void evaluate();
 			void reset();
 			void initializeWeights(float minW=0.0f, float maxW=1.0f);
+			//Also invalidates the children, since it signals responses written outside of evaluate().
 			void setRegionDirty(bool d);
+			//Responses are stale and will be recomputed by the next NeuralSystem::evaluate().
+			bool isDirty() const {
+				return dirty;
+			}
+			//Marks this layer and everything downstream of it as stale. Roots hold inputs and are never stale themselves.
+			void invalidate();
+			void invalidateChildren();
+			//Copies responses and weights into the layer's snapshot buffer. Only the training thread may call this.
+			void publish(int64_t iteration);
+			//The UI reads the last published snapshot instead of the live buffers, which training may be writing to.
+			SnapshotBufferPtr getSnapshots() const {
+				return snapshots;
+			}
+			//Memory held by the layer, including its share of the system's arena. See NeuralFootprint.h.
+			LayerFootprint getFootprint() const;
+			//Index of the neuron in this layer, or -1 if it belongs to another layer.
+			int getIndex(const Neuron* n) const;
+			//Index of the signal's weight in a snapshot's weights, or -1 if the signal feeds another layer.
+			int getWeightIndex(const Signal* sig) const;
 			void backpropagate();
 			aly::NeuralLayerRegionPtr getRegion();
 			bool hasRegion() const {
@@ -267,6 +307,7 @@ namespace tgr {
 			const Neuron& operator()(const Terminal ij) const;
 			void set(const aly::Image1f& input);
 			void set(const std::vector<float>& input);
+			void set(const float* input, size_t N);
 			void get(aly::Image1f& input);
 			void get(std::vector<float>& input);
 			std::vector<Neuron>& getNeurons() {
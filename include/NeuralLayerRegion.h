@@ -23,7 +23,7 @@
 
 #include "AlloyWidget.h"
 #include "AvoidanceRouting.h"
-#include "GLFrameBuffer.h"
+#include "NeuralHeatmap.h"
 namespace tgr {
 	class NeuralLayer;
 	class Neuron;
@@ -40,13 +40,67 @@ namespace aly {
 		std::shared_ptr<IconButton> cancelButton;
 		std::shared_ptr<IconButton> expandButton;
 		std::list<tgr::Neuron*> activeList;
-		aly::ImageRGBA cacheImage;
+		//Taken from a shared pool when the region first rasterizes and returned by release().
+		std::shared_ptr<aly::ImageRGBA> cacheImage;
 
 		aly::ImageGlyphPtr cacheGlyph;
+		//One heatmap per power of two cell size, from 1 to GLYPH_SIZE.
+		std::vector<NeuralHeatmapPtr> heatmaps;
 		bool cacheDirty;
-		aly::GLFrameBuffer renderBuffer;
-		void drawCache(AlloyContext* context);
+		bool cacheReady;
+		//Neurons [windowStart,windowEnd) are rasterized, cacheTile x cacheTile neurons per cell of cacheCell pixels.
+		int2 windowStart, windowEnd;
+		int cacheTile;
+		int cacheCell;
+		//Window of the uploaded glyph, which lags the requested window until the next upload.
+		int2 glyphStart, glyphEnd;
+		//Where a hovered neuron's input value is published. Layer is null for bias neurons, which are constant.
+		struct HoverInput {
+			const tgr::NeuralLayer* layer;
+			int index;
+			const tgr::Neuron* neuron;
+		};
+		struct HoverSignal {
+			int weightIndex;
+			int mappings;
+			std::vector<HoverInput> inputs;
+		};
+		struct HoverNeuron {
+			int2 position;
+			std::vector<HoverSignal> signals;
+		};
+		//Connectivity of the neurons around the cursor, resolved once per selection instead of every frame.
+		std::vector<HoverNeuron> hoverNeurons;
+		int hoverRadius;
+		void updateHover(int2 selected);
+		HoverInput resolve(const tgr::Neuron* n) const;
+		//Normalized response as of the last published snapshot.
+		float getPublishedValue(const HoverInput& in) const;
+		box2px getContentBounds() const;
 	public:
+		static const int GLYPH_SIZE = 32;
+		//Cells smaller than this are drawn flat instead of as glyphs.
+		static const int MIN_GLYPH_SIZE = 8;
+		//Per-neuron outlines are only drawn when neurons are at least this many pixels wide.
+		static const int MIN_DETAIL_SIZE = 4;
+		//The raster window snaps to blocks of this many cells, so small pans do not re-rasterize.
+		static const int WINDOW_BLOCK = 16;
+		//Most hidden regions' cache images are kept for reuse. Beyond this many, they are freed.
+		static const int MAX_POOLED_IMAGES = 16;
+		//Returns the cache image to the pool and frees the glyph texture. The region rasterizes again the next time it is drawn.
+		void release();
+		bool isReleased() const {
+			return (cacheImage.get() == nullptr && cacheGlyph.get() == nullptr);
+		}
+		//Picks the cell size, tile size and window of neurons to rasterize from the on-screen size and clipping. Marks the cache dirty if they changed.
+		void updateDetail();
+		//Rasterizes the layer's published responses into the cache image on the CPU. Regions can be rasterized in parallel.
+		void rasterize();
+		//Uploads a rasterized cache image. Must be called from the render thread.
+		void upload(AlloyContext* context);
+		bool isDirty() const {
+			return cacheDirty;
+		}
 
 		pixel2 cursorPosition;
 		pixel2 cursorOffset;
@@ -0,0 +1,110 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _NEURAL_MODEL_FILE_H_
+#define _NEURAL_MODEL_FILE_H_
+#include "MappedFile.h"
+#include "NeuralKnowledge.h"
+#include <memory>
+#include <string>
+namespace tgr {
+	/*
+	 * Flat model file (.tgrm), little endian:
+	 *   ModelHeader (64 bytes)
+	 *   layerCount ModelLayerEntry (64 bytes each)
+	 *   weights at dataOffset: one arena stride of floats, 64 byte aligned
+	 *   optimizer state at stateOffset: stateSize strides of floats
+	 * The weights are the arena image, so each layer's [weights | bias
+	 * weights] block is 64 byte aligned in the file and a mapped file can
+	 * be used as weight storage in place.
+	 */
+	enum class ModelDataType : uint32_t {
+		Float32 = 0
+	};
+	struct ModelHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t layerCount;
+		int32_t optimizer;
+		uint32_t stateSize;
+		uint32_t reserved;
+		int64_t step;
+		uint64_t stride;
+		uint64_t tableOffset;
+		uint64_t dataOffset;
+		uint64_t stateOffset;
+	};
+	struct ModelLayerEntry {
+		int32_t id;
+		uint32_t dataType;
+		uint64_t weights;
+		uint64_t biasWeights;
+		//Position of the layer's block inside the arena stride, in floats.
+		uint64_t arenaOffset;
+		//Position of the layer's block in the file, in bytes.
+		uint64_t offset;
+		//CRC32 of the weights and bias weights.
+		uint32_t checksum;
+		//Layer shape. Zero in version 1 files.
+		uint32_t width;
+		uint32_t height;
+		uint32_t bins;
+		//NeuronFunctionType of the layer, or -1 if unknown.
+		int32_t neuronType;
+		uint32_t reserved;
+	};
+	static_assert(sizeof(ModelHeader) == 64, "Model header must be 64 bytes.");
+	static_assert(sizeof(ModelLayerEntry) == 64, "Model layer entry must be 64 bytes.");
+	//Read-only mapping of a model file.
+	class NeuralModelFile {
+	protected:
+		MappedFile file;
+		std::string fileName;
+		const ModelHeader* header;
+		const ModelLayerEntry* table;
+	public:
+		//Validates the header and table. With verify, every layer's checksum is checked too, which reads the whole file.
+		NeuralModelFile(const std::string& file, bool verify = true);
+		const std::string& getFile() const {
+			return fileName;
+		}
+		const ModelHeader& getHeader() const {
+			return *header;
+		}
+		int getLayerCount() const {
+			return (int)header->layerCount;
+		}
+		const ModelLayerEntry& getLayer(int i) const {
+			return table[i];
+		}
+		const ModelLayerEntry* findLayer(int id) const;
+		const float* getWeights() const {
+			return (const float*)(file.ptr() + header->dataOffset);
+		}
+		const float* getState(int k) const {
+			return (const float*)(file.ptr() + header->stateOffset) + k*header->stride;
+		}
+		bool verify(const ModelLayerEntry& entry) const;
+	};
+	typedef std::shared_ptr<NeuralModelFile> NeuralModelFilePtr;
+	void WriteNeuralModelToFile(const std::string& file, const NeuralKnowledge& knowledge);
+	void ReadNeuralModelFromFile(const std::string& file, NeuralKnowledge& knowledge, bool verify = true);
+}
+#endif
@@ -0,0 +1,35 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _NEURAL_MODELS_H_
+#define _NEURAL_MODELS_H_
+#include "NeuralSystem.h"
+#include "NeuralFootprint.h"
+#include <functional>
+namespace tgr {
+	//Builds a network topology into an empty system. Running the same builder twice gives identical arena layouts, so replicas can share weights.
+	typedef std::function<void(NeuralSystem& sys)> NeuralModelBuilder;
+	void MakeXOR(NeuralSystem& sys);
+	void MakeWaves(NeuralSystem& sys, int width, int height, int directions);
+	void MakeLeNet5(NeuralSystem& sys, int width, int height);
+	//Dry run of MakeLeNet5 for the footprint estimate. Keep the two in step.
+	void EstimateLeNet5(FootprintEstimator& estimator, int width, int height);
+}
+#endif
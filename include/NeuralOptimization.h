@@ -21,11 +21,29 @@
 #ifndef _NEURALOPTIMIZATION_H_
 #define _NEURALOPTIMIZATION_H_
 #include "Neuron.h"
+#include <AlloyOptimizationMath.h>
+#include <functional>
+#include <deque>
+#include <vector>
 namespace tgr {
-	enum class NeuralOptimizer{GradientDescent,GradientMomentum};
+	enum class NeuralOptimizer{GradientDescent,GradientMomentum,Adam,AdamW,RMSProp,Adagrad,LBFGS};
+	//Contiguous run of weights and their gradients. Optimizer state slot k for the same parameters starts at state+k*stride.
+	struct ParameterRange {
+		float* weights;
+		float* changes;
+		float* state;
+		size_t size;
+		size_t stride;
+		ParameterRange(float* weights = nullptr, float* changes = nullptr, float* state = nullptr, size_t size = 0, size_t stride = 0) :weights(weights), changes(changes), state(state), size(size), stride(stride) {
+		}
+		float* getState(int k) const {
+			return state + k*stride;
+		}
+	};
 	struct NeuralOptimization {
 	protected:
 		float learningRate;
+		int64_t step;
 	public:
 		float getLearningRate() const {
 			return learningRate;
@@ -33,10 +51,22 @@ namespace tgr {
 		void setLearningRate(float rate) {
 			learningRate = rate;
 		}
-		NeuralOptimization(float learningRate) :learningRate(learningRate) {
+		//Number of updates applied so far. Saved with the knowledge so bias corrected optimizers resume correctly.
+		int64_t getStep() const {
+			return step;
+		}
+		void setStep(int64_t s) {
+			step = s;
+		}
+		NeuralOptimization(float learningRate) :learningRate(learningRate),step(0) {
+		}
+		//Number of per-parameter state slots the optimizer needs in the arena.
+		virtual int getStateSize() const {
+			return 0;
 		}
 		virtual NeuralOptimizer getType() const = 0;
-		virtual bool optimize(int id,const std::vector<std::shared_ptr<Signal>>& signals) = 0;
+		virtual bool optimize(const ParameterRange& range) = 0;
+		virtual ~NeuralOptimization() {}
 	};
 	typedef std::shared_ptr<NeuralOptimization> NeuralOptimizationPtr;
 	class GradientDescentOptimizer:public NeuralOptimization {
@@ -48,21 +78,123 @@ namespace tgr {
 		NeuralOptimizer getType() const {
 			return NeuralOptimizer::GradientDescent;
 		}
-		virtual bool optimize(int id, const std::vector<std::shared_ptr<Signal>>& signals) override;
+		virtual bool optimize(const ParameterRange& range) override;
 	};
 
 	class MomentumOptimizer :public NeuralOptimization {
 	protected:
 		float weightDecay;
 		float momentum;
-		std::map<int,std::vector<float>> velocityBufferMap;
 	public:
 		MomentumOptimizer(float learningRate, float weightDecay=0.0f,float momentum =0.9f) :NeuralOptimization(learningRate), weightDecay(weightDecay), momentum(momentum) {
 		}
 		NeuralOptimizer getType() const {
-			return NeuralOptimizer::GradientDescent;
+			return NeuralOptimizer::GradientMomentum;
+		}
+		virtual int getStateSize() const override {
+			return 1;
+		}
+		virtual bool optimize(const ParameterRange& range) override;
+	};
+	//Adam keeps the first and second moment of the gradient in state slots 0 and 1.
+	class AdamOptimizer :public NeuralOptimization {
+	protected:
+		float weightDecay;
+		float beta1;
+		float beta2;
+		float epsilon;
+		bool decoupled;
+	public:
+		AdamOptimizer(float learningRate, float weightDecay = 0.0f, float beta1 = 0.9f, float beta2 = 0.999f, float epsilon = 1E-8f) :NeuralOptimization(learningRate), weightDecay(weightDecay), beta1(beta1), beta2(beta2), epsilon(epsilon), decoupled(false) {
+		}
+		NeuralOptimizer getType() const {
+			return NeuralOptimizer::Adam;
+		}
+		virtual int getStateSize() const override {
+			return 2;
+		}
+		virtual bool optimize(const ParameterRange& range) override;
+	};
+	//AdamW applies weight decay directly to the weights instead of adding it to the gradient.
+	class AdamWOptimizer :public AdamOptimizer {
+	public:
+		AdamWOptimizer(float learningRate, float weightDecay = 0.01f, float beta1 = 0.9f, float beta2 = 0.999f, float epsilon = 1E-8f) :AdamOptimizer(learningRate, weightDecay, beta1, beta2, epsilon) {
+			decoupled = true;
+		}
+		NeuralOptimizer getType() const {
+			return NeuralOptimizer::AdamW;
+		}
+	};
+	class RMSPropOptimizer :public NeuralOptimization {
+	protected:
+		float weightDecay;
+		float decay;
+		float epsilon;
+	public:
+		RMSPropOptimizer(float learningRate, float weightDecay = 0.0f, float decay = 0.9f, float epsilon = 1E-8f) :NeuralOptimization(learningRate), weightDecay(weightDecay), decay(decay), epsilon(epsilon) {
+		}
+		NeuralOptimizer getType() const {
+			return NeuralOptimizer::RMSProp;
+		}
+		virtual int getStateSize() const override {
+			return 1;
+		}
+		virtual bool optimize(const ParameterRange& range) override;
+	};
+	class AdagradOptimizer :public NeuralOptimization {
+	protected:
+		float weightDecay;
+		float epsilon;
+	public:
+		AdagradOptimizer(float learningRate, float weightDecay = 0.0f, float epsilon = 1E-8f) :NeuralOptimization(learningRate), weightDecay(weightDecay), epsilon(epsilon) {
+		}
+		NeuralOptimizer getType() const {
+			return NeuralOptimizer::Adagrad;
+		}
+		virtual int getStateSize() const override {
+			return 1;
+		}
+		virtual bool optimize(const ParameterRange& range) override;
+	};
+	/*
+	 * Limited memory BFGS over the flattened parameter vector. The optimizer
+	 * drives its own full batch evaluations: the objective must evaluate the
+	 * loss at the current weights and write the full batch gradient into the
+	 * range's changes. It is meant for small networks where a handful of
+	 * full batch passes per step is cheap.
+	 */
+	class LBFGSOptimizer :public NeuralOptimization {
+	protected:
+		int history;
+		int maxLineSearch;
+		float armijo;
+		double loss;
+		bool hasGradient;
+		std::deque<aly::Vec<float>> sHistory;
+		std::deque<aly::Vec<float>> yHistory;
+		aly::Vec<float> gradient;
+		aly::Vec<float> direction;
+		aly::Vec<float> start;
+		std::vector<float> alpha;
+		std::vector<float> rho;
+		std::function<double()> objective;
+		void computeDirection();
+	public:
+		LBFGSOptimizer(int history = 10, int maxLineSearch = 20, float armijo = 1E-4f) :NeuralOptimization(1.0f), history(history), maxLineSearch(maxLineSearch), armijo(armijo), loss(0.0), hasGradient(false) {
+		}
+		NeuralOptimizer getType() const {
+			return NeuralOptimizer::LBFGS;
+		}
+		void setObjective(const std::function<double()>& func) {
+			objective = func;
+			reset();
+		}
+		double getLoss() const {
+			return loss;
 		}
-		virtual bool optimize(int id, const std::vector<std::shared_ptr<Signal>>& signals) override;
+		void reset();
+		virtual bool optimize(const ParameterRange& range) override;
 	};
+	typedef std::shared_ptr<LBFGSOptimizer> LBFGSOptimizerPtr;
 }
-#endif
\ No newline at end of file
+#endif
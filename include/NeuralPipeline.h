@@ -0,0 +1,128 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _NEURAL_PIPELINE_H_
+#define _NEURAL_PIPELINE_H_
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <random>
+#include <atomic>
+#include "NeuralAugmentation.h"
+namespace tgr {
+	//One minibatch of staged samples. Buffers are allocated once and reused for every batch.
+	struct NeuralBatch {
+		int iteration;
+		int inputSize;
+		std::vector<int> indexes;
+		std::vector<float> inputs;
+		std::vector<std::vector<float>> outputs;
+		NeuralBatch() :iteration(-1), inputSize(0) {
+		}
+		int size() const {
+			return (int)indexes.size();
+		}
+		const float* getInput(int b) const {
+			return inputs.data() + (size_t)b*inputSize;
+		}
+		float* getInput(int b) {
+			return inputs.data() + (size_t)b*inputSize;
+		}
+		const std::vector<float>& getOutput(int b) const {
+			return outputs[b];
+		}
+	};
+	/*
+	 * Background producer for training batches. While the runtime computes on
+	 * one batch, a worker thread selects, decodes and normalizes the next one
+	 * into a second staging buffer.
+	 */
+	class NeuralPipeline {
+	public:
+		typedef std::function<void(float* input, int idx)> InputStage;
+		typedef std::function<void(std::vector<float>& output, int idx)> OutputStage;
+		typedef std::function<void(std::vector<int>& samples, std::mt19937& rng)> ShuffleStage;
+	protected:
+		enum class SlotState { Free, Ready, Acquired };
+		NeuralBatch batches[2];
+		SlotState states[2];
+		int nextIteration;
+		int nextConsume;
+		std::atomic<bool> running;
+		std::thread producer;
+		std::mutex lock;
+		std::condition_variable produced;
+		std::condition_variable consumed;
+		std::vector<int> samples;
+		int batchSize;
+		int width;
+		int height;
+		int shuffleInterval;
+		std::atomic<int64_t> stageTime;
+		std::atomic<int64_t> waitTime;
+		std::atomic<uint64_t> stagedCount;
+		NeuralAugmentationPtr augmentation;
+		std::mt19937 rng;
+		InputStage inputStage;
+		OutputStage outputStage;
+		ShuffleStage shuffleStage;
+		void produce();
+		void fill(NeuralBatch& batch, int iteration);
+	public:
+		NeuralPipeline();
+		~NeuralPipeline();
+		void setInputStage(const InputStage& stage) {
+			inputStage = stage;
+		}
+		void setOutputStage(const OutputStage& stage) {
+			outputStage = stage;
+		}
+		//Replaces the default uniform shuffle, e.g. to keep reads local to one shard at a time.
+		void setShuffleStage(const ShuffleStage& stage) {
+			shuffleStage = stage;
+		}
+		//Applied to every staged input after the input stage. Samples within a batch are staged in parallel.
+		void setAugmentation(const NeuralAugmentationPtr& aug) {
+			augmentation = aug;
+		}
+		NeuralAugmentationPtr getAugmentation() const {
+			return augmentation;
+		}
+		bool isRunning() const {
+			return running;
+		}
+		//Samples are reshuffled every shuffleInterval batches, matching the runtime's synchronous path.
+		void start(const std::vector<int>& samples, int batchSize, int width, int height, int shuffleInterval, unsigned int seed);
+		void stop();
+		//Blocks until the next batch is staged. The batch stays valid until release().
+		NeuralBatch* acquire();
+		void release(NeuralBatch* batch);
+		//Wall clock samples per second of the producer, excluding time spent waiting for a free slot.
+		double getStagedPerSecond() const;
+		//Time the consumer spent blocked in acquire(). Non-zero means input preparation is the bottleneck.
+		double getWaitSeconds() const {
+			return 1E-9*waitTime.load();
+		}
+		void resetStats();
+	};
+}
+#endif
@@ -0,0 +1,133 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _NEURAL_PROFILER_H_
+#define _NEURAL_PROFILER_H_
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+/*
+ * Scoped wall clock timers for the training loop. Events are written to a
+ * fixed size ring buffer owned by the recording thread, so recording never
+ * locks or allocates. Traces are exported in the Chrome trace-event format
+ * and can be opened with chrome://tracing or Perfetto.
+ *
+ * Instrumentation is compiled in only when TGR_PROFILE is defined. Otherwise
+ * the TGR_PROFILE_* macros expand to nothing.
+ */
+namespace tgr {
+	struct ProfileEvent {
+		const char* name;
+		const char* category;
+		int64_t start;
+		int64_t duration;
+	};
+	class ProfileBuffer {
+	protected:
+		std::vector<ProfileEvent> events;
+		//Only the recording thread writes head. Readers never move it, they only advance tail.
+		std::atomic<uint64_t> head;
+		std::atomic<uint64_t> tail;
+		uint64_t mask;
+		int threadId;
+	public:
+		ProfileBuffer(int threadId, int log2Capacity);
+		int getThreadId() const {
+			return threadId;
+		}
+		inline void push(const ProfileEvent& evt) {
+			uint64_t h = head.load(std::memory_order_relaxed);
+			events[h&mask] = evt;
+			head.store(h + 1, std::memory_order_release);
+		}
+		//Appends the events still held. Slots the recording thread may have overwritten during the copy are dropped.
+		void copy(std::vector<ProfileEvent>& out) const;
+		//Hides the events recorded so far. Safe while the recording thread is pushing.
+		void clear() {
+			tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+		}
+	};
+	class NeuralProfiler {
+	protected:
+		static std::atomic<bool> enabled;
+		std::mutex registryLock;
+		std::vector<std::shared_ptr<ProfileBuffer>> buffers;
+		std::set<std::string> names;
+		std::chrono::steady_clock::time_point epoch;
+		int log2Capacity;
+		NeuralProfiler();
+	public:
+		static NeuralProfiler& getInstance();
+		static inline bool isEnabled() {
+			return enabled.load(std::memory_order_relaxed);
+		}
+		static void setEnabled(bool e) {
+			enabled.store(e);
+		}
+		inline int64_t now() const {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+		}
+		//Returns a pointer to a copy of the string that lives as long as the profiler.
+		const char* intern(const std::string& name);
+		ProfileBuffer* getThreadBuffer();
+		void setCapacity(int log2Events);
+		void clear();
+		void writeChromeTrace(std::ostream& os);
+	};
+	class ProfileScope {
+	protected:
+		const char* name;
+		const char* category;
+		int64_t start;
+	public:
+		ProfileScope(const char* name, const char* category) :name(name), category(category), start(0) {
+			if (name != nullptr&&NeuralProfiler::isEnabled()) {
+				start = NeuralProfiler::getInstance().now();
+			}
+			else {
+				this->name = nullptr;
+			}
+		}
+		~ProfileScope() {
+			if (name != nullptr) {
+				NeuralProfiler& profiler = NeuralProfiler::getInstance();
+				ProfileEvent evt = { name, category, start, profiler.now() - start };
+				profiler.getThreadBuffer()->push(evt);
+			}
+		}
+	};
+	bool WriteChromeTraceToFile(const std::string& file);
+}
+#define TGR_PROFILE_CONCAT_IMPL(a, b) a##b
+#define TGR_PROFILE_CONCAT(a, b) TGR_PROFILE_CONCAT_IMPL(a, b)
+#ifdef TGR_PROFILE
+#define TGR_PROFILE_SCOPE(name, category) tgr::ProfileScope TGR_PROFILE_CONCAT(profileScope, __LINE__)(name, category)
+#define TGR_PROFILE_SCOPE_STRING(name, category) tgr::ProfileScope TGR_PROFILE_CONCAT(profileScope, __LINE__)((tgr::NeuralProfiler::isEnabled()) ? tgr::NeuralProfiler::getInstance().intern(name) : nullptr, category)
+#else
+#define TGR_PROFILE_SCOPE(name, category)
+#define TGR_PROFILE_SCOPE_STRING(name, category)
+#endif
+#endif
@@ -23,10 +23,18 @@
 #include <thread>
 #include <mutex>
 #include <chrono>
+#include <atomic>
 #include <AlloyParameterPane.h>
 #include <AlloyWorker.h>
 #include "NeuralSystem.h"
+#include "NeuralHistory.h"
 #include "NeuralCache.h"
+#include "NeuralCheckpoint.h"
+#include "NeuralModels.h"
+#include "NeuralPipeline.h"
+#include "NeuralTelemetry.h"
+#include "NeuralValidator.h"
+#include <map>
 namespace tgr {
 	class NeuralRuntime;
 	class NeuralListener {
@@ -44,33 +52,150 @@ namespace tgr {
 		aly::Number learningRateInitial;
 		aly::Number weightDecay;
 		aly::Number momentum;
+		aly::Number secondMoment;
 		aly::Number learningRateDelta;
 		aly::Number batchSize;
 		aly::Number minSample;
 		aly::Number maxSample;
 		aly::Number lowerSample;
 		aly::Number upperSample;
+		aly::Number checkpointIterations;
+		aly::Number checkpointSeconds;
+		bool checkpointImprovement;
+		aly::Number historyKeyframes;
+		bool historyHalfPrecision;
+		aly::Number augmentShift;
+		aly::Number augmentRotation;
+		aly::Number augmentElastic;
+		aly::Number augmentNoise;
 		std::shared_ptr<NeuralOptimization> opt;
 		int optimizationMethod;
+		bool profile;
 
+		//Builds the optimizer selected in the controls.
+		std::shared_ptr<NeuralOptimization> makeOptimizer();
 		std::vector<int> sampleIndexes;
 		std::vector<float> outputData;
 		int iteration;
 		std::thread simulationThread;
 		std::shared_ptr<tgr::NeuralSystem> sys;
 
-		std::shared_ptr<tgr::NeuralCache> cache;
+		NeuralHistoryPtr history;
+		NeuralCachePtr cache;
+		NeuralCheckpointWriterPtr checkpoints;
+		//Snapshots handed to the checkpoint writer and validator. One that neither still holds is refilled for the next step.
+		std::vector<std::shared_ptr<NeuralKnowledge>> snapshots;
+		std::shared_ptr<NeuralKnowledge> acquireSnapshot();
+		NeuralModelBuilder modelBuilder;
+		std::vector<NeuralSystemPtr> replicas;
+		NeuralPipeline pipeline;
+		NeuralAugmentationPtr augmentation;
+		double publishInterval;
+		std::chrono::high_resolution_clock::time_point lastPublish;
+		//Steps run back to back on simulationThread, pinned to throughputCore, instead of on the recurring task.
+		bool throughput;
+		int throughputCore;
+		std::atomic<bool> stopRequested;
+		std::atomic<bool> finished;
+		std::atomic<double> samplesPerSecond;
+		int64_t samplesProcessed;
+		int64_t samplesAtPublish;
+		//Pushed by step() and drained by updateTelemetry() on the UI thread.
+		TelemetryRingPtr telemetry;
+		std::map<std::pair<TelemetryMetric, int>, DecimatedSeries> series;
+		std::vector<TelemetryEvent> drained;
+		NeuralValidatorPtr validator;
+		aly::Number validationIterations;
+		bool earlyStopping;
+		aly::Number earlyStoppingPatience;
 	public:
 		std::function<void(int iteration, bool lastIteration)> onUpdate;
 		std::function<void(const NeuralLayerPtr& input,int idx)> inputSampler;
 		std::function<void(std::vector<float>& outputData, int idx)> outputSampler;
+		//Writes one sample into a staging buffer the size of the input layer. When set, batches are prepared on a background thread.
+		std::function<void(float* input, int idx)> inputStager;
+		//Optional sample order for the staged path. Defaults to a uniform shuffle.
+		std::function<void(std::vector<int>& samples, std::mt19937& rng)> sampleShuffler;
 		typedef std::chrono::high_resolution_clock Clock;
 		bool step();
+		//Loss and summed gradient over all selected samples, left in the system's arena.
+		double evaluateBatch();
+		void setModelBuilder(const NeuralModelBuilder& builder) {
+			modelBuilder = builder;
+			replicas.clear();
+		}
+		//Enables on-the-fly augmentation of staged inputs. Requires an inputStager.
+		void setAugmentation(const NeuralAugmentationPtr& aug);
+		//Minimum time between layer snapshots published for the UI. The last iteration is always published. In throughput mode this also paces onUpdate and the log.
+		void setPublishInterval(double seconds) {
+			publishInterval = seconds;
+		}
+		double getPublishInterval() const {
+			return publishInterval;
+		}
 		bool init();
+		//Optimizer state slots per weight for the selected optimizer, for footprint estimates made before training starts.
+		int getStateSize();
+		//Stops the background workers and writes the profile trace. Runs when training ends, and is safe to call again.
 		void cleanup();
-		std::shared_ptr<tgr::NeuralCache> getCache() const {
+		//Evaluates a held out set in the background every "Validate Every" iterations. Set before setup() so its controls are shown.
+		void setValidator(const NeuralValidatorPtr& v) {
+			validator = v;
+			if (v.get() != nullptr && validationIterations.toInteger() == 0) {
+				validationIterations.setValue(iterationsPerStep.toInteger());
+			}
+		}
+		NeuralValidatorPtr getValidator() const {
+			return validator;
+		}
+		//Starts training. In throughput mode, steps run without the recurring task's delay between them.
+		void start();
+		//Stops training and waits for the current step to finish.
+		void stop();
+		//True once the last step has returned. The task may still be winding down, so stop() before touching the system.
+		bool isFinished() const {
+			return finished;
+		}
+		//Index into the Optimizer selection: Gradient Descent, Momentum, Adam, AdamW, RMSProp, Adagrad, L-BFGS.
+		void setOptimizationMethod(int method) {
+			optimizationMethod = method;
+		}
+		void setIterationsPerEpoch(int n) {
+			iterationsPerEpoch.setValue(n);
+		}
+		void setThroughput(bool t) {
+			throughput = t;
+		}
+		bool isThroughput() const {
+			return throughput;
+		}
+		//Core the throughput thread is pinned to, or -1 to leave it unpinned.
+		void setThroughputCore(int core) {
+			throughputCore = core;
+		}
+		//Drains metrics pushed by the training thread into decimated series and refreshes the layer graphs. Call from the UI thread. Returns true if anything arrived.
+		bool updateTelemetry();
+		//Residual series are per layer. Other metrics use layer -1. Returns null if nothing was recorded.
+		const DecimatedSeries* getSeries(TelemetryMetric metric, int layer = -1) const;
+		TelemetryRingPtr getTelemetry() const {
+			return telemetry;
+		}
+		//Measured over the last publish interval.
+		double getSamplesPerSecond() const {
+			return samplesPerSecond.load();
+		}
+		NeuralHistoryPtr getHistory() const {
+			return history;
+		}
+		//Decoded frames of the history, for the timeline.
+		NeuralCachePtr getCache() const {
 			return cache;
 		}
+		//Footprint of the system and of the decoded history frames. Call while training is stopped.
+		SystemFootprint getFootprint() const;
+		NeuralCheckpointWriterPtr getCheckpoints() const {
+			return checkpoints;
+		}
 		void setSampleRange(int mn, int mx);
 		void setSelectedSamples(int mn, int mx);
 		void setup(const aly::ParameterPanePtr& pane);
@@ -87,7 +212,7 @@ namespace tgr {
 		uint64_t getIteration() const {
 			return iteration;
 		}
-		virtual ~NeuralRuntime() {};
+		virtual ~NeuralRuntime();
 	};
 	typedef std::shared_ptr<NeuralRuntime> NeuralRuntimePtr;
 }
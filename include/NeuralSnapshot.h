@@ -0,0 +1,74 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _NEURAL_SNAPSHOT_H_
+#define _NEURAL_SNAPSHOT_H_
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+namespace tgr {
+	//Copy of a layer's responses and [weights|bias weights] as of one published iteration.
+	struct LayerSnapshot {
+		std::vector<float> responses;
+		std::vector<float> weights;
+		int64_t iteration;
+		uint64_t revision;
+		LayerSnapshot() :iteration(-1), revision(0) {
+		}
+	};
+	/*
+	 * Lock-free triple buffer with one writer and one reader. The writer fills
+	 * the back buffer and swaps it with the middle one. The reader swaps the
+	 * middle buffer with the front one only if something was published since
+	 * its last swap. Neither side ever waits on the other or sees a buffer
+	 * the other is using, and buffers are reused, so publishing a snapshot of
+	 * the same size does not allocate.
+	 */
+	class SnapshotBuffer {
+	protected:
+		static const int INDEX_MASK = 3;
+		static const int FRESH = 4;
+		LayerSnapshot buffers[3];
+		std::atomic<int> middle;
+		int back;
+		int front;
+	public:
+		SnapshotBuffer() :middle(1), back(0), front(2) {
+		}
+		//Writer side. The back buffer may be filled in freely until publish().
+		LayerSnapshot& getBack() {
+			return buffers[back];
+		}
+		void publish();
+		//Reader side. Returns true if a newer snapshot became the front buffer.
+		bool update();
+		const LayerSnapshot& getFront() const {
+			return buffers[front];
+		}
+		bool hasFresh() const {
+			return (middle.load(std::memory_order_relaxed)&FRESH) != 0;
+		}
+		//Capacity of all three buffers. Buffers only grow when the writer publishes, so call this from the writer's thread.
+		size_t getCapacityBytes() const;
+	};
+	typedef std::shared_ptr<SnapshotBuffer> SnapshotBufferPtr;
+}
+#endif
@@ -23,6 +23,8 @@
 #include "NeuralLayer.h"
 #include "AlloyExpandTree.h"
 #include "NeuralKnowledge.h"
+#include "NeuralArena.h"
+#include "NeuralModelFile.h"
 #include <map>
 namespace aly {
 	class NeuralFlowPane;
@@ -37,15 +39,59 @@ namespace tgr {
 		std::vector<NeuralLayerPtr> roots;
 		std::vector<NeuralLayerPtr> leafs;
 		bool initialized;
+		bool exactGradient;
 		std::shared_ptr<aly::NeuralFlowPane> flowPane;
 		NeuralLayerPtr inputLayer, outputLayer;
 		NeuralKnowledge knowledge;
+		NeuralArena arena;
+		NeuralOptimizationPtr optimizer;
+		NeuralModelFilePtr mappedModel;
+		std::vector<char> required;
+		std::vector<const NeuralLayer*> visiting;
 	public:
 
-		void evaluate();
+		/*
+		 * Recomputes only layers marked stale by changed inputs or weights.
+		 * With visibleOnly, stale layers that do not feed a visible
+		 * NeuralLayerRegion are left for a later call.
+		 */
+		void evaluate(bool visibleOnly = false);
+		//Marks every layer stale so the next evaluate() recomputes the whole network.
+		void invalidate();
+		//Publishes every layer that changed since its last snapshot. Call from the thread that owns the system.
+		void publish(int64_t iteration);
+		bool isInitialized() const {
+			return initialized;
+		}
 		void backpropagate();
+		/*
+		 * By default backpropagate() scales each neuron's change by its
+		 * fan-out, which keeps first-order steps stable but is not the
+		 * gradient of any loss. Exact mode produces the true gradient of
+		 * 0.5*sum(err^2), which line searches such as L-BFGS require.
+		 */
+		void setExactGradient(bool exact) {
+			exactGradient = exact;
+		}
+		bool isExactGradient() const {
+			return exactGradient;
+		}
 		bool optimize();
 		void setKnowledge(const NeuralKnowledge& k);
+		/*
+		 * Maps a .tgrm model file and points every layer's weights into it
+		 * for read-only inference. The file's layout must match the arena.
+		 * Training is refused while mapped. setKnowledge(), initialize() and
+		 * initializeWeights() copy the mapped weights back into the arena.
+		 */
+		void mapKnowledge(const std::string& file, bool verify = true);
+		void unmapKnowledge();
+		bool isMapped() const {
+			return (mappedModel.get() != nullptr);
+		}
+		const NeuralModelFilePtr& getMappedModel() const {
+			return mappedModel;
+		}
 		void setInput(const NeuralLayerPtr& layer) {
 			inputLayer = layer;
 		}
@@ -59,6 +105,15 @@ namespace tgr {
 			return outputLayer;
 		}
 		void setOptimizer(const NeuralOptimizationPtr& opt);
+		NeuralOptimizationPtr getOptimizer() const {
+			return optimizer;
+		}
+		NeuralArena& getArena() {
+			return arena;
+		}
+		const NeuralArena& getArena() const {
+			return arena;
+		}
 		double accumulate(const NeuralLayerPtr& layer, const aly::Image1f& output);
 		double accumulate(const NeuralLayerPtr& layer, const std::vector<float>& output);
 
@@ -88,6 +143,11 @@ namespace tgr {
 		std::vector<NeuralLayerPtr>& getRoots() {
 			return roots;
 		}
+		const std::vector<std::shared_ptr<NeuralFilter>>& getFilters() const {
+			return filters;
+		}
+		//Per layer and per filter memory of the built network. Call from the thread that owns the system.
+		SystemFootprint getFootprint() const;
 		const std::vector<NeuralLayerPtr>& getLayers() const {
 			return layers;
 		}
@@ -0,0 +1,100 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _NEURAL_TELEMETRY_H_
+#define _NEURAL_TELEMETRY_H_
+#include <AlloyMath.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+namespace tgr {
+	enum class TelemetryMetric : int32_t { Residual, LearningRate, StepSeconds, SamplesPerSecond };
+	struct TelemetryEvent {
+		int64_t iteration;
+		TelemetryMetric metric;
+		//Layer index for per-layer metrics, otherwise -1.
+		int32_t layer;
+		float value;
+	};
+	/*
+	 * Fixed size single-producer/single-consumer ring for training metrics.
+	 * The training thread pushes and the UI thread drains, without locks or
+	 * allocation. If the UI falls a whole ring behind, new events are dropped
+	 * and counted rather than overwriting ones being read.
+	 */
+	class TelemetryRing {
+	protected:
+		std::vector<TelemetryEvent> events;
+		uint64_t mask;
+		//Kept on separate cache lines so the two threads do not contend on them.
+		alignas(64) std::atomic<uint64_t> head;
+		alignas(64) std::atomic<uint64_t> tail;
+		std::atomic<uint64_t> dropped;
+	public:
+		TelemetryRing(int log2Capacity = 16);
+		inline bool push(const TelemetryEvent& evt) {
+			uint64_t h = head.load(std::memory_order_relaxed);
+			if (h - tail.load(std::memory_order_acquire) > mask) {
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			events[h&mask] = evt;
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+		//Appends all pending events to out. Returns the number appended.
+		size_t drain(std::vector<TelemetryEvent>& out);
+		uint64_t getDropped() const {
+			return dropped.load(std::memory_order_relaxed);
+		}
+		//Only call while nothing is pushing.
+		void clear();
+	};
+	/*
+	 * Min/max envelope of a series indexed by iteration. Once there are more
+	 * than maxBuckets buckets, neighbors are merged and the bucket width
+	 * doubles, so memory and drawing cost stay constant however long the run.
+	 */
+	class DecimatedSeries {
+	protected:
+		struct Bucket {
+			int64_t index;
+			float minValue;
+			float maxValue;
+		};
+		std::vector<Bucket> buckets;
+		int64_t origin;
+		int64_t width;
+		size_t maxBuckets;
+		void merge();
+	public:
+		DecimatedSeries(size_t maxBuckets = 1024);
+		void add(int64_t iteration, float value);
+		void clear();
+		size_t size() const {
+			return buckets.size();
+		}
+		//Two points per bucket, at its minimum and maximum, so spikes survive decimation.
+		void getPoints(std::vector<aly::float2>& points) const;
+	};
+	typedef std::shared_ptr<TelemetryRing> TelemetryRingPtr;
+}
+#endif
@@ -0,0 +1,113 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _NEURAL_VALIDATOR_H_
+#define _NEURAL_VALIDATOR_H_
+#include "NeuralSystem.h"
+#include "NeuralModels.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+namespace tgr {
+	struct ValidationResult {
+		int iteration;
+		int samples;
+		int classes;
+		//Mean of 0.5*|output - target|^2 over the evaluation set.
+		double loss;
+		double accuracy;
+		double seconds;
+		//Row is the label, column the predicted class.
+		std::vector<int> confusion;
+		ValidationResult() :iteration(-1), samples(0), classes(0), loss(0.0), accuracy(0.0), seconds(0.0) {
+		}
+		int getCount(int label, int predicted) const {
+			return confusion[label*classes + predicted];
+		}
+	};
+	/*
+	 * Evaluates a held out set against snapshots of the weights while
+	 * training continues. Each worker thread owns a replica system built
+	 * from the model builder, so validation never touches the training
+	 * system's activations. A snapshot submitted while the previous one is
+	 * still being evaluated is skipped, so the trainer never waits.
+	 *
+	 * Optionally tracks early stopping: once the loss has not improved by
+	 * minDelta for patience validations in a row, shouldStop() turns true.
+	 */
+	class NeuralValidator {
+	public:
+		//Writes the sample into a buffer the size of the input layer.
+		typedef std::function<void(float* input, int idx)> Stager;
+		typedef std::function<int(int idx)> Labeler;
+		typedef std::function<void(const ValidationResult& result)> Listener;
+	protected:
+		NeuralModelBuilder builder;
+		Stager stager;
+		Labeler labeler;
+		int sampleCount;
+		int classes;
+		std::vector<NeuralSystemPtr> replicas;
+		std::thread worker;
+		std::atomic<bool> busy;
+		std::atomic<bool> stopRequested;
+		std::mutex lock;
+		ValidationResult latest;
+		int patience;
+		double minDelta;
+		double bestLoss;
+		int sinceBest;
+		std::atomic<bool> stopTraining;
+		void run(int iteration, std::shared_ptr<NeuralKnowledge> k);
+		void join();
+	public:
+		Listener onResult;
+		NeuralValidator(const NeuralModelBuilder& builder, const Stager& stager, const Labeler& labeler, int sampleCount, int classes);
+		~NeuralValidator();
+		//Builds the replicas. Call before training starts, since building a model is not safe alongside another thread doing the same.
+		void initialize(int threads = 0);
+		//Returns false if the previous snapshot is still being evaluated.
+		bool submit(int iteration, const std::shared_ptr<NeuralKnowledge>& k);
+		bool isBusy() const {
+			return busy.load();
+		}
+		//Cancels the current evaluation and waits for its thread. Further passes stop early until reset().
+		void stop();
+		//Clears results and early stopping state for a new run.
+		void reset();
+		ValidationResult getLatest();
+		//A patience of zero disables early stopping.
+		void setEarlyStopping(int patience, double minDelta = 0.0) {
+			this->patience = patience;
+			this->minDelta = minDelta;
+		}
+		bool shouldStop() const {
+			return stopTraining.load();
+		}
+		int getSampleCount() const {
+			return sampleCount;
+		}
+	};
+	typedef std::shared_ptr<NeuralValidator> NeuralValidatorPtr;
+}
+#endif
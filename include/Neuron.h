@@ -102,7 +102,14 @@ namespace tgr {
 		//aly::int3 id;
 		friend class NeuralLayer;
 		float normalizedValue() const {
-			return aly::clamp((*value - transform.min()) / std::max(1E-10f,transform.max() - transform.min()),0.0f,1.0f);
+			return normalizedValue(*value);
+		}
+		//Normalizes a response of this neuron read from somewhere else, e.g. a published snapshot.
+		float normalizedValue(float v) const {
+			return aly::clamp((v - transform.min()) / std::max(1E-10f,transform.max() - transform.min()),0.0f,1.0f);
+		}
+		const NeuronFunction& getFunction() const {
+			return transform;
 		}
 		float forward(float val) const {
 			return transform.forward(val);
@@ -118,7 +125,7 @@ namespace tgr {
 		}
 		size_t getInputNeuronSize() const {
 			size_t count = 0;
-			for (auto in : input) {
+			for (const SignalPtr& in : input) {
 				count += in->size(this);
 			}
 			return count;
@@ -129,7 +136,8 @@ namespace tgr {
 			return output.size();
 		}
 		float evaluate();
-		float backpropagate();
+		//With exact, change is the derivative of the loss with respect to the neuron's averaged input. Otherwise it is normalized by the fan-out.
+		float backpropagate(bool exact = false);
 		const std::vector<SignalPtr>& getInput() const {
 			return input;
 		}
@@ -0,0 +1,144 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#ifndef _SHARD_DATASET_H_
+#define _SHARD_DATASET_H_
+#include "MappedFile.h"
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+namespace tgr {
+	class NeuralLayer;
+	/*
+	 * Shard file layout (little endian):
+	 *   ShardHeader (64 bytes)
+	 *   recordCount records of recordStride bytes each, 64 byte aligned,
+	 *     holding width x height x channels values in the shard's encoding
+	 *   recordCount ShardIndexEntry at indexOffset
+	 * Records have a fixed stride, so record n is found without the index.
+	 * The index keeps labels and source ids out of the payload, so labels
+	 * can be read without touching image pages.
+	 */
+	enum class ShardEncoding : uint32_t {
+		UInt8 = 0, Float16 = 1, Float32 = 2
+	};
+	struct ShardHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t encoding;
+		uint32_t width;
+		uint32_t height;
+		uint32_t channels;
+		uint64_t recordCount;
+		uint64_t recordStride;
+		uint64_t indexOffset;
+		float scaleMin;
+		float scaleMax;
+		uint32_t reserved[2];
+	};
+	struct ShardIndexEntry {
+		int32_t label;
+		uint32_t source;
+	};
+	static_assert(sizeof(ShardHeader) == 64, "Shard header must be 64 bytes.");
+	//Writes records to prefix-00000.tgrs, prefix-00001.tgrs, ... starting a new shard every recordsPerShard records.
+	class ShardWriter {
+	protected:
+		std::string prefix;
+		ShardEncoding encoding;
+		ShardHeader header;
+		int recordsPerShard;
+		std::ofstream out;
+		std::vector<ShardIndexEntry> index;
+		std::vector<uint8_t> record;
+		std::vector<std::string> files;
+		void openShard();
+		void closeShard();
+	public:
+		//UInt8 records quantize [scaleMin, scaleMax] to 256 levels. The float encodings store values as given.
+		ShardWriter(const std::string& prefix, ShardEncoding encoding, int width, int height, int recordsPerShard = 65536, float scaleMin = 0.0f, float scaleMax = 1.0f);
+		~ShardWriter();
+		void add(const float* data, int label, uint32_t source);
+		//Finishes the open shard and deletes higher numbered shards left by an earlier run. Throws if either fails.
+		void close();
+		const std::vector<std::string>& getFiles() const {
+			return files;
+		}
+		static std::string GetShardFile(const std::string& prefix, int shard);
+		//Inverse of GetShardFile(), so any shard of a set can be used to name the whole set.
+		static std::string GetShardPrefix(const std::string& file);
+	};
+	//Streams records from a set of memory mapped shards.
+	class ShardDataset {
+	protected:
+		struct Shard {
+			MappedFile file;
+			const ShardHeader* header;
+			const ShardIndexEntry* index;
+			const uint8_t* records;
+			int first;
+			int count;
+			std::atomic<bool> touched;
+			Shard() :header(nullptr), index(nullptr), records(nullptr), first(0), count(0), touched(false) {
+			}
+		};
+		std::vector<std::unique_ptr<Shard>> shards;
+		int count;
+		int imageWidth;
+		int imageHeight;
+		int findShard(int idx) const;
+	public:
+		ShardDataset();
+		ShardDataset(const std::string& prefix);
+		//Opens every shard written by ShardWriter for the prefix.
+		void open(const std::string& prefix);
+		void open(const std::vector<std::string>& files);
+		int size() const {
+			return count;
+		}
+		int width() const {
+			return imageWidth;
+		}
+		int height() const {
+			return imageHeight;
+		}
+		int getShardCount() const {
+			return (int)shards.size();
+		}
+		int getLabel(int idx) const;
+		uint32_t getSource(int idx) const;
+		//Decodes a record into width() x height() floats. The first read from a shard prefetches the whole shard.
+		void copyTo(int idx, float* dst) const;
+		void copyTo(int idx, NeuralLayer& layer) const;
+		/*
+		 * Reorders indexes so that shards are visited in random order and
+		 * records in random order within each shard. Reads stay inside one
+		 * shard at a time, so a dataset larger than RAM streams from disk
+		 * instead of faulting pages in at random.
+		 */
+		void shuffle(std::vector<int>& indexes, std::mt19937& rng) const;
+	};
+	typedef std::shared_ptr<ShardDataset> ShardDatasetPtr;
+}
+#endif
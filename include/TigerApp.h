@@ -32,12 +32,18 @@
 #include "AlloyGraphPane.h"
 #include "NeuralRuntime.h"
 #include "NeuralCache.h"
+#include "IDXDataset.h"
+#include "ShardDataset.h"
+#include <atomic>
 class TigerApp : public aly::Application {
 protected:
 	tgr::NeuralLayer* selectedLayer;
 	bool parametersDirty;
 	bool frameBuffersDirty;
-	bool running = false;
+	//Set while the runtime owns the system. The UI only reads published layer snapshots then.
+	std::atomic<bool> running{ false };
+	//Timeline position picked while training, applied once it stops. -1 if none.
+	int pendingTime = -1;
 	tgr::NeuralSystemPtr sys;
 	aly::IconButtonPtr playButton, stopButton;
 	aly::ExpandTreePtr expandTree;
@@ -54,6 +60,9 @@ protected:
 	aly::HorizontalSliderPtr tweenRegion;
 	std::vector<aly::Image1f> trainInputData;
 	std::vector<uint8_t> trainOutputData;
+	tgr::IDXDatasetPtr trainImages, trainLabels;
+	tgr::IDXDatasetPtr evalImages, evalLabels;
+	tgr::ShardDatasetPtr trainShards;
 	tgr::NeuralRuntimePtr worker;
 	aly::GraphPanePtr graphRegion;
 	std::shared_ptr<tgr::NeuralCache> cache;
@@ -63,6 +72,7 @@ protected:
 	bool initializeWaves();
 	void initialize();
 	void setSelectedLayer(tgr::NeuralLayer* layer);
+	void finishTraining();
 public:
 	void setSampleIndex(int idx);
 	void setNeuralTime(int idx);
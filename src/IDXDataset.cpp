@@ -0,0 +1,119 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "IDXDataset.h"
+#include "NeuralLayer.h"
+#include <emmintrin.h>
+#include <algorithm>
+namespace tgr {
+	static uint32_t ReadBigEndian(const uint8_t* ptr) {
+		return (uint32_t(ptr[0]) << 24) | (uint32_t(ptr[1]) << 16) | (uint32_t(ptr[2]) << 8) | uint32_t(ptr[3]);
+	}
+	void ConvertBytes(const uint8_t* src, float* dst, int N, float scale, float offset) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 s = _mm_set1_ps(scale);
+		const __m128 o = _mm_set1_ps(offset);
+		int n = 0;
+		for (; n + 16 <= N; n += 16) {
+			__m128i bytes = _mm_loadu_si128((const __m128i*)(src + n));
+			__m128i lo = _mm_unpacklo_epi8(bytes, zero);
+			__m128i hi = _mm_unpackhi_epi8(bytes, zero);
+			_mm_storeu_ps(dst + n, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), s), o));
+			_mm_storeu_ps(dst + n + 4, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), s), o));
+			_mm_storeu_ps(dst + n + 8, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), s), o));
+			_mm_storeu_ps(dst + n + 12, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), s), o));
+		}
+		for (; n < N; n++) {
+			dst[n] = src[n] * scale + offset;
+		}
+	}
+	IDXDataset::IDXDataset() :samples(nullptr), sampleSize(0), count(0), xPadding(0), yPadding(0), scaleMin(0.0f), scaleMax(1.0f) {
+	}
+	IDXDataset::IDXDataset(const std::string& file, float scaleMin, float scaleMax, int xPadding, int yPadding) :IDXDataset() {
+		open(file, scaleMin, scaleMax, xPadding, yPadding);
+	}
+	void IDXDataset::open(const std::string& fileName, float smin, float smax, int xpad, int ypad) {
+		if (xpad < 0 || ypad < 0)
+			throw std::runtime_error("padding size must not be negative");
+		if (smin >= smax)
+			throw std::runtime_error("scale_max must be greater than scale_min");
+		file.open(fileName);
+		const uint8_t* ptr = file.ptr();
+		if (file.size() < 4 || ptr[0] != 0 || ptr[1] != 0 || ptr[2] != 0x08) {
+			throw std::runtime_error("IDX file format error:" + fileName);
+		}
+		int dims = ptr[3];
+		if (dims < 1 || file.size() < 4 + 4 * (size_t)dims) {
+			throw std::runtime_error("IDX file format error:" + fileName);
+		}
+		dimensions.resize(dims);
+		sampleSize = 1;
+		for (int d = 0; d < dims; d++) {
+			dimensions[d] = (int)ReadBigEndian(ptr + 4 + 4 * d);
+			if (d > 0)sampleSize *= dimensions[d];
+		}
+		count = dimensions[0];
+		samples = ptr + 4 + 4 * dims;
+		if (samples + count*sampleSize > ptr + file.size()) {
+			throw std::runtime_error("IDX file is truncated:" + fileName);
+		}
+		scaleMin = smin;
+		scaleMax = smax;
+		xPadding = xpad;
+		yPadding = ypad;
+	}
+	int IDXDataset::width() const {
+		return ((dimensions.size() > 2) ? dimensions.back() : 1) + 2 * xPadding;
+	}
+	int IDXDataset::height() const {
+		return ((dimensions.size() > 2) ? dimensions[dimensions.size() - 2] : 1) + 2 * yPadding;
+	}
+	void IDXDataset::copyTo(int idx, float* dst) const {
+		int w = width();
+		int h = height();
+		int cols = w - 2 * xPadding;
+		int rows = h - 2 * yPadding;
+		const uint8_t* src = getSample(idx);
+		float scale = (scaleMax - scaleMin) / 255.0f;
+		if (xPadding == 0 && yPadding == 0) {
+			ConvertBytes(src, dst, rows*cols, scale, scaleMin);
+			return;
+		}
+		std::fill(dst, dst + w*yPadding, scaleMin);
+		std::fill(dst + w*(h - yPadding), dst + w*h, scaleMin);
+		for (int j = 0; j < rows; j++) {
+			float* row = dst + w*(j + yPadding);
+			std::fill(row, row + xPadding, scaleMin);
+			ConvertBytes(src + j*cols, row + xPadding, cols, scale, scaleMin);
+			std::fill(row + xPadding + cols, row + w, scaleMin);
+		}
+	}
+	void IDXDataset::copyTo(int idx, aly::Image1f& img) const {
+		img.resize(width(), height());
+		copyTo(idx, (float*)img.ptr());
+	}
+	void IDXDataset::copyTo(int idx, NeuralLayer& layer) const {
+		if (layer.width != width() || layer.height != height() || layer.responses.size() < (size_t)(width()*height())) {
+			throw std::runtime_error(aly::MakeString() << "IDX sample size " << width() << "x" << height() << " does not match layer " << layer.getName());
+		}
+		copyTo(idx, layer.responses.ptr());
+		layer.setRegionDirty(true);
+	}
+}
@@ -0,0 +1,119 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "MappedFile.h"
+#include <stdexcept>
+#include <algorithm>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+namespace tgr {
+#ifdef _WIN32
+	MappedFile::MappedFile() :data(nullptr), length(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr) {
+	}
+#else
+	MappedFile::MappedFile() :data(nullptr), length(0), fileDescriptor(-1) {
+	}
+#endif
+	MappedFile::MappedFile(const std::string& file) :MappedFile() {
+		open(file);
+	}
+	MappedFile::~MappedFile() {
+		close();
+	}
+	void MappedFile::open(const std::string& file) {
+		close();
+#ifdef _WIN32
+		fileHandle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+		if (fileHandle == INVALID_HANDLE_VALUE) {
+			throw std::runtime_error("failed to open file:" + file);
+		}
+		LARGE_INTEGER fileSize;
+		GetFileSizeEx(fileHandle, &fileSize);
+		length = (size_t)fileSize.QuadPart;
+		if (length == 0) {
+			close();
+			throw std::runtime_error("file is empty:" + file);
+		}
+		mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mappingHandle == nullptr) {
+			close();
+			throw std::runtime_error("failed to map file:" + file);
+		}
+		data = (const uint8_t*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+		fileDescriptor = ::open(file.c_str(), O_RDONLY);
+		if (fileDescriptor < 0) {
+			throw std::runtime_error("failed to open file:" + file);
+		}
+		struct stat st;
+		fstat(fileDescriptor, &st);
+		length = (size_t)st.st_size;
+		if (length == 0) {
+			close();
+			throw std::runtime_error("file is empty:" + file);
+		}
+		void* ptr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+		data = (ptr == MAP_FAILED) ? nullptr : (const uint8_t*)ptr;
+#endif
+		if (data == nullptr) {
+			close();
+			throw std::runtime_error("failed to map file:" + file);
+		}
+	}
+	void MappedFile::close() {
+#ifdef _WIN32
+		if (data != nullptr)UnmapViewOfFile(data);
+		if (mappingHandle != nullptr)CloseHandle(mappingHandle);
+		if (fileHandle != INVALID_HANDLE_VALUE)CloseHandle(fileHandle);
+		mappingHandle = nullptr;
+		fileHandle = INVALID_HANDLE_VALUE;
+#else
+		if (data != nullptr)munmap((void*)data, length);
+		if (fileDescriptor >= 0)::close(fileDescriptor);
+		fileDescriptor = -1;
+#endif
+		data = nullptr;
+		length = 0;
+	}
+	void MappedFile::prefetch(size_t offset, size_t count) const {
+		if (data == nullptr || offset >= length)return;
+		count = std::min(count, length - offset);
+#ifdef _WIN32
+		//PrefetchVirtualMemory needs Windows 8, so Windows relies on the cache manager's read-ahead instead.
+		(void)count;
+#else
+		size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		size_t start = offset - offset%page;
+		madvise((void*)(data + start), count + (offset - start), MADV_WILLNEED);
+#endif
+	}
+}
@@ -0,0 +1,70 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralAllocation.h"
+#include <cstdlib>
+#include <new>
+namespace tgr {
+	std::atomic<int> AllocationAudit::depth(0);
+	std::atomic<uint64_t> AllocationAudit::count(0);
+	std::atomic<uint64_t> AllocationAudit::bytes(0);
+	static thread_local bool ignoredThread = false;
+	bool AllocationAudit::isSupported() {
+#ifdef TGR_AUDIT_ALLOCATIONS
+		return true;
+#else
+		return false;
+#endif
+	}
+	void AllocationAudit::record(size_t size) {
+		if (depth.load(std::memory_order_relaxed) <= 0 || ignoredThread)return;
+		count.fetch_add(1, std::memory_order_relaxed);
+		bytes.fetch_add(size, std::memory_order_relaxed);
+	}
+	void AllocationAudit::ignoreCurrentThread() {
+		ignoredThread = true;
+	}
+}
+#ifdef TGR_AUDIT_ALLOCATIONS
+//The standard containers allocate through these too, so every heap allocation in the process is seen.
+void* operator new(std::size_t size) {
+	tgr::AllocationAudit::record(size);
+	void* ptr = std::malloc((size > 0) ? size : 1);
+	if (ptr == nullptr) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+	std::free(ptr);
+}
+void operator delete(void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+void operator delete[](void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+#endif
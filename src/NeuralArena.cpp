@@ -0,0 +1,156 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralArena.h"
+#include "NeuralLayer.h"
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+namespace tgr {
+	static size_t PadArena(size_t n) {
+		return ((n + NeuralArena::ALIGNMENT - 1) / NeuralArena::ALIGNMENT)*NeuralArena::ALIGNMENT;
+	}
+	NeuralArena::NeuralArena() :data(nullptr), stride(0), trainableSize(0), stateSize(0) {
+	}
+	void NeuralArena::build(const std::vector<std::shared_ptr<NeuralLayer>>& layers, int states) {
+		std::map<int, ArenaBlock> layout;
+		size_t offset = 0;
+		for (int pass = 0; pass < 2; pass++) {
+			for (const NeuralLayerPtr& layer : layers) {
+				if (layer->isTrainable() != (pass == 0))continue;
+				ArenaBlock block(offset, layer->getWeights().size(), layer->getBiasWeights().size());
+				layout[layer->getId()] = block;
+				offset += PadArena(block.size());
+			}
+			if (pass == 0)trainableSize = offset;
+		}
+		size_t newStride = offset;
+		size_t count = newStride*(2 + states);
+		std::unique_ptr<float[]> newStorage(new float[count + ALIGNMENT]);
+		float* newData = newStorage.get();
+		size_t misalign = (reinterpret_cast<uintptr_t>(newData) / sizeof(float)) % ALIGNMENT;
+		if (misalign != 0)newData += ALIGNMENT - misalign;
+		std::memset(newData, 0, count * sizeof(float));
+		//Layers copy their current values out of the old storage before it is released.
+		for (const NeuralLayerPtr& layer : layers) {
+			const ArenaBlock& block = layout[layer->getId()];
+			layer->bind(newData + block.offset, newData + newStride + block.offset);
+		}
+		storage = std::move(newStorage);
+		data = newData;
+		stride = newStride;
+		stateSize = states;
+		blocks = layout;
+		weightChunks.assign(KnowledgeStore::GetChunkCount(stride), KnowledgeChunkPtr());
+		stateChunks.assign(KnowledgeStore::GetChunkCount(stride*stateSize), KnowledgeChunkPtr());
+		weightBuffers.assign(weightChunks.size(), std::shared_ptr<std::vector<float>>());
+		stateBuffers.assign(stateChunks.size(), std::shared_ptr<std::vector<float>>());
+	}
+	const ArenaBlock& NeuralArena::getBlock(const NeuralLayer& layer) const {
+		auto pos = blocks.find(layer.getId());
+		if (pos == blocks.end()) {
+			throw std::runtime_error(aly::MakeString() << "Layer " << layer.getName() << " is not in the arena.");
+		}
+		return pos->second;
+	}
+	ParameterRange NeuralArena::getRange() {
+		return ParameterRange(getWeights(), getChanges(), (stateSize > 0) ? getState(0) : nullptr, trainableSize, stride);
+	}
+	ParameterRange NeuralArena::getRange(const NeuralLayer& layer) {
+		const ArenaBlock& block = getBlock(layer);
+		return ParameterRange(getWeights() + block.offset, getChanges() + block.offset, (stateSize > 0) ? getState(0) + block.offset : nullptr, block.size(), stride);
+	}
+	void NeuralArena::rebindWeights(const std::vector<std::shared_ptr<NeuralLayer>>& layers) {
+		for (const NeuralLayerPtr& layer : layers) {
+			layer->bindWeights(data + getBlock(*layer).offset);
+		}
+	}
+	void NeuralArena::zeroChanges() {
+		if (stride > 0)std::memset(getChanges(), 0, stride * sizeof(float));
+	}
+	void NeuralArena::zeroState() {
+		if (stateSize > 0)std::memset(getState(0), 0, stride*stateSize * sizeof(float));
+		std::fill(stateChunks.begin(), stateChunks.end(), KnowledgeChunkPtr());
+	}
+	static void MarkChunks(std::vector<KnowledgeChunkPtr>& chunks, size_t offset, size_t count) {
+		if (count == 0)return;
+		size_t last = std::min((offset + count - 1) / KnowledgeStore::CHUNK_SIZE + 1, chunks.size());
+		for (size_t c = offset / KnowledgeStore::CHUNK_SIZE; c < last; c++) {
+			chunks[c].reset();
+		}
+	}
+	void NeuralArena::markDirty(size_t offset, size_t count) {
+		MarkChunks(weightChunks, offset, count);
+		for (int k = 0; k < stateSize; k++) {
+			MarkChunks(stateChunks, k*stride + offset, count);
+		}
+	}
+	void NeuralArena::markDirty() {
+		std::fill(weightChunks.begin(), weightChunks.end(), KnowledgeChunkPtr());
+		std::fill(stateChunks.begin(), stateChunks.end(), KnowledgeChunkPtr());
+	}
+	static void SnapshotChunks(const float* data, size_t count, std::vector<KnowledgeChunkPtr>& chunks, std::vector<std::shared_ptr<std::vector<float>>>& buffers, KnowledgeStore& store) {
+		for (size_t c = 0; c < chunks.size(); c++) {
+			if (chunks[c].get() == nullptr) {
+				size_t offset = c*KnowledgeStore::CHUNK_SIZE;
+				size_t end = std::min(offset + KnowledgeStore::CHUNK_SIZE, count);
+				std::shared_ptr<std::vector<float>>& buffer = buffers[c];
+				//Only the arena holds the buffer, so no snapshot can see it change.
+				if (buffer.use_count() == 1) {
+					buffer->assign(data + offset, data + end);
+				}
+				else {
+					buffer = std::make_shared<std::vector<float>>(data + offset, data + end);
+				}
+				chunks[c] = buffer;
+			}
+		}
+		store.assign(chunks, count);
+	}
+	static void RestoreChunks(float* data, const KnowledgeStore& store, std::vector<KnowledgeChunkPtr>& chunks, std::vector<size_t>* changed) {
+		for (size_t c = 0; c < chunks.size(); c++) {
+			const KnowledgeChunkPtr& chunk = store.getChunk(c);
+			if (chunks[c] == chunk)continue;
+			float* dst = data + c*KnowledgeStore::CHUNK_SIZE;
+			//Frames decoded separately hold equal values in different chunks, so compare before copying.
+			if (std::memcmp(dst, chunk->data(), chunk->size() * sizeof(float)) != 0) {
+				std::memcpy(dst, chunk->data(), chunk->size() * sizeof(float));
+				if (changed != nullptr)changed->push_back(c);
+			}
+			chunks[c] = chunk;
+		}
+	}
+	void NeuralArena::snapshotWeights(KnowledgeStore& store) {
+		SnapshotChunks(getWeights(), stride, weightChunks, weightBuffers, store);
+	}
+	void NeuralArena::snapshotState(KnowledgeStore& store) {
+		SnapshotChunks((stateSize > 0) ? getState(0) : nullptr, stride*stateSize, stateChunks, stateBuffers, store);
+	}
+	bool NeuralArena::restoreWeights(const KnowledgeStore& store, std::vector<size_t>* changed) {
+		if (store.size() != stride)return false;
+		RestoreChunks(getWeights(), store, weightChunks, changed);
+		return true;
+	}
+	bool NeuralArena::restoreState(const KnowledgeStore& store) {
+		if (store.size() != stride*stateSize)return false;
+		RestoreChunks((stateSize > 0) ? getState(0) : nullptr, store, stateChunks, nullptr);
+		return true;
+	}
+}
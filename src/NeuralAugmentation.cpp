@@ -0,0 +1,207 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralAugmentation.h"
+#include "NeuralProfiler.h"
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+namespace tgr {
+	static uint64_t MixSeed(uint64_t x) {
+		//splitmix64 finalizer.
+		x += 0x9E3779B97F4A7C15ULL;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+		return x ^ (x >> 31);
+	}
+	static void GaussianBlur(float* data, float* tmp, int width, int height, float sigma) {
+		int r = std::max(1, (int)std::ceil(3.0f*sigma));
+		//Sigma only changes with the settings, so each staging thread keeps the last kernel.
+		thread_local std::vector<float> kernel;
+		thread_local float kernelSigma = -1.0f;
+		if (sigma != kernelSigma) {
+			kernel.resize(2 * r + 1);
+			float sum = 0.0f;
+			for (int k = -r; k <= r; k++) {
+				sum += kernel[k + r] = std::exp(-0.5f*k*k / (sigma*sigma));
+			}
+			for (float& k : kernel) {
+				k /= sum;
+			}
+			kernelSigma = sigma;
+		}
+		for (int j = 0; j < height; j++) {
+			const float* row = data + j*width;
+			for (int i = 0; i < width; i++) {
+				float val = 0.0f;
+				for (int k = -r; k <= r; k++) {
+					val += kernel[k + r] * row[std::min(std::max(i + k, 0), width - 1)];
+				}
+				tmp[j*width + i] = val;
+			}
+		}
+		for (int j = 0; j < height; j++) {
+			for (int i = 0; i < width; i++) {
+				float val = 0.0f;
+				for (int k = -r; k <= r; k++) {
+					val += kernel[k + r] * tmp[std::min(std::max(j + k, 0), height - 1)*width + i];
+				}
+				data[j*width + i] = val;
+			}
+		}
+	}
+	void ResampleBilinear(const float* src, float* dst, int width, int height, const float* transform, const float* dx, const float* dy) {
+		const __m128 a = _mm_set1_ps(transform[0]);
+		const __m128 d = _mm_set1_ps(transform[3]);
+		const __m128 xmax = _mm_set1_ps((float)(width - 1));
+		const __m128 ymax = _mm_set1_ps((float)(height - 1));
+		const __m128 zero = _mm_setzero_ps();
+		alignas(16) int32_t x0[4], y0[4];
+		alignas(16) float p00[4], p10[4], p01[4], p11[4];
+		for (int j = 0; j < height; j++) {
+			float* out = dst + j*width;
+			const __m128 by = _mm_set1_ps(transform[1] * j + transform[2]);
+			const __m128 ey = _mm_set1_ps(transform[4] * j + transform[5]);
+			int i = 0;
+			for (; i + 4 <= width; i += 4) {
+				__m128 xs = _mm_set_ps(float(i + 3), float(i + 2), float(i + 1), float(i));
+				__m128 px = _mm_add_ps(_mm_mul_ps(a, xs), by);
+				__m128 py = _mm_add_ps(_mm_mul_ps(d, xs), ey);
+				if (dx != nullptr) {
+					px = _mm_add_ps(px, _mm_loadu_ps(dx + j*width + i));
+					py = _mm_add_ps(py, _mm_loadu_ps(dy + j*width + i));
+				}
+				//Clamp to the border so samples outside the image repeat the edge, which is background for padded inputs.
+				px = _mm_min_ps(_mm_max_ps(px, zero), xmax);
+				py = _mm_min_ps(_mm_max_ps(py, zero), ymax);
+				__m128i ix = _mm_cvttps_epi32(px);
+				__m128i iy = _mm_cvttps_epi32(py);
+				__m128 fx = _mm_sub_ps(px, _mm_cvtepi32_ps(ix));
+				__m128 fy = _mm_sub_ps(py, _mm_cvtepi32_ps(iy));
+				_mm_store_si128((__m128i*)x0, ix);
+				_mm_store_si128((__m128i*)y0, iy);
+				for (int k = 0; k < 4; k++) {
+					int x1 = std::min(x0[k] + 1, width - 1);
+					const float* r0 = src + y0[k] * width;
+					const float* r1 = src + std::min(y0[k] + 1, height - 1)*width;
+					p00[k] = r0[x0[k]];
+					p10[k] = r0[x1];
+					p01[k] = r1[x0[k]];
+					p11[k] = r1[x1];
+				}
+				__m128 v00 = _mm_load_ps(p00);
+				__m128 v01 = _mm_load_ps(p01);
+				__m128 top = _mm_add_ps(v00, _mm_mul_ps(fx, _mm_sub_ps(_mm_load_ps(p10), v00)));
+				__m128 bottom = _mm_add_ps(v01, _mm_mul_ps(fx, _mm_sub_ps(_mm_load_ps(p11), v01)));
+				_mm_storeu_ps(out + i, _mm_add_ps(top, _mm_mul_ps(fy, _mm_sub_ps(bottom, top))));
+			}
+			for (; i < width; i++) {
+				float px = transform[0] * i + transform[1] * j + transform[2];
+				float py = transform[3] * i + transform[4] * j + transform[5];
+				if (dx != nullptr) {
+					px += dx[j*width + i];
+					py += dy[j*width + i];
+				}
+				px = std::min(std::max(px, 0.0f), (float)(width - 1));
+				py = std::min(std::max(py, 0.0f), (float)(height - 1));
+				int ix = (int)px;
+				int iy = (int)py;
+				float fx = px - ix;
+				float fy = py - iy;
+				int ix1 = std::min(ix + 1, width - 1);
+				const float* r0 = src + iy*width;
+				const float* r1 = src + std::min(iy + 1, height - 1)*width;
+				float top = r0[ix] + fx*(r0[ix1] - r0[ix]);
+				float bottom = r1[ix] + fx*(r1[ix1] - r1[ix]);
+				out[i] = top + fy*(bottom - top);
+			}
+		}
+	}
+	NeuralAugmentation::NeuralAugmentation(float maxShift, float maxRotation, float elasticAlpha, float elasticSigma, float noise, uint64_t seed) :
+		maxShift(maxShift), maxRotation(maxRotation), elasticAlpha(elasticAlpha), elasticSigma(elasticSigma), noise(noise), seed(seed), sampleCount(0), busyTime(0) {
+	}
+	void NeuralAugmentation::makeDisplacement(std::vector<float>& field, int width, int height, uint64_t sampleSeed) const {
+		int N = width*height;
+		field.resize(3 * N);
+		std::minstd_rand rng((uint32_t)(sampleSeed >> 32) | 1);
+		std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+		for (int n = 0; n < 2 * N; n++) {
+			field[n] = uniform(rng);
+		}
+		float* tmp = field.data() + 2 * N;
+		GaussianBlur(field.data(), tmp, width, height, elasticSigma);
+		GaussianBlur(field.data() + N, tmp, width, height, elasticSigma);
+		for (int n = 0; n < 2 * N; n++) {
+			field[n] *= elasticAlpha;
+		}
+	}
+	void NeuralAugmentation::apply(float* image, int width, int height, int iteration, int idx) {
+		apply(image, width, height, MixSeed(seed ^ MixSeed(((uint64_t)(uint32_t)iteration << 32) | (uint32_t)idx)));
+	}
+	void NeuralAugmentation::apply(float* image, int width, int height, uint64_t sampleSeed) {
+		if (isIdentity() || width <= 0 || height <= 0) {
+			return;
+		}
+		TGR_PROFILE_SCOPE("augment", "pipeline");
+		auto start = std::chrono::steady_clock::now();
+		thread_local std::vector<float> source;
+		thread_local std::vector<float> field;
+		int N = width*height;
+		std::minstd_rand rng((uint32_t)sampleSeed | 1);
+		std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+		float angle = maxRotation*uniform(rng)*3.14159265f / 180.0f;
+		float tx = maxShift*uniform(rng);
+		float ty = maxShift*uniform(rng);
+		float cx = 0.5f*(width - 1);
+		float cy = 0.5f*(height - 1);
+		float c = std::cos(angle);
+		float s = std::sin(angle);
+		//Inverse map from output pixel to source pixel: rotate about the center, then shift.
+		float transform[6] = { c, s, cx - c*(cx + tx) - s*(cy + ty), -s, c, cy + s*(cx + tx) - c*(cy + ty) };
+		const float* dx = nullptr;
+		const float* dy = nullptr;
+		if (elasticAlpha > 0.0f) {
+			makeDisplacement(field, width, height, sampleSeed);
+			dx = field.data();
+			dy = field.data() + N;
+		}
+		source.assign(image, image + N);
+		ResampleBilinear(source.data(), image, width, height, transform, dx, dy);
+		if (noise > 0.0f) {
+			std::normal_distribution<float> gaussian(0.0f, noise);
+			for (int n = 0; n < N; n++) {
+				image[n] += gaussian(rng);
+			}
+		}
+		sampleCount++;
+		busyTime += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+	double NeuralAugmentation::getSamplesPerSecond() const {
+		double t = getBusySeconds();
+		return (t > 0.0) ? getSampleCount() / t : 0.0;
+	}
+	void NeuralAugmentation::resetStats() {
+		sampleCount = 0;
+		busyTime = 0;
+	}
+}
@@ -1,88 +1,137 @@
 #include "NeuralCache.h"
-#include <AlloyFileUtil.h>
+#include "NeuralProfiler.h"
 using namespace aly;
 namespace tgr {
-	void CacheElement::load() {
-		std::lock_guard<std::mutex> lockMe(accessLock);
-		if (!loaded) {
-			neuralKnowledge.reset(new NeuralKnowledge());
-			ReadNeuralKnowledgeFromFile(knowledgeFile, *neuralKnowledge);
-			loaded = true;
-		}
+	static size_t GetKnowledgeBytes(const NeuralKnowledge& k) {
+		return sizeof(NeuralKnowledge) + (k.getData().size() + k.getStateData().size()) * sizeof(float);
 	}
-	void CacheElement::unload() {
-		std::lock_guard<std::mutex> lockMe(accessLock);
-		if (loaded) {
-			if (writeOnce) {
-				WriteNeuralKnowledgeToFile(neuralKnowledge->getFile(), *neuralKnowledge);
-				writeOnce = false;
-			}
-			neuralKnowledge.reset();
-			loaded = false;
+	NeuralCache::NeuralCache(const Loader& loader, size_t maxBytes) :index(new Index()), loader(loader), maxBytes(maxBytes), usedBytes(0), clock(0), generation(0), hits(0), misses(0), running(false) {
+	}
+	NeuralCache::~NeuralCache() {
+		{
+			std::lock_guard<std::mutex> lockMe(prefetchLock);
+			running = false;
+			prefetchQueue.clear();
+		}
+		prefetchSignal.notify_all();
+		if (prefetcher.joinable()) {
+			prefetcher.join();
 		}
 	}
-	void CacheElement::set(const NeuralKnowledge& nknow) {
-		neuralKnowledge.reset(new NeuralKnowledge());
-		*neuralKnowledge = nknow;
-		knowledgeFile = nknow.getFile();
-		loaded = true;
+	void NeuralCache::setLoader(const Loader& l) {
+		clear();
+		std::lock_guard<std::mutex> lockMe(writeLock);
+		loader = l;
 	}
-	std::shared_ptr<NeuralKnowledge> CacheElement::getKnowledge() {
-		load();
-		return neuralKnowledge;
+	void NeuralCache::setBudget(size_t bytes) {
+		std::lock_guard<std::mutex> lockMe(writeLock);
+		maxBytes = bytes;
 	}
-	std::shared_ptr<CacheElement> NeuralCache::set(int frame, const NeuralKnowledge& nknow) {
-		std::lock_guard<std::mutex> lockMe(accessLock);
-		auto iter = cache.find(frame);
-		std::shared_ptr<CacheElement> elem;
-		if (iter != cache.end()) {
-			elem = iter->second;
+	std::shared_ptr<NeuralKnowledge> NeuralCache::find(int frame) {
+		std::shared_ptr<const Index> resident = std::atomic_load(&index);
+		auto iter = resident->find(frame);
+		if (iter == resident->end()) {
+			return std::shared_ptr<NeuralKnowledge>();
 		}
-		else {
-			elem = std::shared_ptr<CacheElement>(new CacheElement());
-			cache[frame] = elem;
+		iter->second->lastUse.store(clock++, std::memory_order_relaxed);
+		return iter->second->knowledge;
+	}
+	std::shared_ptr<NeuralKnowledge> NeuralCache::get(int frame) {
+		std::shared_ptr<NeuralKnowledge> knowledge = find(frame);
+		if (knowledge.get() != nullptr) {
+			hits++;
+			return knowledge;
 		}
-		elem->set(nknow);
-		if (elem->isLoaded()) {
-			while (loadedList.size() >= maxElements) {
-				cache[loadedList.begin()->second]->unload();
-				loadedList.erase(loadedList.begin());
-			}
-			loadedList.insert(std::pair<uint64_t, int>(counter++, frame));
+		misses++;
+		return load(frame);
+	}
+	std::shared_ptr<NeuralKnowledge> NeuralCache::load(int frame) {
+		std::shared_ptr<NeuralKnowledge> knowledge;
+		Loader loadFrame;
+		{
+			std::lock_guard<std::mutex> lockMe(writeLock);
+			loadFrame = loader;
+		}
+		if (!loadFrame)return knowledge;
+		uint64_t gen = generation.load();
+		{
+			TGR_PROFILE_SCOPE("cache load", "cache");
+			knowledge = loadFrame(frame);
+		}
+		if (knowledge.get() != nullptr) {
+			insert(frame, knowledge, gen);
 		}
-		return elem;
+		return knowledge;
 	}
-	std::shared_ptr<CacheElement> NeuralCache::get(int frame) {
-		std::lock_guard<std::mutex> lockMe(accessLock);
-		auto iter = cache.find(frame);
-		if (iter != cache.end()) {
-			std::shared_ptr<CacheElement> elem = iter->second;
-			if (!elem->isLoaded()) {
-				while (loadedList.size() >= maxElements) {
-					cache[loadedList.begin()->second]->unload();
-					loadedList.erase(loadedList.begin());
+	void NeuralCache::set(int frame, const std::shared_ptr<NeuralKnowledge>& knowledge) {
+		insert(frame, knowledge, generation.load());
+	}
+	void NeuralCache::insert(int frame, const std::shared_ptr<NeuralKnowledge>& knowledge, uint64_t gen) {
+		std::lock_guard<std::mutex> lockMe(writeLock);
+		//A load that started before clear() must not bring back a frame of the old run.
+		if (gen != generation.load())return;
+		std::shared_ptr<Index> next(new Index(*index));
+		auto existing = next->find(frame);
+		if (existing != next->end()) {
+			usedBytes -= existing->second->bytes;
+			next->erase(existing);
+		}
+		size_t bytes = GetKnowledgeBytes(*knowledge);
+		while (usedBytes + bytes > maxBytes && next->size() > 0) {
+			auto oldest = next->begin();
+			for (auto iter = next->begin(); iter != next->end(); iter++) {
+				if (iter->second->lastUse.load() < oldest->second->lastUse.load()) {
+					oldest = iter;
 				}
-				elem->load();
-				loadedList.insert(std::pair<uint64_t, int>(counter++, frame));
 			}
-			return elem;
+			usedBytes -= oldest->second->bytes;
+			next->erase(oldest);
 		}
-		else {
-			return std::shared_ptr<CacheElement>();
+		(*next)[frame] = std::shared_ptr<Entry>(new Entry(knowledge, bytes, clock++));
+		usedBytes += bytes;
+		std::atomic_store(&index, std::shared_ptr<const Index>(next));
+	}
+	void NeuralCache::prefetch(const std::vector<int>& frames) {
+		{
+			std::lock_guard<std::mutex> lockMe(prefetchLock);
+			prefetchQueue.assign(frames.begin(), frames.end());
+			if (!running) {
+				running = true;
+				prefetcher = std::thread([this]() {
+					prefetchLoop();
+				});
+			}
 		}
+		prefetchSignal.notify_one();
 	}
-	CacheElement::~CacheElement() {
-		if (FileExists(knowledgeFile)) {
-			RemoveFile(knowledgeFile);
-			std::string imageFile = GetFileWithoutExtension(knowledgeFile) + ".png";
-			if (FileExists(imageFile))RemoveFile(imageFile);
+	void NeuralCache::prefetchLoop() {
+		while (true) {
+			int frame;
+			{
+				std::unique_lock<std::mutex> lockMe(prefetchLock);
+				prefetchSignal.wait(lockMe, [this]() {return !running || !prefetchQueue.empty();});
+				if (!running)return;
+				frame = prefetchQueue.front();
+				prefetchQueue.pop_front();
+			}
+			if (find(frame).get() == nullptr) {
+				TGR_PROFILE_SCOPE("prefetch", "cache");
+				load(frame);
+			}
 		}
 	}
 	void NeuralCache::clear() {
-		std::lock_guard<std::mutex> lockMe(accessLock);
-		counter = 0;
-		loadedList.clear();
-		cache.clear();
-
+		{
+			std::lock_guard<std::mutex> lockMe(prefetchLock);
+			prefetchQueue.clear();
+		}
+		std::lock_guard<std::mutex> lockMe(writeLock);
+		generation++;
+		usedBytes = 0;
+		std::atomic_store(&index, std::shared_ptr<const Index>(new Index()));
+	}
+	size_t NeuralCache::getUsedBytes() {
+		std::lock_guard<std::mutex> lockMe(writeLock);
+		return usedBytes;
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,126 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralCheckpoint.h"
+#include "NeuralProfiler.h"
+#include "NeuralAllocation.h"
+#include <algorithm>
+namespace tgr {
+	NeuralCheckpointWriter::NeuralCheckpointWriter(const Sink& sink, size_t capacity) :
+		sink(sink), queue(std::max(capacity, (size_t)1)), head(0), queued(0), running(false), busy(false), writtenCount(0), droppedCount(0) {
+		reset();
+	}
+	NeuralCheckpointWriter::~NeuralCheckpointWriter() {
+		stop();
+	}
+	void NeuralCheckpointWriter::reset() {
+		lastIteration = -1;
+		lastTime = Clock::now();
+		bestResidual = 1E30;
+	}
+	void NeuralCheckpointWriter::start() {
+		std::lock_guard<std::mutex> lockMe(lock);
+		if (running)return;
+		running = true;
+		writer = std::thread([this]() {
+			run();
+		});
+	}
+	void NeuralCheckpointWriter::stop() {
+		{
+			std::lock_guard<std::mutex> lockMe(lock);
+			running = false;
+		}
+		pending.notify_all();
+		if (writer.joinable()) {
+			writer.join();
+		}
+	}
+	void NeuralCheckpointWriter::flush() {
+		std::unique_lock<std::mutex> lockMe(lock);
+		drained.wait(lockMe, [this]() {return (queued == 0 && !busy) || !writer.joinable();});
+	}
+	bool NeuralCheckpointWriter::isDue(int iteration, double residual) {
+		bool due = false;
+		if (policy.everyIterations > 0 && (lastIteration < 0 || iteration - lastIteration >= policy.everyIterations)) {
+			due = true;
+		}
+		Clock::time_point now = Clock::now();
+		if (policy.everySeconds > 0.0 && std::chrono::duration<double>(now - lastTime).count() >= policy.everySeconds) {
+			due = true;
+		}
+		if (policy.onImprovement && residual < bestResidual) {
+			due = true;
+		}
+		if (due) {
+			lastIteration = iteration;
+			lastTime = now;
+		}
+		bestResidual = std::min(bestResidual, residual);
+		return due;
+	}
+	void NeuralCheckpointWriter::submit(int iteration, const std::shared_ptr<NeuralKnowledge>& knowledge) {
+		{
+			std::lock_guard<std::mutex> lockMe(lock);
+			if (queued == queue.size()) {
+				queue[head].knowledge.reset();
+				head = (head + 1) % queue.size();
+				queued--;
+				droppedCount++;
+			}
+			Checkpoint& checkpoint = queue[(head + queued) % queue.size()];
+			checkpoint.iteration = iteration;
+			checkpoint.knowledge = knowledge;
+			queued++;
+		}
+		pending.notify_one();
+	}
+	void NeuralCheckpointWriter::run() {
+		//Sinks compress and serialize, which allocates by design. An allocation audit of training should not see it.
+		AllocationAudit::ignoreCurrentThread();
+		while (true) {
+			Checkpoint checkpoint;
+			{
+				std::unique_lock<std::mutex> lockMe(lock);
+				pending.wait(lockMe, [this]() {return !running || queued > 0;});
+				if (queued == 0) {
+					drained.notify_all();
+					return;
+				}
+				//Moved out so the ring does not keep the snapshot alive after it is written.
+				checkpoint = std::move(queue[head]);
+				queue[head].knowledge.reset();
+				head = (head + 1) % queue.size();
+				queued--;
+				busy = true;
+			}
+			{
+				TGR_PROFILE_SCOPE("checkpoint", "checkpoint");
+				sink(checkpoint.iteration, checkpoint.knowledge);
+			}
+			writtenCount++;
+			{
+				std::lock_guard<std::mutex> lockMe(lock);
+				busy = false;
+			}
+			drained.notify_all();
+		}
+	}
+}
@@ -1,15 +1,15 @@
 #include "NeuralFilter.h"
 namespace tgr {
 	void NeuralFilter::evaluate() {
-		for (NeuralLayerPtr layer : outputLayers) {
-			layer->evaluate();
+		for (const NeuralLayerPtr& layer : outputLayers) {
+			if (layer->isDirty())layer->evaluate();
 		}
 	}
 	void NeuralFilter::backpropagate() {
-		for (NeuralLayerPtr layer : outputLayers) {
+		for (const NeuralLayerPtr& layer : outputLayers) {
 			if (layer->isLeaf())layer->backpropagate();
 		}
-		for (NeuralLayerPtr layer : inputLayers) {
+		for (const NeuralLayerPtr& layer : inputLayers) {
 			layer->backpropagate();
 		}
 	}
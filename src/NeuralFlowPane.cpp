@@ -129,9 +129,69 @@ namespace aly{
 	}
 	void NeuralFlowPane::pack(const pixel2& pos, const pixel2& dims, const double2& dpmm, double pixelRatio, bool clamp) {
 		Composite::pack(pos, dims, dpmm, pixelRatio);
+		route();
+	}
+	static bool Overlaps(const box2px& box, const float2& a, const float2& b) {
+		return (std::max(a.x, b.x) >= box.position.x && std::min(a.x, b.x) <= box.position.x + box.dimensions.x &&
+			std::max(a.y, b.y) >= box.position.y && std::min(a.y, b.y) <= box.position.y + box.dimensions.y);
+	}
+	void NeuralFlowPane::route() {
+		std::set<NeuralLayerRegion*> moved;
+		//Old and new bounds of moved regions. A path crossing either may need to change.
+		std::vector<box2px> changed;
+		bool translated = true;
+		float2 delta(0.0f, 0.0f);
+		for (NeuralLayerRegionPtr region : layerRegions) {
+			box2px box = region->getObstacleBounds();
+			auto pos = routedBounds.find(region.get());
+			if (pos == routedBounds.end()) {
+				moved.insert(region.get());
+				changed.push_back(box);
+				translated = false;
+				routedBounds[region.get()] = box;
+				continue;
+			}
+			box2px& last = pos->second;
+			float2 d = box.position - last.position;
+			if (d.x == 0.0f && d.y == 0.0f && box.dimensions == last.dimensions) {
+				translated = false;
+				continue;
+			}
+			if (box.dimensions != last.dimensions || (moved.size() > 0 && d != delta)) {
+				translated = false;
+			}
+			delta = d;
+			moved.insert(region.get());
+			changed.push_back(last);
+			changed.push_back(box);
+			last = box;
+		}
+		if (moved.size() == 0) {
+			return;
+		}
 		router.update();
+		if (translated && moved.size() == layerRegions.size()) {
+			//The whole graph was dragged, so the routes are unchanged apart from the offset.
+			for (NeuralConnectionPtr connect : connections) {
+				for (float2& pt : connect->path) {
+					pt += delta;
+				}
+			}
+			return;
+		}
 		for (NeuralConnectionPtr connect : connections) {
-			router.evaluate(connect);
+			bool reroute = (connect->path.size() == 0 || moved.count(connect->source.get()) != 0 || moved.count(connect->destination.get()) != 0);
+			for (int i = 0; !reroute && i < (int)connect->path.size() - 1; i++) {
+				for (const box2px& box : changed) {
+					if (Overlaps(box, connect->path[i], connect->path[i + 1])) {
+						reroute = true;
+						break;
+					}
+				}
+			}
+			if (reroute) {
+				router.evaluate(connect);
+			}
 		}
 	}
 	bool NeuralFlowPane::onEventHandler(AlloyContext* context, const InputEvent& e) {
@@ -211,6 +271,26 @@ namespace aly{
 			}
 		}
 		popScissor(nvg);
+		//Picks up snapshots published since the last frame and zoom or scroll changes. Dirty layer caches are then rasterized together on the CPU and each is uploaded once.
+		std::vector<NeuralLayerRegion*> dirty;
+		for (NeuralLayerRegionPtr layerRegion : layerRegions) {
+			if (layerRegion->getLayer()->getSnapshots()->update()) {
+				layerRegion->setDirty(true);
+			}
+			if (layerRegion->isVisible()) {
+				layerRegion->updateDetail();
+				if (layerRegion->isDirty()) {
+					dirty.push_back(layerRegion.get());
+				}
+			}
+			else if (!layerRegion->isReleased()) {
+				layerRegion->release();
+			}
+		}
+#pragma omp parallel for
+		for (int i = 0; i < (int)dirty.size(); i++) {
+			dirty[i]->rasterize();
+		}
 		for (std::shared_ptr<Region>& region : children) {
 			if (region->isVisible()) {
 				region->draw(context);
@@ -267,6 +347,9 @@ namespace aly{
 			pixel2 cursorPosition = selectedLayer->getRegion()->cursorPosition;
 			if (selected.x != -1 && selected.y != -1 && glfwGetKey(context->window,GLFW_KEY_LEFT)==GLFW_RELEASE&&glfwGetKey(context->window, GLFW_KEY_RIGHT) == GLFW_RELEASE) {
 				Neuron* neuron = layer->get(selected.x, selected.y);
+				const LayerSnapshot& snap = layer->getSnapshots()->getFront();
+				int idx = layer->getIndex(neuron);
+				float value = (idx >= 0 && idx < (int)snap.responses.size()) ? snap.responses[idx] : 0.0f;
 				context->setCursor(&Cursor::CrossHairs);
 				nvgFontFaceId(nvg, context->getFontHandle(FontType::Bold));
 				nvgFontSize(nvg, 20.0f);
@@ -274,7 +357,7 @@ namespace aly{
 				float yoffset = 10.0f;
 				drawText(nvg, cursorPosition + pixel2(0.0f, yoffset), MakeString() << neuron->getType() << " " << selected, FontStyle::Outline, context->theme.LIGHTER, context->theme.DARKER);
 				yoffset += 20.0f;
-				drawText(nvg, cursorPosition + pixel2(0.0f, yoffset), MakeString() << "value: " <<std::setw(4)<<std::setprecision(3)<<*neuron->value, FontStyle::Outline, context->theme.LIGHTER, context->theme.DARKER);
+				drawText(nvg, cursorPosition + pixel2(0.0f, yoffset), MakeString() << "value: " <<std::setw(4)<<std::setprecision(3)<<value, FontStyle::Outline, context->theme.LIGHTER, context->theme.DARKER);
 				yoffset += 20.0f;
 				if (neuron->getInputNeuronSize() > 0) {
 					drawText(nvg, cursorPosition + pixel2(0.0f, yoffset), MakeString() << "in neurons: " << neuron->getInputNeuronSize(), FontStyle::Outline, context->theme.LIGHTER, context->theme.DARKER);
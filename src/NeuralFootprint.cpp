@@ -0,0 +1,250 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralFootprint.h"
+#include "Neuron.h"
+#include <iomanip>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+namespace tgr {
+	LayerFootprint& LayerFootprint::operator+=(const LayerFootprint& r) {
+		neurons += r.neurons;
+		signals += r.signals;
+		connections += r.connections;
+		neuronBytes += r.neuronBytes;
+		signalBytes += r.signalBytes;
+		mappingBytes += r.mappingBytes;
+		knowledgeBytes += r.knowledgeBytes;
+		stateBytes += r.stateBytes;
+		snapshotBytes += r.snapshotBytes;
+		return *this;
+	}
+	size_t GetMappingEntryBytes() {
+		//A red-black tree node carries three links and a color next to its value.
+		return 4 * sizeof(void*) + sizeof(std::pair<const Neuron* const, std::vector<Neuron*>>);
+	}
+	size_t GetSignalBytes() {
+		//Signals are made with new, so each shared_ptr has a separate control block with a vtable, two counts and the pointer.
+		return sizeof(Signal) + 2 * sizeof(void*) + 2 * sizeof(int32_t);
+	}
+	FootprintEstimator::FootprintEstimator(int stateSize) :stateSize(stateSize) {
+	}
+	const FootprintEstimator::Shape& FootprintEstimator::getShape(int layer) const {
+		if (layer < 0 || layer >= (int)shapes.size()) {
+			throw std::runtime_error(aly::MakeString() << "Footprint estimate has no layer " << layer);
+		}
+		return shapes[layer];
+	}
+	int FootprintEstimator::addLayer(const std::string& name, int width, int height, int bins, bool bias) {
+		Shape shape;
+		shape.width = width;
+		shape.height = height;
+		shape.bins = bins;
+		shape.bias = bias;
+		shape.inputEntries = 0;
+		shape.outputEntries = 0;
+		shape.forwardEntries = 0;
+		shape.backwardEntries = 0;
+		shapes.push_back(shape);
+		layers.push_back(LayerFootprint(name, (int)layers.size()));
+		int layer = (int)shapes.size() - 1;
+		if (bias) {
+			//NeuralLayer::compile() gives every neuron its own bias neuron and weight.
+			size_t N = (size_t)width*height;
+			addSignals(layer, N, N, N, N, N);
+			shapes[layer].outputEntries += N;
+		}
+		return layer;
+	}
+	void FootprintEstimator::addSignals(int layer, size_t signals, size_t connections, size_t forwardEntries, size_t backwardEntries, size_t inputEntries) {
+		Shape& shape = shapes[layer];
+		layers[layer].signals += signals;
+		layers[layer].connections += connections;
+		shape.forwardEntries += forwardEntries;
+		shape.backwardEntries += backwardEntries;
+		shape.inputEntries += inputEntries;
+	}
+	void FootprintEstimator::addFilter(const std::string& name, const std::vector<int>& outputs) {
+		FilterFootprint filter;
+		filter.name = name;
+		filter.layers = outputs;
+		filters.push_back(filter);
+	}
+	int FootprintEstimator::addInput(const std::string& name, int width, int height, int bins) {
+		return addLayer(name, width, height, bins, false);
+	}
+	std::vector<int> FootprintEstimator::addConvolution(const std::string& name, const std::vector<int>& inputs, int kernelSize, int features, bool bias, const std::vector<std::pair<int, int>>& connectionMap) {
+		if (inputs.size() == 0) {
+			throw std::runtime_error("Convolution needs at least one input.");
+		}
+		if (kernelSize % 2 == 0) {
+			throw std::runtime_error("Kernel size must be odd.");
+		}
+		Shape in = getShape(inputs[0]);
+		int pad = kernelSize / 2;
+		int ow = in.width - 2 * pad;
+		int oh = in.height - 2 * pad;
+		size_t K = (size_t)kernelSize*kernelSize;
+		size_t N = (size_t)ow*oh;
+		std::vector<int> outputs;
+		if (connectionMap.size() == 0) {
+			//Every feature shares one kernel across all inputs.
+			size_t I = inputs.size();
+			for (int f = 0; f < features; f++) {
+				int out = addLayer(aly::MakeString() << name << " [" << f << "]", ow, oh, 1, bias);
+				addSignals(out, K, I*N*K, K*N, K*N*I, I*N*K);
+				outputs.push_back(out);
+			}
+			for (int input : inputs) {
+				shapes[input].outputEntries += (size_t)features*N*K;
+			}
+		}
+		else {
+			//Each connected pair gets its own kernel.
+			std::map<int, int> created;
+			for (const std::pair<int, int>& pr : connectionMap) {
+				if (pr.first < 0 || pr.first >= (int)inputs.size()) {
+					throw std::runtime_error(aly::MakeString() << "Connection map refers to input " << pr.first << " of " << inputs.size());
+				}
+				auto pos = created.find(pr.second);
+				if (pos == created.end()) {
+					pos = created.insert(std::make_pair(pr.second, addLayer(aly::MakeString() << name << " [" << pr.second << "]", ow, oh, 1, bias))).first;
+				}
+				addSignals(pos->second, K, N*K, K*N, K*N, N*K);
+				shapes[inputs[pr.first]].outputEntries += N*K;
+			}
+			for (const std::pair<int, int>& pr : created) {
+				outputs.push_back(pr.second);
+			}
+		}
+		addFilter(name, outputs);
+		return outputs;
+	}
+	std::vector<int> FootprintEstimator::addAveragePool(const std::string& name, const std::vector<int>& inputs, int kernelSize, bool bias) {
+		std::vector<int> outputs;
+		size_t K = (size_t)kernelSize*kernelSize;
+		for (int input : inputs) {
+			//Copied, since adding the output layer may move the shapes.
+			Shape in = getShape(input);
+			if (in.width%kernelSize != 0 || in.height%kernelSize != 0) {
+				throw std::runtime_error("Map size must be divisible by kernel size.");
+			}
+			int out = addLayer(name, in.width / kernelSize, in.height / kernelSize, 1, bias);
+			//One signal per output neuron gathers its whole window.
+			size_t N = (size_t)(in.width / kernelSize)*(in.height / kernelSize);
+			addSignals(out, N, N*K, N, N*K, N);
+			shapes[input].outputEntries += N*K;
+			outputs.push_back(out);
+		}
+		addFilter(name, outputs);
+		return outputs;
+	}
+	int FootprintEstimator::addFullyConnected(const std::string& name, const std::vector<int>& inputs, int width, int height, bool bias) {
+		int out = addLayer(name, width, height, 1, bias);
+		size_t M = (size_t)width*height;
+		for (int input : inputs) {
+			const Shape& in = getShape(input);
+			//Every pair of neurons gets its own signal.
+			size_t C = (size_t)in.width*in.height*in.bins*M;
+			addSignals(out, C, C, C, C, C);
+			shapes[input].outputEntries += C;
+		}
+		addFilter(name, std::vector<int>(1, out));
+		return out;
+	}
+	SystemFootprint FootprintEstimator::getFootprint() const {
+		SystemFootprint footprint;
+		for (size_t l = 0; l < shapes.size(); l++) {
+			const Shape& shape = shapes[l];
+			LayerFootprint layer = layers[l];
+			size_t responses = (size_t)shape.width*shape.height*shape.bins;
+			size_t biasNeurons = (shape.bias) ? (size_t)shape.width*shape.height : 0;
+			layer.neurons = responses + biasNeurons;
+			layer.neuronBytes = layer.neurons*sizeof(Neuron) + (shape.inputEntries + shape.outputEntries)*sizeof(SignalPtr);
+			layer.signalBytes = layer.signals*GetSignalBytes();
+			layer.mappingBytes = (shape.forwardEntries + shape.backwardEntries)*GetMappingEntryBytes() + 2 * layer.connections*sizeof(Neuron*);
+			//Responses and changes of every neuron, and weights and changes in the arena.
+			layer.knowledgeBytes = 2 * (layer.neurons + layer.signals)*sizeof(float);
+			layer.stateBytes = (size_t)stateSize*layer.signals*sizeof(float);
+			//Three snapshot buffers once the layer has been published often enough.
+			layer.snapshotBytes = 3 * (responses + layer.signals)*sizeof(float);
+			footprint.layers.push_back(layer);
+			footprint.total += layer;
+		}
+		footprint.filters = filters;
+		for (FilterFootprint& filter : footprint.filters) {
+			filter.total.name = filter.name;
+			for (int l : filter.layers) {
+				filter.total += footprint.layers[l];
+			}
+		}
+		return footprint;
+	}
+	static std::string FormatBytes(size_t bytes) {
+		std::stringstream ss;
+		ss << std::fixed << std::setprecision(1);
+		if (bytes >= (size_t(1) << 30)) {
+			ss << bytes / double(size_t(1) << 30) << " GB";
+		}
+		else if (bytes >= (size_t(1) << 20)) {
+			ss << bytes / double(size_t(1) << 20) << " MB";
+		}
+		else if (bytes >= (size_t(1) << 10)) {
+			ss << bytes / double(size_t(1) << 10) << " KB";
+		}
+		else {
+			ss << bytes << " B";
+		}
+		return ss.str();
+	}
+	static void WriteRow(std::ostream& os, const std::string& name, const LayerFootprint& fp) {
+		os << std::left << std::setw(36) << name.substr(0, 35) << std::right << std::setw(10) << fp.neurons << std::setw(12) << fp.signals << std::setw(12) << fp.connections;
+		os << std::setw(12) << FormatBytes(fp.neuronBytes) << std::setw(12) << FormatBytes(fp.signalBytes) << std::setw(12) << FormatBytes(fp.mappingBytes);
+		os << std::setw(12) << FormatBytes(fp.knowledgeBytes) << std::setw(12) << FormatBytes(fp.stateBytes) << std::setw(12) << FormatBytes(fp.snapshotBytes) << std::setw(12) << FormatBytes(fp.getBytes()) << std::endl;
+	}
+	void WriteFootprintReport(std::ostream& os, const SystemFootprint& footprint) {
+		os << std::left << std::setw(36) << "Filter / Layer" << std::right << std::setw(10) << "Neurons" << std::setw(12) << "Signals" << std::setw(12) << "Links";
+		os << std::setw(12) << "Neurons" << std::setw(12) << "Signals" << std::setw(12) << "Maps" << std::setw(12) << "Knowledge" << std::setw(12) << "State" << std::setw(12) << "Snapshots" << std::setw(12) << "Total" << std::endl;
+		os << std::string(152, '-') << std::endl;
+		std::set<int> listed;
+		for (const FilterFootprint& filter : footprint.filters) {
+			listed.insert(filter.layers.begin(), filter.layers.end());
+		}
+		//Input layers are not the output of any filter.
+		for (int l = 0; l < (int)footprint.layers.size(); l++) {
+			if (listed.count(l) == 0) {
+				WriteRow(os, footprint.layers[l].name, footprint.layers[l]);
+			}
+		}
+		for (const FilterFootprint& filter : footprint.filters) {
+			WriteRow(os, filter.name, filter.total);
+			if (filter.layers.size() > 1) {
+				for (int l : filter.layers) {
+					WriteRow(os, "  " + footprint.layers[l].name, footprint.layers[l]);
+				}
+			}
+		}
+		os << std::string(152, '-') << std::endl;
+		WriteRow(os, footprint.total.name, footprint.total);
+		os << "Graph " << FormatBytes(footprint.total.getGraphBytes()) << ", knowledge snapshot " << FormatBytes(footprint.knowledgeBytes) << ", history cache " << FormatBytes(footprint.cacheBytes) << ", overall " << FormatBytes(footprint.getBytes()) << std::endl;
+	}
+}
@@ -0,0 +1,179 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralHeatmap.h"
+#include "NeuralLayer.h"
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+namespace aly {
+	static const int SUPERSAMPLES = 8;
+	static void MakeLut(std::vector<uint16_t>& lut) {
+		lut.resize(NeuralHeatmap::LUT_SIZE * 4);
+		for (int i = 0; i < NeuralHeatmap::LUT_SIZE; i++) {
+			RGBAf c = ColorMapToRGB(i / float(NeuralHeatmap::LUT_SIZE - 1), ColorMap::RedToBlue);
+			lut[4 * i] = (uint16_t)clamp((int)std::round(255.0f*c.x), 0, 255);
+			lut[4 * i + 1] = (uint16_t)clamp((int)std::round(255.0f*c.y), 0, 255);
+			lut[4 * i + 2] = (uint16_t)clamp((int)std::round(255.0f*c.z), 0, 255);
+			lut[4 * i + 3] = (uint16_t)clamp((int)std::round(255.0f*c.w), 0, 255);
+		}
+	}
+	NeuralHeatmap::NeuralHeatmap(int cellSize, const Color& background, const Color& ring, const Color& stroke) :cellSize(cellSize) {
+		//Same geometry as the NanoVG glyph: a ring colored disk with the response in an outlined inner disk.
+		float rOuter = 0.5f*cellSize;
+		float rInner = 0.25f*cellSize;
+		float lineWidth = std::max(0.01f*cellSize, 1.0f / SUPERSAMPLES);
+		const Color* colors[3] = { &background, &ring, &stroke };
+		base.resize(cellSize*cellSize * 4);
+		weight.resize(cellSize*cellSize * 4);
+		for (int y = 0; y < cellSize; y++) {
+			for (int x = 0; x < cellSize; x++) {
+				float sums[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+				int fill = 0;
+				for (int sy = 0; sy < SUPERSAMPLES; sy++) {
+					for (int sx = 0; sx < SUPERSAMPLES; sx++) {
+						float dx = x + (sx + 0.5f) / SUPERSAMPLES - rOuter;
+						float dy = y + (sy + 0.5f) / SUPERSAMPLES - rOuter;
+						float d = std::sqrt(dx*dx + dy*dy);
+						const Color* c = colors[0];
+						if (std::abs(d - rInner) <= 0.5f*lineWidth) {
+							c = colors[2];
+						}
+						else if (d <= rInner) {
+							fill++;
+							continue;
+						}
+						else if (d <= rOuter) {
+							c = colors[1];
+						}
+						sums[0] += c->r;
+						sums[1] += c->g;
+						sums[2] += c->b;
+						sums[3] += c->a;
+					}
+				}
+				int N = SUPERSAMPLES*SUPERSAMPLES;
+				size_t idx = 4 * (x + y*cellSize);
+				for (int k = 0; k < 4; k++) {
+					base[idx + k] = (uint16_t)std::round(255.0f * 256.0f * sums[k] / N);
+					weight[idx + k] = (uint16_t)((256 * fill + N / 2) / N);
+				}
+			}
+		}
+		MakeLut(lut);
+	}
+	NeuralHeatmap::NeuralHeatmap(int cellSize) :cellSize(cellSize) {
+		base.assign(cellSize*cellSize * 4, 0);
+		weight.assign(cellSize*cellSize * 4, 256);
+		MakeLut(lut);
+	}
+	bool NeuralHeatmap::rasterize(const tgr::NeuralLayer& layer, const std::vector<float>& responses, ImageRGBA& image) const {
+		return rasterize(layer, responses, int2(0, 0), int2(layer.width, layer.height), 1, image);
+	}
+	bool NeuralHeatmap::rasterize(const tgr::NeuralLayer& layer, const std::vector<float>& responses, int2 start, int2 end, int tile, ImageRGBA& image) const {
+		int LW = layer.width;
+		start.x = clamp(start.x, 0, LW);
+		start.y = clamp(start.y, 0, layer.height);
+		end.x = clamp(end.x, start.x, LW);
+		end.y = clamp(end.y, start.y, layer.height);
+		tile = std::max(tile, 1);
+		int W = (end.x - start.x + tile - 1) / tile;
+		int H = (end.y - start.y + tile - 1) / tile;
+		int N = W*H;
+		if (N == 0 || responses.size() < (size_t)(LW*layer.height) || layer.getNeurons().size() == 0) {
+			return false;
+		}
+		if (image.width != W*cellSize || image.height != H*cellSize) {
+			image.resize(W*cellSize, H*cellSize);
+		}
+		//Gather the window, averaging each tile. Partial tiles at the window edge average the neurons they cover.
+		thread_local std::vector<float> gathered;
+		gathered.resize(N);
+		for (int j = 0; j < H; j++) {
+			int y0 = start.y + j*tile;
+			int y1 = std::min(y0 + tile, end.y);
+			for (int i = 0; i < W; i++) {
+				int x0 = start.x + i*tile;
+				int x1 = std::min(x0 + tile, end.x);
+				float sum = 0.0f;
+				for (int y = y0; y < y1; y++) {
+					const float* row = responses.data() + (size_t)y*LW;
+					for (int x = x0; x < x1; x++) {
+						sum += row[x];
+					}
+				}
+				gathered[i + j*W] = sum / ((x1 - x0)*(y1 - y0));
+			}
+		}
+		const tgr::NeuronFunction& func = layer.getNeurons().front().getFunction();
+		float mn = func.min();
+		float scale = (LUT_SIZE - 1) / std::max(1E-10f, func.max() - mn);
+		//Normalize and quantize four responses at a time, matching Neuron::normalizedValue().
+		thread_local std::vector<int32_t> indexes;
+		indexes.resize(N + 3);
+		const float* values = gathered.data();
+		__m128 vmin = _mm_set1_ps(mn);
+		__m128 vscale = _mm_set1_ps(scale);
+		__m128 vzero = _mm_setzero_ps();
+		__m128 vmax = _mm_set1_ps((float)(LUT_SIZE - 1));
+		int n = 0;
+		for (; n + 4 <= N; n += 4) {
+			__m128 v = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(values + n), vmin), vscale);
+			v = _mm_min_ps(_mm_max_ps(v, vzero), vmax);
+			_mm_storeu_si128((__m128i*)(indexes.data() + n), _mm_cvtps_epi32(v));
+		}
+		for (; n < N; n++) {
+			float v = (values[n] - mn)*scale;
+			//Casting a non-finite or out of range float to int is undefined. NaN maps to 0, as in the SSE path.
+			indexes[n] = std::isfinite(v) ? (int)std::round(clamp(v, 0.0f, (float)(LUT_SIZE - 1))) : ((v > 0.0f) ? LUT_SIZE - 1 : 0);
+		}
+		uint8_t* pixels = (uint8_t*)image.ptr();
+		size_t rowBytes = (size_t)image.width * 4;
+		__m128i vround = _mm_set1_epi16(128);
+		for (int j = 0; j < H; j++) {
+			for (int i = 0; i < W; i++) {
+				const uint16_t* c = &lut[4 * indexes[i + j*W]];
+				__m128i color = _mm_setr_epi16(c[0], c[1], c[2], c[3], c[0], c[1], c[2], c[3]);
+				uint8_t* cell = pixels + (size_t)j*cellSize*rowBytes + (size_t)i*cellSize * 4;
+				for (int y = 0; y < cellSize; y++) {
+					const uint16_t* b = &base[y*cellSize * 4];
+					const uint16_t* w = &weight[y*cellSize * 4];
+					uint8_t* dst = cell + y*rowBytes;
+					int x = 0;
+					//Four pixels per iteration: base + weight*color in 8.8 fixed point, rounded and packed to bytes.
+					for (; x + 4 <= cellSize; x += 4) {
+						__m128i lo = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(b + 4 * x)), _mm_mullo_epi16(_mm_loadu_si128((const __m128i*)(w + 4 * x)), color));
+						__m128i hi = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(b + 4 * x + 8)), _mm_mullo_epi16(_mm_loadu_si128((const __m128i*)(w + 4 * x + 8)), color));
+						lo = _mm_srli_epi16(_mm_add_epi16(lo, vround), 8);
+						hi = _mm_srli_epi16(_mm_add_epi16(hi, vround), 8);
+						_mm_storeu_si128((__m128i*)(dst + 4 * x), _mm_packus_epi16(lo, hi));
+					}
+					for (; x < cellSize; x++) {
+						for (int k = 0; k < 4; k++) {
+							int v = (b[4 * x + k] + w[4 * x + k] * c[k] + 128) >> 8;
+							dst[4 * x + k] = (uint8_t)std::min(v, 255);
+						}
+					}
+				}
+			}
+		}
+		return true;
+	}
+}
@@ -0,0 +1,287 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralHistory.h"
+#include "HalfFloat.h"
+#include <zlib.h>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <stdexcept>
+namespace tgr {
+	static inline uint32_t FloatBits(float f) {
+		uint32_t u;
+		std::memcpy(&u, &f, sizeof(float));
+		return u;
+	}
+	static inline float BitsFloat(uint32_t u) {
+		float f;
+		std::memcpy(&f, &u, sizeof(float));
+		return f;
+	}
+	//Zigzag of the integer difference between the bit patterns, so small changes of either sign give small codes.
+	static inline uint32_t EncodeDelta(uint32_t cur, uint32_t prev) {
+		int32_t d = (int32_t)(cur - prev);
+		return ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+	}
+	static inline uint32_t DecodeDelta(uint32_t code, uint32_t prev) {
+		return prev + ((code >> 1) ^ (0u - (code & 1)));
+	}
+	static inline uint16_t EncodeDelta(uint16_t cur, uint16_t prev) {
+		int16_t d = (int16_t)(uint16_t)(cur - prev);
+		return (uint16_t)(((uint16_t)d << 1) ^ (uint16_t)(d >> 15));
+	}
+	static inline uint16_t DecodeDelta(uint16_t code, uint16_t prev) {
+		return (uint16_t)(prev + ((code >> 1) ^ (0u - (code & 1))));
+	}
+	//Byte n*B+p of src goes to plane p, so bytes of equal significance are adjacent.
+	static void SplitPlanes(const uint8_t* src, uint8_t* dst, size_t N, int B) {
+		for (size_t n = 0; n < N; n++) {
+			for (int p = 0; p < B; p++) {
+				dst[p*N + n] = src[n*B + p];
+			}
+		}
+	}
+	static void MergePlanes(const uint8_t* src, uint8_t* dst, size_t N, int B) {
+		for (size_t n = 0; n < N; n++) {
+			for (int p = 0; p < B; p++) {
+				dst[n*B + p] = src[p*N + n];
+			}
+		}
+	}
+	//Only a half precision frame's weights are stored as fp16. Optimizer state stays fp32 so resuming from any frame keeps exact moments.
+	static size_t GetHalfCount(bool half, size_t weightCount) {
+		return half ? weightCount : 0;
+	}
+	//The fp32 words follow the fp16 words, padded so they stay 4 byte aligned.
+	static size_t GetFloatOffset(size_t halfCount) {
+		return (halfCount * sizeof(uint16_t) + 3) & ~(size_t)3;
+	}
+	NeuralHistory::NeuralHistory(const NeuralHistoryOptions& options) :options(options) {
+		clear();
+	}
+	void NeuralHistory::setOptions(const NeuralHistoryOptions& opts) {
+		std::lock_guard<std::mutex> lockMe(encodeLock);
+		options = opts;
+		//The next frame starts a new chain so it is encoded with the new settings.
+		sinceKeyframe = std::numeric_limits<int>::max() / 2;
+	}
+	void NeuralHistory::clear() {
+		std::lock_guard<std::mutex> encodeMe(encodeLock);
+		std::lock_guard<std::mutex> decodeMe(decodeLock);
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		frames.clear();
+		last.clear();
+		cursor.clear();
+		cursorWeights.clear();
+		cursorState.clear();
+		lastFrame = -1;
+		lastKeyframe = -1;
+		cursorFrame = -1;
+		sinceKeyframe = 0;
+		rawBytes = 0;
+		storedBytes = 0;
+	}
+	void NeuralHistory::add(int frameIndex, const NeuralKnowledge& knowledge) {
+		std::lock_guard<std::mutex> encodeMe(encodeLock);
+		if (lastFrame >= 0 && frameIndex <= lastFrame) {
+			throw std::runtime_error("History frame " + std::to_string(frameIndex) + " added after frame " + std::to_string(lastFrame));
+		}
+		const KnowledgeStore& weights = knowledge.getData();
+		const KnowledgeStore& state = knowledge.getStateData();
+		size_t N = weights.size() + state.size();
+		thread_local std::vector<float> values;
+		values.resize(N);
+		weights.copyTo(values.data());
+		state.copyTo(values.data() + weights.size());
+		bool key = (lastKeyframe < 0 || last.size() != N || sinceKeyframe + 1 >= options.keyframeInterval);
+		Frame frame;
+		frame.keyframe = key ? frameIndex : lastKeyframe;
+		frame.half = (!key && options.halfPrecision);
+		frame.count = N;
+		frame.weightCount = weights.size();
+		frame.header.reset(new NeuralKnowledge());
+		frame.header->setHeader(knowledge);
+		size_t H = GetHalfCount(frame.half, frame.weightCount);
+		size_t offset = GetFloatOffset(H);
+		size_t bytes = offset + (N - H) * sizeof(float);
+		thread_local std::vector<uint8_t> words;
+		thread_local std::vector<uint8_t> planes;
+		words.resize(bytes);
+		planes.resize(bytes);
+		if (key) {
+			std::memcpy(words.data(), values.data(), N * sizeof(float));
+			last = values;
+		}
+		else {
+			uint16_t* hw = (uint16_t*)words.data();
+			for (size_t n = 0; n < H; n++) {
+				uint16_t h = FloatToHalf(values[n]);
+				hw[n] = EncodeDelta(h, FloatToHalf(last[n]));
+				last[n] = HalfToFloat(h);
+			}
+			uint32_t* w = (uint32_t*)(words.data() + offset);
+			for (size_t n = H; n < N; n++) {
+				w[n - H] = EncodeDelta(FloatBits(values[n]), FloatBits(last[n]));
+				last[n] = values[n];
+			}
+		}
+		SplitPlanes(words.data(), planes.data(), H, 2);
+		std::memset(planes.data() + H * 2, 0, offset - H * 2);
+		SplitPlanes(words.data() + offset, planes.data() + offset, N - H, 4);
+		uLongf compressedSize = compressBound((uLong)planes.size());
+		std::shared_ptr<std::vector<uint8_t>> data(new std::vector<uint8_t>(compressedSize));
+		if (compress2(data->data(), &compressedSize, planes.data(), (uLong)planes.size(), options.compressionLevel) != Z_OK) {
+			throw std::runtime_error("Could not compress history frame.");
+		}
+		data->resize(compressedSize);
+		data->shrink_to_fit();
+		frame.data = data;
+		sinceKeyframe = key ? 0 : sinceKeyframe + 1;
+		lastKeyframe = frame.keyframe;
+		lastFrame = frameIndex;
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		rawBytes += N * sizeof(float);
+		storedBytes += data->size();
+		frames[frameIndex] = std::move(frame);
+	}
+	void NeuralHistory::decode(const Frame& frame, bool keyframe, std::vector<float>& values) {
+		size_t N = frame.count;
+		size_t H = GetHalfCount(frame.half, frame.weightCount);
+		size_t offset = GetFloatOffset(H);
+		size_t bytes = offset + (N - H) * sizeof(float);
+		thread_local std::vector<uint8_t> words;
+		thread_local std::vector<uint8_t> planes;
+		words.resize(bytes);
+		planes.resize(bytes);
+		uLongf size = (uLongf)planes.size();
+		if (uncompress(planes.data(), &size, frame.data->data(), (uLong)frame.data->size()) != Z_OK || size != planes.size()) {
+			throw std::runtime_error("History frame is corrupt.");
+		}
+		MergePlanes(planes.data(), words.data(), H, 2);
+		MergePlanes(planes.data() + offset, words.data() + offset, N - H, 4);
+		if (keyframe) {
+			values.resize(N);
+			std::memcpy(values.data(), words.data(), N * sizeof(float));
+		}
+		else {
+			const uint16_t* hw = (const uint16_t*)words.data();
+			for (size_t n = 0; n < H; n++) {
+				values[n] = HalfToFloat(DecodeDelta(hw[n], FloatToHalf(values[n])));
+			}
+			const uint32_t* w = (const uint32_t*)(words.data() + offset);
+			for (size_t n = H; n < N; n++) {
+				values[n] = BitsFloat(DecodeDelta(w[n - H], FloatBits(values[n])));
+			}
+		}
+	}
+	bool NeuralHistory::contains(int frame) const {
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		return (frames.find(frame) != frames.end());
+	}
+	int NeuralHistory::getFloor(int frame) const {
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		auto iter = frames.upper_bound(frame);
+		if (iter == frames.begin())return -1;
+		return (--iter)->first;
+	}
+	std::vector<int> NeuralHistory::getNeighbors(int frame, int radius) const {
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		std::vector<int> neighbors;
+		auto after = frames.upper_bound(frame);
+		auto before = frames.lower_bound(frame);
+		int ahead = 0, behind = 0;
+		//Walks outward from frame, taking whichever side is closer. Ties go forward.
+		while (true) {
+			bool forward = (ahead < radius && after != frames.end());
+			bool backward = (behind < radius && before != frames.begin());
+			if (!forward && !backward)break;
+			if (forward && backward) {
+				auto prev = before;
+				prev--;
+				forward = (after->first - frame <= frame - prev->first);
+			}
+			if (forward) {
+				neighbors.push_back((after++)->first);
+				ahead++;
+			}
+			else {
+				neighbors.push_back((--before)->first);
+				behind++;
+			}
+		}
+		return neighbors;
+	}
+	bool NeuralHistory::get(int frameIndex, NeuralKnowledge& knowledge) {
+		std::lock_guard<std::mutex> decodeMe(decodeLock);
+		Frame frame;
+		std::vector<std::pair<int, Frame>> chain;
+		{
+			//Only the frames to decode are copied here. Their bytes are shared, not duplicated.
+			std::lock_guard<std::mutex> lockMe(accessLock);
+			auto target = frames.find(frameIndex);
+			if (target == frames.end())return false;
+			int key = target->second.keyframe;
+			auto begin = frames.find(key);
+			//Continue from the last reconstruction when it lies on the same chain at or before the target.
+			if (cursorFrame >= key && cursorFrame <= frameIndex) {
+				auto cursorIter = frames.find(cursorFrame);
+				if (cursorIter != frames.end() && cursorIter->second.keyframe == key) {
+					begin = ++cursorIter;
+				}
+			}
+			auto end = target;
+			end++;
+			for (auto iter = begin; iter != end; iter++) {
+				chain.push_back(*iter);
+			}
+			frame = target->second;
+		}
+		for (const std::pair<int, Frame>& link : chain) {
+			decode(link.second, link.first == link.second.keyframe, cursor);
+			cursorFrame = link.first;
+		}
+		knowledge.setHeader(*frame.header);
+		cursorWeights.assign(cursor.data(), frame.weightCount, cursorWeights);
+		cursorState.assign(cursor.data() + frame.weightCount, frame.count - frame.weightCount, cursorState);
+		knowledge.getData() = cursorWeights;
+		knowledge.getStateData() = cursorState;
+		return true;
+	}
+	std::shared_ptr<NeuralKnowledge> NeuralHistory::get(int frame) {
+		std::shared_ptr<NeuralKnowledge> knowledge(new NeuralKnowledge());
+		if (!get(frame, *knowledge)) {
+			knowledge.reset();
+		}
+		return knowledge;
+	}
+	size_t NeuralHistory::size() const {
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		return frames.size();
+	}
+	size_t NeuralHistory::getRawBytes() const {
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		return rawBytes;
+	}
+	size_t NeuralHistory::getStoredBytes() const {
+		std::lock_guard<std::mutex> lockMe(accessLock);
+		return storedBytes;
+	}
+}
@@ -2,36 +2,136 @@
 #include "NeuralKnowledge.h"
 #include "AlloyFileUtil.h"
 #include "NeuralSystem.h"
+#include "NeuralModelFile.h"
 #include <cereal/archives/xml.hpp>
 #include <cereal/archives/json.hpp>
 #include <cereal/archives/portable_binary.hpp>
+#include <algorithm>
 using namespace aly;
 namespace tgr {
-	Knowledge& NeuralKnowledge::getWeights(const NeuralLayer& layer) {
-		return weights.at(layer.getId());
+	const KnowledgeLayout& NeuralKnowledge::getLayout(const NeuralLayer& layer) const {
+		auto pos = layout.find(layer.getId());
+		if (pos == layout.end()) {
+			throw std::runtime_error(MakeString() << "No knowledge for layer " << layer.getName() << ".");
+		}
+		return pos->second;
+	}
+	KnowledgeStore::KnowledgeStore(const std::vector<KnowledgeChunkPtr>& chunks, size_t count) :chunks(chunks), count(count) {
+		if (chunks.size() != GetChunkCount(count)) {
+			throw std::runtime_error("Knowledge chunks do not match their size.");
+		}
+	}
+	void KnowledgeStore::assign(const std::vector<KnowledgeChunkPtr>& c, size_t n) {
+		if (c.size() != GetChunkCount(n)) {
+			throw std::runtime_error("Knowledge chunks do not match their size.");
+		}
+		chunks = c;
+		count = n;
+	}
+	void KnowledgeStore::assign(const float* data, size_t n) {
+		chunks.resize(GetChunkCount(n));
+		for (size_t c = 0; c < chunks.size(); c++) {
+			size_t offset = c*CHUNK_SIZE;
+			chunks[c] = std::make_shared<const std::vector<float>>(data + offset, data + std::min(offset + CHUNK_SIZE, n));
+		}
+		count = n;
+	}
+	void KnowledgeStore::assign(const float* data, size_t n, const KnowledgeStore& previous) {
+		if (previous.size() != n) {
+			assign(data, n);
+			return;
+		}
+		chunks.resize(GetChunkCount(n));
+		for (size_t c = 0; c < chunks.size(); c++) {
+			size_t offset = c*CHUNK_SIZE;
+			size_t len = std::min(offset + CHUNK_SIZE, n) - offset;
+			const KnowledgeChunkPtr& prev = previous.getChunk(c);
+			if (std::memcmp(prev->data(), data + offset, len * sizeof(float)) == 0) {
+				chunks[c] = prev;
+			}
+			else {
+				chunks[c] = std::make_shared<const std::vector<float>>(data + offset, data + offset + len);
+			}
+		}
+		count = n;
 	}
-	const Knowledge& NeuralKnowledge::getWeights(const NeuralLayer& layer) const {
-		return weights.at(layer.getId());
+	void KnowledgeStore::copyTo(float* dst, size_t offset, size_t n) const {
+		if (offset + n > count) {
+			throw std::runtime_error("Knowledge range exceeds its store.");
+		}
+		while (n > 0) {
+			size_t c = offset / CHUNK_SIZE;
+			size_t i = offset % CHUNK_SIZE;
+			size_t len = std::min(n, CHUNK_SIZE - i);
+			std::memcpy(dst, chunks[c]->data() + i, len * sizeof(float));
+			dst += len;
+			offset += len;
+			n -= len;
+		}
 	}
-	Knowledge& NeuralKnowledge::getBiasWeights(const NeuralLayer& layer) {
-		return biasWeights.at(layer.getId());
+	std::vector<float> KnowledgeStore::toVector() const {
+		std::vector<float> data(count);
+		if (count > 0)copyTo(data.data());
+		return data;
 	}
-	const Knowledge& NeuralKnowledge::getBiasWeights(const NeuralLayer& layer) const {
-		return biasWeights.at(layer.getId());
+	void NeuralKnowledge::copyTo(NeuralLayer& layer) const {
+		const KnowledgeLayout& l = getLayout(layer);
+		KnowledgeView& w = layer.getWeights();
+		KnowledgeView& bw = layer.getBiasWeights();
+		if (l.weights != w.size() || l.biasWeights != bw.size()) {
+			throw std::runtime_error("Knowledge size does not match layer.");
+		}
+		weights.copyTo(w.ptr(), (size_t)l.offset, w.size());
+		weights.copyTo(bw.ptr(), (size_t)(l.offset + l.weights), bw.size());
+		layer.markDirty();
 	}
-	void NeuralKnowledge::add(const NeuralLayer& layer) {
-		weights[layer.getId()] = layer.getWeights();
-		biasWeights[layer.getId()] = layer.getBiasWeights();
+	void NeuralKnowledge::copyState(const NeuralLayer& layer, int k, float* dst) const {
+		const KnowledgeLayout& l = getLayout(layer);
+		state.copyTo(dst, k*weights.size() + (size_t)l.offset, (size_t)(l.weights + l.biasWeights));
 	}
-	void NeuralKnowledge::set(const NeuralSystem& sys) {
-		weights.clear();
-		for (NeuralLayerPtr layer : sys.getLayers()) {
-			add(*layer);
+	void NeuralKnowledge::set(NeuralSystem& sys) {
+		NeuralArena& arena = sys.getArena();
+		//Dropping the previous snapshot's chunks first lets the arena refill them in place.
+		state.clear();
+		if (sys.isMapped()) {
+			weights.assign(sys.getMappedModel()->getWeights(), arena.getStride(), weights);
+		}
+		else {
+			weights.clear();
+			arena.snapshotWeights(weights);
+		}
+		stateSize = arena.getStateSize();
+		arena.snapshotState(state);
+		NeuralOptimizationPtr opt = sys.getOptimizer();
+		optimizer = (opt.get() != nullptr) ? (int)opt->getType() : -1;
+		step = (opt.get() != nullptr) ? opt->getStep() : 0;
+		//A reused snapshot keeps its layout nodes when the network has not changed.
+		const std::map<int, ArenaBlock>& blocks = arena.getBlocks();
+		bool sameLayers = (layout.size() == blocks.size());
+		auto b = blocks.begin();
+		for (auto a = layout.begin(); sameLayers && a != layout.end(); a++, b++) {
+			sameLayers = (a->first == b->first);
+		}
+		if (!sameLayers)layout.clear();
+		for (const std::pair<const int, ArenaBlock>& pr : blocks) {
+			layout[pr.first] = KnowledgeLayout(pr.second.offset, pr.second.weights, pr.second.biasWeights);
+		}
+		for (const NeuralLayerPtr& l : sys.getLayers()) {
+			auto pos = layout.find(l->getId());
+			if (pos == layout.end())continue;
+			KnowledgeLayout& entry = pos->second;
+			entry.width = (uint32_t)l->width;
+			entry.height = (uint32_t)l->height;
+			entry.bins = (uint32_t)l->bins;
+			entry.neuronType = (l->getNeurons().size() > 0) ? (int32_t)l->getNeurons().front().getFunction().type() : -1;
 		}
 	}
 	void WriteNeuralKnowledgeToFile(const std::string& file, const NeuralKnowledge& params) {
 		std::string ext = GetFileExtension(file);
-		if (ext == "json") {
+		if (ext == "tgrm") {
+			WriteNeuralModelToFile(file, params);
+		}
+		else if (ext == "json") {
 			std::ofstream os(file);
 			cereal::JSONOutputArchive archive(os);
 			archive(cereal::make_nvp("tigernet", params));
@@ -49,7 +149,10 @@ namespace tgr {
 	}
 	void ReadNeuralKnowledgeFromFile(const std::string& file, NeuralKnowledge& params) {
 		std::string ext = GetFileExtension(file);
-		if (ext == "json") {
+		if (ext == "tgrm") {
+			ReadNeuralModelFromFile(file, params);
+		}
+		else if (ext == "json") {
 			std::ifstream os(file);
 			cereal::JSONInputArchive archive(os);
 			archive(cereal::make_nvp("tigernet", params));
@@ -23,6 +23,9 @@
 #include "AlloyDrawUtil.h"
 #include "TigerApp.h"
 #include "NeuralFlowPane.h"
+#include "NeuralProfiler.h"
+#include <algorithm>
+#include <cstring>
 #include <cereal/archives/xml.hpp>
 #include <cereal/archives/json.hpp>
 #include <cereal/archives/portable_binary.hpp>
@@ -72,9 +75,53 @@ namespace tgr {
 			archive(cereal::make_nvp("neuralstate", params));
 		}
 	}
-	void NeuralLayer::set(const Knowledge& k, const Knowledge& bk) {
-		weights = k;
-		biasWeights = bk;
+	void NeuralLayer::set(const KnowledgeView& k, const KnowledgeView& bk) {
+		weights.set(k);
+		biasWeights.set(bk);
+		markDirty();
+	}
+	void NeuralLayer::markDirty() {
+		invalidate();
+		if (sys != nullptr&&sys->getArena().isAllocated()) {
+			const ArenaBlock& block = sys->getArena().getBlock(*this);
+			sys->getArena().markDirty(block.offset, block.size());
+		}
+	}
+	void NeuralLayer::bind(float* weightData, float* changeData) {
+		size_t N = weights.size();
+		size_t B = biasWeights.size();
+		if (signals.size() != N + B) {
+			throw std::runtime_error(MakeString() << "Layer " << name << " must be compiled before binding.");
+		}
+		KnowledgeView(weightData, N).set(weights);
+		KnowledgeView(weightData + N, B).set(biasWeights);
+		KnowledgeView(changeData, N).set(weightChanges);
+		KnowledgeView(changeData + N, B).set(biasWeightChanges);
+		for (size_t n = 0; n < signals.size(); n++) {
+			Signal* sig = signals[n].get();
+			sig->weight = weightData + n;
+			sig->change = changeData + n;
+		}
+		weights = KnowledgeView(weightData, N);
+		weightChanges = KnowledgeView(changeData, N);
+		biasWeights = KnowledgeView(weightData + N, B);
+		biasWeightChanges = KnowledgeView(changeData + N, B);
+		weightStorage = Knowledge();
+		weightChangeStorage = Knowledge();
+		biasWeightStorage = Knowledge();
+		biasWeightChangeStorage = Knowledge();
+	}
+	void NeuralLayer::bindWeights(float* weightData) {
+		size_t N = weights.size();
+		size_t B = biasWeights.size();
+		if (signals.size() != N + B) {
+			throw std::runtime_error(MakeString() << "Layer " << name << " must be compiled before binding.");
+		}
+		for (size_t n = 0; n < signals.size(); n++) {
+			signals[n]->weight = weightData + n;
+		}
+		weights = KnowledgeView(weightData, N);
+		biasWeights = KnowledgeView(weightData + N, B);
 	}
 	void NeuralLayer::setState(const NeuralState& state) {
 		name = state.name;
@@ -86,14 +133,15 @@ namespace tgr {
 		responseChanges.set(state.responseChanges);
 		biasResponses.set(state.biasResponses);
 		biasResponseChanges.set(state.biasResponseChanges);
+		markDirty();
 	}
 	NeuralState NeuralLayer::getState() const {
 		NeuralState state;
 		state.name = name;
-		state.weights = weights;
-		state.weightChanges = weightChanges;
-		state.biasWeights = biasWeights;
-		state.biasWeightChanges = biasWeightChanges;
+		weights.get(state.weights);
+		weightChanges.get(state.weightChanges);
+		biasWeights.get(state.biasWeights);
+		biasWeightChanges.get(state.biasWeightChanges);
 		state.responses = responses;
 		state.responseChanges = responseChanges;
 		state.biasResponses = biasResponses;
@@ -111,7 +159,7 @@ namespace tgr {
 		}
 		*/
 	}
-	NeuralLayer::NeuralLayer(int width, int height, int bins, bool bias, const NeuronFunction& func) :width(width), height(height), bins(bins),bias(bias),compiled(false),id(-1),visited(false),trainable(true),residualError(0.0) {
+	NeuralLayer::NeuralLayer(int width, int height, int bins, bool bias, const NeuronFunction& func) :width(width), height(height), bins(bins),bias(bias),compiled(false),id(-1),visited(false),trainable(true),dirty(true),revision(1),publishedRevision(0),snapshots(new SnapshotBuffer()),residualError(0.0),sys(nullptr) {
 		neurons.resize(width*height*bins, Neuron(func));
 		graph.reset(new GraphData(getName()));
 	}
@@ -119,11 +167,13 @@ namespace tgr {
 		return sys->getFlow();
 	}
 	void NeuralLayer::initializeWeights(float minW, float maxW) {
-		for (SignalPtr sig : signals) {
+		for (const SignalPtr& sig : signals) {
 			*sig->weight=RandomUniform(minW, maxW);
 		}
+		markDirty();
 	}
 	void NeuralLayer::reset() {
+		invalidate();
 		residualError = 0.0;
 		for (Neuron& neuron : neurons) {
 			*neuron.change = 0.0f;
@@ -132,11 +182,10 @@ namespace tgr {
 		for (Neuron& neuron : biasNeurons) {
 			*neuron.change = 0.0f;
 		}
-		for (SignalPtr sig : signals) {
-			*sig->change=0.0f;
-		}
+		weightChanges.setZero();
+		biasWeightChanges.setZero();
 	}
-	NeuralLayer::NeuralLayer(const std::string& name,int width, int height, int bins,bool bias, const NeuronFunction& func) :name(name), width(width), height(height), bins(bins),bias(bias), id(-1), visited(false), trainable(true), residualError(0.0) {
+	NeuralLayer::NeuralLayer(const std::string& name,int width, int height, int bins,bool bias, const NeuronFunction& func) :name(name), width(width), height(height), bins(bins),bias(bias),compiled(false), id(-1), visited(false), trainable(true), dirty(true), revision(1), publishedRevision(0), snapshots(new SnapshotBuffer()), residualError(0.0),sys(nullptr) {
 		neurons.resize(width*height*bins,Neuron(func));
 		graph.reset(new GraphData(getName()));
 	}
@@ -153,21 +202,44 @@ namespace tgr {
 		bins = b;
 	}
 	void NeuralLayer::backpropagate() {
+		TGR_PROFILE_SCOPE_STRING(name, "backpropagate");
 		int N = (int)neurons.size();
 		double residual = 0.0;
+		bool exact = (sys != nullptr && sys->isExactGradient());
 #pragma omp parallel for reduction(+:residual)
 		for (int n = 0; n < N; n++) {
-			residual+=std::abs(neurons[n].backpropagate());
+			residual+=std::abs(neurons[n].backpropagate(exact));
 		}
 		residual /= N;
 		//std::cout << "Backprop [" << getName() << "|" << N << "] Residual="<<residual << std::endl;
 	}
 	void NeuralLayer::setRegionDirty(bool b) {
-		if (layerRegion.get() != nullptr) {
-			layerRegion->setDirty(b);
+		//The region itself is redrawn once the UI picks up the next published snapshot.
+		if (b) {
+			revision++;
+			invalidateChildren();
+		}
+	}
+	void NeuralLayer::invalidate() {
+		revision++;
+		//Roots are never evaluated, so they cannot use the flag to stop the walk. Their children are always invalidated.
+		if (isRoot()) {
+			dirty = false;
+			invalidateChildren();
+			return;
+		}
+		//A stale layer's descendants are already stale, which bounds the walk through shared subgraphs.
+		if (dirty)return;
+		dirty = true;
+		invalidateChildren();
+	}
+	void NeuralLayer::invalidateChildren() {
+		for (const NeuralLayerPtr& child : children) {
+			child->invalidate();
 		}
 	}
 	void NeuralLayer::evaluate() {
+		TGR_PROFILE_SCOPE_STRING(name, "evaluate");
 		int N = (int)neurons.size();
 		double mag = 0.0;
 #pragma omp parallel for reduction(+:mag)
@@ -176,9 +248,79 @@ namespace tgr {
 		}
 		mag /= N;
 		//std::cout << "Evaluate [" << getName() << "|" << N << "] Magnitude=" << mag << std::endl;
-		if (layerRegion.get() != nullptr) {
-			layerRegion->setDirty(true);
+		dirty = false;
+		revision++;
+	}
+	void NeuralLayer::publish(int64_t iteration) {
+		if (publishedRevision == revision || responses.size() == 0) {
+			return;
+		}
+		LayerSnapshot& snap = snapshots->getBack();
+		size_t N = weights.size();
+		size_t B = biasWeights.size();
+		snap.responses.resize(responses.size());
+		std::memcpy(snap.responses.data(), responses.ptr(), responses.size() * sizeof(float));
+		snap.weights.resize(N + B);
+		if (N > 0)std::memcpy(snap.weights.data(), weights.ptr(), N * sizeof(float));
+		if (B > 0)std::memcpy(snap.weights.data() + N, biasWeights.ptr(), B * sizeof(float));
+		snap.iteration = iteration;
+		snap.revision = revision;
+		snapshots->publish();
+		publishedRevision = revision;
+	}
+	LayerFootprint NeuralLayer::getFootprint() const {
+		LayerFootprint fp(name, id);
+		fp.neurons = neurons.size() + biasNeurons.size();
+		fp.signals = signals.size();
+		fp.neuronBytes = (neurons.capacity() + biasNeurons.capacity())*sizeof(Neuron);
+		for (const std::vector<Neuron>* list : { &neurons, &biasNeurons }) {
+			for (const Neuron& n : *list) {
+				fp.neuronBytes += (n.getInput().capacity() + n.getOutput().capacity())*sizeof(SignalPtr);
+			}
+		}
+		fp.signalBytes = signals.size()*GetSignalBytes();
+		for (const SignalPtr& sig : signals) {
+			fp.mappingBytes += (sig->forwardMapping.size() + sig->backwardMapping.size())*GetMappingEntryBytes();
+			for (const auto& pr : sig->forwardMapping) {
+				fp.connections += pr.second.size();
+				fp.mappingBytes += pr.second.capacity()*sizeof(Neuron*);
+			}
+			for (const auto& pr : sig->backwardMapping) {
+				fp.mappingBytes += pr.second.capacity()*sizeof(Neuron*);
+			}
+		}
+		//Local weight storage is only non-empty until the layer is bound to an arena.
+		fp.knowledgeBytes = (responses.size() + responseChanges.size() + biasResponses.size() + biasResponseChanges.size())*sizeof(float);
+		fp.knowledgeBytes += (weightStorage.size() + weightChangeStorage.size() + biasWeightStorage.size() + biasWeightChangeStorage.size())*sizeof(float);
+		if (sys != nullptr && sys->getArena().isAllocated()) {
+			const NeuralArena& arena = sys->getArena();
+			auto pos = arena.getBlocks().find(id);
+			if (pos != arena.getBlocks().end()) {
+				size_t block = pos->second.size();
+				fp.knowledgeBytes += 2 * block*sizeof(float);
+				fp.stateBytes = (size_t)arena.getStateSize()*block*sizeof(float);
+			}
+		}
+		fp.snapshotBytes = snapshots->getCapacityBytes();
+		return fp;
+	}
+	int NeuralLayer::getIndex(const Neuron* n) const {
+		if (neurons.size() == 0 || n < neurons.data() || n >= neurons.data() + neurons.size()) {
+			return -1;
 		}
+		return (int)(n - neurons.data());
+	}
+	int NeuralLayer::getWeightIndex(const Signal* sig) const {
+		const float* w = sig->weight;
+		size_t N = weights.size();
+		size_t B = biasWeights.size();
+		if (N > 0 && w >= weights.ptr() && w < weights.ptr() + N) {
+			return (int)(w - weights.ptr());
+		}
+		if (B > 0 && w >= biasWeights.ptr() && w < biasWeights.ptr() + B) {
+			return (int)(N + (w - biasWeights.ptr()));
+		}
+		return -1;
 	}
 	aly::Vector1f NeuralLayer::toVector() const{
 		int N = (int)neurons.size();
@@ -198,23 +340,26 @@ namespace tgr {
 		if (compiled)return;
 		int idx = 0;
 		signals.clear();
-		std::set<SignalPtr, SignalCompare> tmp;
-		for (Neuron& n : neurons) {
-			for (SignalPtr sig : n.getInput()) {
-				tmp.insert(sig);
-			}
+		//Shared signals are gathered into one array and deduplicated by id, which avoids a tree node per connection.
+		size_t count = 0;
+		for (const Neuron& n : neurons) {
+			count += n.getInputWeightSize();
+		}
+		signals.reserve(count);
+		for (const Neuron& n : neurons) {
+			signals.insert(signals.end(), n.getInput().begin(), n.getInput().end());
+		}
+		std::sort(signals.begin(), signals.end(), SignalCompare());
+		signals.erase(std::unique(signals.begin(), signals.end(), [](const SignalPtr& lhs, const SignalPtr& rhs) {
+			return lhs->id == rhs->id;
+		}), signals.end());
+		size_t N = signals.size();
+		weightStorage.resize(N);
+		weightChangeStorage.resize(N);
+		for (size_t n = 0; n < N; n++) {
+			signals[n]->weight = &weightStorage[n];
+			signals[n]->change = &weightChangeStorage[n];
 		}
-		signals.insert(signals.begin(), tmp.begin(), tmp.end());
-		size_t N = tmp.size();
-		size_t n = 0;
-		weights.resize(N);
-		weightChanges.resize(N);
-		for (SignalPtr sig:tmp) {
-			sig->weight = &weights[n];
-			sig->change = &weightChanges[n];
-			n++;
-		}
-		tmp.clear();
 		N = neurons.size();
 		responses.resize(N);
 		responseChanges.resize(N);
@@ -237,8 +382,8 @@ namespace tgr {
 		if (bias) {
 			int N = width*height;
 			biasNeurons.resize(N, Bias());
-			biasWeights.resize(N);
-			biasWeightChanges.resize(N);
+			biasWeightStorage.resize(N);
+			biasWeightChangeStorage.resize(N);
 			biasResponses.resize(N);
 			biasResponseChanges.resize(N);
 
@@ -254,19 +399,25 @@ namespace tgr {
 			for (size_t n = 0; n < N; n++) {
 				Neuron& neuron = biasNeurons[n];
 				SignalPtr sig = MakeConnection(&neuron, &neurons[n]);
-				sig->weight = &biasWeights[n];
-				sig->change = &biasWeightChanges[n];
+				sig->weight = &biasWeightStorage[n];
+				sig->change = &biasWeightChangeStorage[n];
 				neuron.value = &biasResponses[n];
 				neuron.change = &biasResponseChanges[n];
 				*neuron.value = 1.0f;
 				signals.push_back(sig);
 			}
 		}
+		weights = KnowledgeView(weightStorage);
+		weightChanges = KnowledgeView(weightChangeStorage);
+		biasWeights = KnowledgeView(biasWeightStorage);
+		biasWeightChanges = KnowledgeView(biasWeightChangeStorage);
 		compiled = true;
 	}
 	bool NeuralLayer::optimize() {
-		if (optimizer.get() != nullptr) {
-			return optimizer->optimize(id,signals);
+		if (optimizer.get() != nullptr&&sys != nullptr&&sys->getArena().isAllocated()) {
+			bool ret = optimizer->optimize(sys->getArena().getRange(*this));
+			markDirty();
+			return ret;
 		}
 		else {
 			//std::cerr << "No optimizer for " << getName() << std::endl;
@@ -281,6 +432,7 @@ namespace tgr {
 		for (Neuron& n : neurons) {
 			n.setFunction(func);
 		}
+		invalidate();
 	}
 	int NeuralLayer::getBin(size_t index) const {
 		return clamp((int)std::floor(*neurons[index].value*bins), 0, bins-1);
@@ -333,7 +485,7 @@ namespace tgr {
 		return neurons[aly::clamp(ij.x, 0, width - 1) + aly::clamp(ij.y, 0, height - 1) * width];
 	}
 	bool NeuralLayer::visitedChildren() const {
-		for (NeuralLayerPtr layer : children) {
+		for (const NeuralLayerPtr& layer : children) {
 			if (!layer->isVisited())return false;
 		}
 		return true;
@@ -357,11 +509,9 @@ namespace tgr {
 			
 			float2 dims=float2(240.0f,240.0f/ getAspect())+ NeuralLayerRegion::getPadding();
 			layerRegion = NeuralLayerRegionPtr(new NeuralLayerRegion(name,this, CoordPerPX(0.5f, 0.5f, -dims.x*0.5f, -dims.y*0.5f), CoordPX(dims.x, dims.y)));
+			//Children get their regions when they are expanded into view.
 			if (hasChildren()) {
 				layerRegion->setExpandable(true);
-				for (auto child : getChildren()) {
-					child->getRegion();
-				}
 			}
 			layerRegion->onHide = [this]() {
 				sys->getFlow()->update();
@@ -392,22 +542,27 @@ namespace tgr {
 		flowPane->update();
 	}
 	void NeuralLayer::set(const Image1f& input) {
+		if (input.width == width&&input.height == height) {
+			set((const float*)input.ptr(), input.size());
+			return;
+		}
 		for (int j = 0; j < input.height; j++) {
 			for (int i = 0; i < input.width; i++) {
 				*get(i, j)->value = input(i, j).x;
 			}
 		}
-		if (layerRegion.get() != nullptr) {
-			layerRegion->setDirty(true);
-		}
+		setRegionDirty(true);
 	}
 	void NeuralLayer::set(const std::vector<float>& input) {
-		for (size_t i = 0; i < input.size(); i++) {
-			*get(i)->value = input[i];
-		}
-		if (layerRegion.get() != nullptr) {
-			layerRegion->setDirty(true);
+		set(input.data(), input.size());
+	}
+	void NeuralLayer::set(const float* input, size_t N) {
+		//Neuron values alias the responses buffer, so a staged sample is a single copy.
+		N = std::min(N, responses.size());
+		if (N > 0) {
+			std::memcpy(responses.ptr(), input, N * sizeof(float));
 		}
+		setRegionDirty(true);
 	}
 	void NeuralLayer::get( Image1f& input) {
 		input.resize(width, height);
@@ -26,64 +26,192 @@
 using namespace tgr;
 namespace aly {
 	const float NeuralLayerRegion::fontSize = 24.0f;
+	//Only touched from the UI thread, before or after the parallel rasterization pass.
+	static std::vector<std::shared_ptr<ImageRGBA>>& GetImagePool() {
+		static std::vector<std::shared_ptr<ImageRGBA>> pool;
+		return pool;
+	}
 	box2px NeuralLayerRegion::getObstacleBounds() const {
 		box2px box = getBounds(false);
 		box.position.y += 26.0f;
 		box.dimensions.y -= 26.0 + 30.0f;
 		return box;
 	}
-	void NeuralLayerRegion::drawCache(AlloyContext* context) {
-		if (!cacheDirty)return;
-		box2px bounds = box2px(pixel2(0, 0), pixel2(float(cacheImage.width), float(cacheImage.height)));
-		NVGcontext* nvg = context->nvgContext;
-		renderBuffer.begin(RGBAf(0.0f));
-		nvgBeginFrame(nvg, cacheImage.width, cacheImage.height, 1.0f);
-		int width = layer->width;
-		int height = layer->height;
-		float scale = bounds.dimensions.x / width;
-		nvgBeginPath(nvg);
-		nvgRect(nvg, bounds.position.x, bounds.position.y, bounds.dimensions.x, bounds.dimensions.y);
-		nvgFillColor(nvg, context->theme.DARKER);
-		nvgFill(nvg);
-		float rOuter = 0.5f*scale;
-		float rInner = 0.25f*scale;
-		float lineWidth = scale*0.01f;
-		for (int j = 0; j < height; j++) {
-			for (int i = 0; i < width; i++) {
-				float2 center = float2(bounds.position.x + (i + 0.5f)*scale, bounds.position.y + (j + 0.5f)*scale);
-				nvgFillColor(nvg, Color(92, 92, 92));
-				nvgBeginPath(nvg);
-				nvgCircle(nvg, center.x, center.y, scale*0.5f);
-				nvgFill(nvg);
-				Neuron& n = (*layer)(i, j);
-
-				nvgStrokeColor(nvg, Color(220, 220, 220));
-				nvgStrokeWidth(nvg, lineWidth);
-				nvgFillColor(nvg, Color(ColorMapToRGB(n.normalizedValue(), ColorMap::RedToBlue)));
-				nvgBeginPath(nvg);
-				nvgCircle(nvg, center.x, center.y, rInner);
-				nvgFill(nvg);
-				nvgStroke(nvg);
+	box2px NeuralLayerRegion::getContentBounds() const {
+		box2px bounds = getBounds();
+		bounds.position += float2(0.0f, fontSize + 8.0f);
+		bounds.dimensions -= getPadding();
+		return bounds;
+	}
+	void NeuralLayerRegion::updateDetail() {
+		box2px bounds = getContentBounds();
+		int W = layer->width;
+		int H = layer->height;
+		float cellPx = bounds.dimensions.x / std::max(W, 1);
+		//Cells are rasterized at the next power of two up from their on-screen size. Below a pixel, neurons are averaged into tiles instead.
+		int cell = 1;
+		int tile = 1;
+		if (cellPx >= 1.0f) {
+			while (cell < GLYPH_SIZE && cell < cellPx) {
+				cell *= 2;
+			}
+		}
+		else if (cellPx > 0.0f) {
+			while (tile*cellPx < 1.0f) {
+				tile *= 2;
 			}
 		}
-		nvgEndFrame(nvg);
-		renderBuffer.end();
-		ImageRGBAf img = renderBuffer.getTexture().read();
-		FlipVertical(img);
-		ConvertImage(img, cacheImage);
-		cacheGlyph.reset(new ImageGlyph(cacheImage, AlloyApplicationContext().get(), true));
+		int2 start(0, 0);
+		int2 end(0, 0);
+		box2px clip = (parent != nullptr) ? parent->getCursorBounds() : bounds;
+		float x0 = std::max(bounds.position.x, clip.position.x);
+		float y0 = std::max(bounds.position.y, clip.position.y);
+		float x1 = std::min(bounds.position.x + bounds.dimensions.x, clip.position.x + clip.dimensions.x);
+		float y1 = std::min(bounds.position.y + bounds.dimensions.y, clip.position.y + clip.dimensions.y);
+		if (x1 > x0 && y1 > y0 && cellPx > 0.0f) {
+			int block = tile*WINDOW_BLOCK;
+			start.x = std::max(0, (int)std::floor((x0 - bounds.position.x) / (cellPx*block))*block);
+			start.y = std::max(0, (int)std::floor((y0 - bounds.position.y) / (cellPx*block))*block);
+			end.x = std::min(W, (int)std::ceil((x1 - bounds.position.x) / (cellPx*block))*block);
+			end.y = std::min(H, (int)std::ceil((y1 - bounds.position.y) / (cellPx*block))*block);
+		}
+		if (start != windowStart || end != windowEnd || tile != cacheTile || cell != cacheCell) {
+			windowStart = start;
+			windowEnd = end;
+			cacheTile = tile;
+			cacheCell = cell;
+			cacheDirty = true;
+		}
+		if (end.x <= start.x || end.y <= start.y) {
+			//Scrolled out of view.
+			release();
+		}
+		else if (cacheImage.get() == nullptr) {
+			std::vector<std::shared_ptr<ImageRGBA>>& pool = GetImagePool();
+			if (pool.size() > 0) {
+				cacheImage = pool.back();
+				pool.pop_back();
+			}
+			else {
+				cacheImage.reset(new ImageRGBA());
+			}
+			cacheDirty = true;
+		}
+	}
+	void NeuralLayerRegion::release() {
+		if (cacheImage.get() != nullptr) {
+			std::vector<std::shared_ptr<ImageRGBA>>& pool = GetImagePool();
+			if ((int)pool.size() < MAX_POOLED_IMAGES) {
+				pool.push_back(cacheImage);
+			}
+			cacheImage.reset();
+		}
+		cacheGlyph.reset();
+		glyphStart = int2(0, 0);
+		glyphEnd = int2(0, 0);
+		windowStart = int2(0, 0);
+		windowEnd = int2(0, 0);
+		cacheReady = false;
+		cacheDirty = true;
+	}
+	void NeuralLayerRegion::rasterize() {
+		if (!cacheDirty || cacheImage.get() == nullptr)return;
+		//Cleared first so a snapshot picked up during rasterization marks the cache dirty again.
 		cacheDirty = false;
+		int level = 0;
+		while ((1 << level) < cacheCell && level + 1 < (int)heatmaps.size()) {
+			level++;
+		}
+		cacheReady = heatmaps[level]->rasterize(*layer, layer->getSnapshots()->getFront().responses, windowStart, windowEnd, cacheTile, *cacheImage);
+	}
+	NeuralLayerRegion::HoverInput NeuralLayerRegion::resolve(const tgr::Neuron* n) const {
+		HoverInput in = { nullptr, -1, n };
+		int idx = layer->getIndex(n);
+		if (idx >= 0) {
+			in.layer = layer;
+			in.index = idx;
+			return in;
+		}
+		for (const NeuralLayer* dep : layer->getDependencies()) {
+			idx = dep->getIndex(n);
+			if (idx >= 0) {
+				in.layer = dep;
+				in.index = idx;
+				return in;
+			}
+		}
+		return in;
+	}
+	float NeuralLayerRegion::getPublishedValue(const HoverInput& in) const {
+		if (in.layer == nullptr) {
+			//Bias neurons are not published. Their response is constant, so reading it directly is safe.
+			return in.neuron->normalizedValue();
+		}
+		const LayerSnapshot& snap = in.layer->getSnapshots()->getFront();
+		return (in.index < (int)snap.responses.size()) ? in.neuron->normalizedValue(snap.responses[in.index]) : 0.0f;
+	}
+	void NeuralLayerRegion::updateHover(int2 selected) {
+		hoverNeurons.clear();
+		hoverRadius = selectionRadius;
+		if (selected.x == -1) {
+			return;
+		}
+		for (int j = std::max(0, selected.y - selectionRadius); j <= std::min(layer->height - 1, selected.y + selectionRadius); j++) {
+			for (int i = std::max(0, selected.x - selectionRadius); i <= std::min(layer->width - 1, selected.x + selectionRadius); i++) {
+				Neuron& n = (*layer)(i, j);
+				HoverNeuron hover;
+				hover.position = int2(i, j);
+				int N = (int)n.getInputWeightSize();
+				hover.signals.resize(N);
+				for (int k = 0; k < N; k++) {
+					SignalPtr& sig = n.getInput(k);
+					HoverSignal& hs = hover.signals[k];
+					hs.weightIndex = layer->getWeightIndex(sig.get());
+					hs.mappings = (int)sig->forwardMapping.size();
+					if (hs.mappings > 0) {
+						for (Neuron* ne : sig->getForward(&n)) {
+							hs.inputs.push_back(resolve(ne));
+						}
+					}
+				}
+				hoverNeurons.push_back(hover);
+			}
+		}
+	}
+	void NeuralLayerRegion::upload(AlloyContext* context) {
+		if (!cacheReady)return;
+		//Cells are picked per power of two of the zoom, so the glyph is never minified by 2x or more and needs no mipmaps. Without them the texture can be updated in place.
+		if (cacheGlyph.get() != nullptr && cacheGlyph->width == cacheImage->width && cacheGlyph->height == cacheImage->height) {
+			nvgUpdateImage(context->nvgContext, cacheGlyph->handle, (const unsigned char*)cacheImage->ptr());
+		}
+		else {
+			cacheGlyph.reset(new ImageGlyph(*cacheImage, context, false));
+		}
+		glyphStart = windowStart;
+		glyphEnd = windowEnd;
+		cacheReady = false;
 	}
 	NeuralLayerRegion::NeuralLayerRegion(const std::string& name, tgr::NeuralLayer* layer,
 		const AUnit2D& pos, const AUnit2D& dims, bool resizeable) :
 		Composite(name, pos, dims), layer(layer), scale(1.0f) {
 		selectionRadius = 2;
+		hoverRadius = selectionRadius;
 		cacheDirty = true;
-		const int GLYPH_SIZE = 32;
-		cacheImage.resize(layer->width * GLYPH_SIZE, layer->height * GLYPH_SIZE);
-		cacheImage.set(RGBA(0,0,0,0));
-		renderBuffer.initialize(cacheImage.width, cacheImage.height);
-		cacheGlyph = ImageGlyphPtr(new ImageGlyph(cacheImage, AlloyApplicationContext().get(), false));
+		cacheReady = false;
+		windowStart = int2(0, 0);
+		windowEnd = int2(0, 0);
+		glyphStart = int2(0, 0);
+		glyphEnd = int2(0, 0);
+		cacheTile = 0;
+		cacheCell = 0;
+		//Every region draws the same glyphs, so the stamps are built once.
+		static std::vector<NeuralHeatmapPtr> sharedHeatmaps;
+		if (sharedHeatmaps.size() == 0) {
+			for (int cell = 1; cell <= GLYPH_SIZE; cell *= 2) {
+				sharedHeatmaps.push_back((cell < MIN_GLYPH_SIZE) ? NeuralHeatmapPtr(new NeuralHeatmap(cell)) : NeuralHeatmapPtr(new NeuralHeatmap(cell, AlloyApplicationContext()->theme.DARKER)));
+			}
+		}
+		heatmaps = sharedHeatmaps;
 		cellPadding = pixel2(10, 10);
 		if (resizeable) {
 			Application::addListener(this);
@@ -101,6 +229,7 @@ namespace aly {
 		cancelButton->borderWidth = UnitPX(0.0f);
 		cancelButton->onMouseDown = [this](AlloyContext* context, const InputEvent& event) {
 			this->setVisible(false);
+			release();
 			if (onHide) {
 				onHide();
 			}
@@ -174,17 +303,23 @@ namespace aly {
 			selected = int2((int)std::floor(width*pos.x), (int)std::floor(height*pos.y));
 			
 		}
+		//NeuralFlowPane normally rasterizes all dirty regions in parallel before they are drawn.
+		updateDetail();
 		if (cacheDirty) {
-			context->addDeferredTask([this]() {
-				drawCache(AlloyApplicationContext().get());
-			});
+			rasterize();
+		}
+		upload(context);
+		if (cacheGlyph.get() != nullptr && glyphEnd.x > glyphStart.x && glyphEnd.y > glyphStart.y) {
+			box2px glyphBounds(
+				bounds.position + float2(glyphStart.x*scale, glyphStart.y*scale),
+				float2((glyphEnd.x - glyphStart.x)*scale, (glyphEnd.y - glyphStart.y)*scale));
+			cacheGlyph->draw(glyphBounds, COLOR_NONE, COLOR_NONE, context);
 		}
-		cacheGlyph->draw(bounds, COLOR_NONE, COLOR_NONE, context);
 		float rOuter = 0.5f*scale;
 		float rInner = 0.25f*scale;
 		float lineWidth = scale*0.01f;
 		nvgStrokeWidth(nvg, lineWidth);
-
+		const LayerSnapshot& snap = layer->getSnapshots()->getFront();
 
 		if (lastSelected != selected) {
 			for (Neuron* neuron : activeList) {
@@ -203,70 +338,82 @@ namespace aly {
 			if (selected.x != -1&& layer->getFlow()!=nullptr) {
 				layer->getFlow()->setSelected(layer);
 			}
+			updateHover(selected);
 		}
-		for (int j = 0; j < height; j++) {
-			for (int i = 0; i < width; i++) {
-				float2 center = float2(bounds.position.x + (i + 0.5f)*scale, bounds.position.y + (j + 0.5f)*scale);
-				Neuron& n = (*layer)(i, j);
-				if (lineWidth > 0.1f&&selected.x != -1 && std::abs(i - selected.x) <= selectionRadius&&std::abs(j - selected.y) <= selectionRadius) {
-					int N = (int)n.getInputWeightSize();
-					nvgLineCap(nvg, NVG_SQUARE);
-					for (int i = 0; i < N; i++) {
-						SignalPtr& sig = n.getInput(i);
-						float a = 2.0f*i*NVG_PI / N - 0.5f*NVG_PI;
-						float cosa = std::cos(a);
-						float sina = std::sin(a);
-						float sx = center.x + rInner*cosa;
-						float sy = center.y + rInner*sina;
-						float tw =mix(rInner+lineWidth,rOuter-2*lineWidth, clamp(0.5f+0.5f*(*sig->weight),0.0f,1.0f));
-						float wx = center.x + tw*cosa;
-						float wy = center.y + tw*sina;
-						float ex = center.x + (rOuter - 2 * lineWidth)*cosa;
-						float ey = center.y + (rOuter - 2 * lineWidth)*sina;
-						nvgStrokeColor(nvg, Color(128, 128, 128));
-						nvgStrokeWidth(nvg, lineWidth);
-						nvgBeginPath(nvg);
-						nvgMoveTo(nvg, sx,sy);
-						nvgLineTo(nvg, ex, ey);
-						nvgStroke(nvg);
-
-						float valSum = 0.0f;
-						int sz=(int)sig->forwardMapping.size();	
-						if (sz > 0) {
-							for (Neuron* ne : sig->getForward(&n)) {
-								valSum += ne->normalizedValue();
-							}
-							nvgStrokeColor(nvg, Color(ColorMapToRGB(clamp(valSum/sz,0.0f,1.0f), ColorMap::RedToBlue)));
-						} else {
-							nvgStrokeColor(nvg, Color(200,200,200));
-						}
-						nvgBeginPath(nvg);
-						nvgMoveTo(nvg, sx + lineWidth*cosa, sy + lineWidth*sina);
-						nvgLineTo(nvg, wx, wy);
-						nvgStrokeWidth(nvg, 3 * lineWidth);
-						nvgStroke(nvg);
-
-					}
-
-					nvgStrokeWidth(nvg, 2.0f* lineWidth);
-					nvgStrokeColor(nvg, Color(200, 200, 200));
+		else if (hoverRadius != selectionRadius) {
+			updateHover(selected);
+		}
+		if (lineWidth > 0.1f) {
+			for (const HoverNeuron& hover : hoverNeurons) {
+				float2 center = float2(bounds.position.x + (hover.position.x + 0.5f)*scale, bounds.position.y + (hover.position.y + 0.5f)*scale);
+				int N = (int)hover.signals.size();
+				nvgLineCap(nvg, NVG_SQUARE);
+				for (int i = 0; i < N; i++) {
+					const HoverSignal& sig = hover.signals[i];
+					float a = 2.0f*i*NVG_PI / N - 0.5f*NVG_PI;
+					float cosa = std::cos(a);
+					float sina = std::sin(a);
+					float sx = center.x + rInner*cosa;
+					float sy = center.y + rInner*sina;
+					float w = (sig.weightIndex >= 0 && sig.weightIndex < (int)snap.weights.size()) ? snap.weights[sig.weightIndex] : 0.0f;
+					float tw =mix(rInner+lineWidth,rOuter-2*lineWidth, clamp(0.5f+0.5f*w,0.0f,1.0f));
+					float wx = center.x + tw*cosa;
+					float wy = center.y + tw*sina;
+					float ex = center.x + (rOuter - 2 * lineWidth)*cosa;
+					float ey = center.y + (rOuter - 2 * lineWidth)*sina;
+					nvgStrokeColor(nvg, Color(128, 128, 128));
+					nvgStrokeWidth(nvg, lineWidth);
 					nvgBeginPath(nvg);
-					nvgCircle(nvg, center.x, center.y, rOuter - lineWidth);
+					nvgMoveTo(nvg, sx,sy);
+					nvgLineTo(nvg, ex, ey);
 					nvgStroke(nvg);
 
+					float valSum = 0.0f;
+					if (sig.mappings > 0) {
+						for (const HoverInput& in : sig.inputs) {
+							valSum += getPublishedValue(in);
+						}
+						nvgStrokeColor(nvg, Color(ColorMapToRGB(clamp(valSum/sig.mappings,0.0f,1.0f), ColorMap::RedToBlue)));
+					} else {
+						nvgStrokeColor(nvg, Color(200,200,200));
+					}
 					nvgBeginPath(nvg);
-					nvgCircle(nvg, center.x, center.y, rInner - lineWidth);
+					nvgMoveTo(nvg, sx + lineWidth*cosa, sy + lineWidth*sina);
+					nvgLineTo(nvg, wx, wy);
+					nvgStrokeWidth(nvg, 3 * lineWidth);
 					nvgStroke(nvg);
 				}
-				if (n.active||(selected.x==i&&selected.y==j)) {
-					nvgStrokeWidth(nvg, 2.0f);
-					nvgStrokeColor(nvg, Color(200, 200, 200));
-					nvgBeginPath(nvg);
-					nvgCircle(nvg, center.x, center.y, rOuter);
-					nvgStroke(nvg);
+
+				nvgStrokeWidth(nvg, 2.0f* lineWidth);
+				nvgStrokeColor(nvg, Color(200, 200, 200));
+				nvgBeginPath(nvg);
+				nvgCircle(nvg, center.x, center.y, rOuter - lineWidth);
+				nvgStroke(nvg);
+
+				nvgBeginPath(nvg);
+				nvgCircle(nvg, center.x, center.y, rInner - lineWidth);
+				nvgStroke(nvg);
+			}
+		}
+		//Outlines for neurons feeding the selection. Only neurons inside the raster window are visited, and only when they are large enough to see.
+		nvgStrokeWidth(nvg, 2.0f);
+		nvgStrokeColor(nvg, Color(200, 200, 200));
+		if (scale >= MIN_DETAIL_SIZE) {
+			for (int j = windowStart.y; j < windowEnd.y; j++) {
+				for (int i = windowStart.x; i < windowEnd.x; i++) {
+					if ((*layer)(i, j).active) {
+						nvgBeginPath(nvg);
+						nvgCircle(nvg, bounds.position.x + (i + 0.5f)*scale, bounds.position.y + (j + 0.5f)*scale, rOuter);
+						nvgStroke(nvg);
+					}
 				}
 			}
 		}
+		if (selected.x != -1) {
+			nvgBeginPath(nvg);
+			nvgCircle(nvg, bounds.position.x + (selected.x + 0.5f)*scale, bounds.position.y + (selected.y + 0.5f)*scale, rOuter);
+			nvgStroke(nvg);
+		}
 
 		popScissor(context->nvgContext);
 		
@@ -0,0 +1,157 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralModelFile.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+namespace tgr {
+	static const char MODEL_MAGIC[4] = { 'T', 'G', 'R', 'M' };
+	//Version 2 added the layer shape and neuron type to the table.
+	static const uint32_t MODEL_VERSION = 2;
+	static uint64_t AlignModel(uint64_t offset) {
+		return (offset + 63) & ~(uint64_t)63;
+	}
+	static uint32_t Checksum(const float* data, uint64_t count) {
+		uLong crc = crc32(0L, Z_NULL, 0);
+		const Bytef* bytes = (const Bytef*)data;
+		uint64_t length = count * sizeof(float);
+		//zlib takes 32 bit lengths.
+		while (length > 0) {
+			uInt chunk = (uInt)std::min(length, (uint64_t)(1u << 30));
+			crc = crc32(crc, bytes, chunk);
+			bytes += chunk;
+			length -= chunk;
+		}
+		return (uint32_t)crc;
+	}
+	static void WritePadding(std::ofstream& out, uint64_t offset) {
+		static const char zeros[64] = { 0 };
+		uint64_t pos = (uint64_t)out.tellp();
+		if (offset > pos)out.write(zeros, (std::streamsize)(offset - pos));
+	}
+	void WriteNeuralModelToFile(const std::string& file, const NeuralKnowledge& knowledge) {
+		const std::map<int, KnowledgeLayout>& layouts = knowledge.getLayouts();
+		std::vector<float> weights = knowledge.getData().toVector();
+		std::vector<float> state = knowledge.getStateData().toVector();
+		ModelHeader header;
+		std::memset(&header, 0, sizeof(ModelHeader));
+		std::memcpy(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+		header.version = MODEL_VERSION;
+		header.layerCount = (uint32_t)layouts.size();
+		header.optimizer = knowledge.getOptimizer();
+		header.stateSize = (uint32_t)knowledge.getStateSize();
+		header.step = knowledge.getStep();
+		header.stride = weights.size();
+		header.tableOffset = sizeof(ModelHeader);
+		header.dataOffset = AlignModel(header.tableOffset + header.layerCount * sizeof(ModelLayerEntry));
+		header.stateOffset = AlignModel(header.dataOffset + header.stride * sizeof(float));
+		std::vector<ModelLayerEntry> table;
+		for (const std::pair<const int, KnowledgeLayout>& pr : layouts) {
+			const KnowledgeLayout& layout = pr.second;
+			if (layout.offset + layout.weights + layout.biasWeights > weights.size()) {
+				throw std::runtime_error("Knowledge layout exceeds its weights.");
+			}
+			ModelLayerEntry entry;
+			std::memset(&entry, 0, sizeof(ModelLayerEntry));
+			entry.id = pr.first;
+			entry.dataType = (uint32_t)ModelDataType::Float32;
+			entry.weights = layout.weights;
+			entry.biasWeights = layout.biasWeights;
+			entry.arenaOffset = layout.offset;
+			entry.offset = header.dataOffset + layout.offset * sizeof(float);
+			entry.checksum = Checksum(weights.data() + layout.offset, layout.weights + layout.biasWeights);
+			entry.width = layout.width;
+			entry.height = layout.height;
+			entry.bins = layout.bins;
+			entry.neuronType = layout.neuronType;
+			table.push_back(entry);
+		}
+		std::ofstream out(file, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) {
+			throw std::runtime_error("Could not create model file " + file);
+		}
+		out.write((const char*)&header, sizeof(ModelHeader));
+		out.write((const char*)table.data(), table.size() * sizeof(ModelLayerEntry));
+		WritePadding(out, header.dataOffset);
+		out.write((const char*)weights.data(), weights.size() * sizeof(float));
+		WritePadding(out, header.stateOffset);
+		out.write((const char*)state.data(), state.size() * sizeof(float));
+		if (out.fail()) {
+			throw std::runtime_error("Could not write model file " + file);
+		}
+	}
+	NeuralModelFile::NeuralModelFile(const std::string& name, bool verifyLayers) :fileName(name), header(nullptr), table(nullptr) {
+		file.open(name);
+		header = (const ModelHeader*)file.ptr();
+		if (file.size() < sizeof(ModelHeader) || std::memcmp(header->magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0) {
+			throw std::runtime_error("Not a model file:" + name);
+		}
+		if (header->version < 1 || header->version > MODEL_VERSION) {
+			throw std::runtime_error("Unsupported model file version " + std::to_string(header->version) + ":" + name);
+		}
+		if (header->tableOffset + header->layerCount * sizeof(ModelLayerEntry) > file.size() || header->dataOffset % 64 != 0
+			|| header->dataOffset + header->stride * sizeof(float) > file.size() || header->stateOffset + header->stateSize*header->stride * sizeof(float) > file.size()) {
+			throw std::runtime_error("Model file is truncated:" + name);
+		}
+		table = (const ModelLayerEntry*)(file.ptr() + header->tableOffset);
+		for (int i = 0; i < getLayerCount(); i++) {
+			const ModelLayerEntry& entry = table[i];
+			if (entry.dataType != (uint32_t)ModelDataType::Float32 || entry.arenaOffset + entry.weights + entry.biasWeights > header->stride) {
+				throw std::runtime_error("Model layer " + std::to_string(entry.id) + " is malformed:" + name);
+			}
+			if (verifyLayers && !verify(entry)) {
+				throw std::runtime_error("Model layer " + std::to_string(entry.id) + " failed its checksum:" + name);
+			}
+		}
+	}
+	const ModelLayerEntry* NeuralModelFile::findLayer(int id) const {
+		for (int i = 0; i < getLayerCount(); i++) {
+			if (table[i].id == id)return &table[i];
+		}
+		return nullptr;
+	}
+	bool NeuralModelFile::verify(const ModelLayerEntry& entry) const {
+		return (Checksum(getWeights() + entry.arenaOffset, entry.weights + entry.biasWeights) == entry.checksum);
+	}
+	void ReadNeuralModelFromFile(const std::string& file, NeuralKnowledge& knowledge, bool verify) {
+		NeuralModelFile model(file, verify);
+		const ModelHeader& header = model.getHeader();
+		std::map<int, KnowledgeLayout>& layouts = knowledge.getLayouts();
+		layouts.clear();
+		for (int i = 0; i < model.getLayerCount(); i++) {
+			const ModelLayerEntry& entry = model.getLayer(i);
+			KnowledgeLayout& layout = layouts[entry.id] = KnowledgeLayout(entry.arenaOffset, entry.weights, entry.biasWeights);
+			if (header.version >= 2) {
+				layout.width = entry.width;
+				layout.height = entry.height;
+				layout.bins = entry.bins;
+				layout.neuronType = entry.neuronType;
+			}
+		}
+		knowledge.getData().assign(model.getWeights(), header.stride);
+		knowledge.getStateData().assign(model.getState(0), header.stride*header.stateSize);
+		knowledge.setOptimizerState(header.optimizer, (int)header.stateSize, header.step);
+		knowledge.setFile(file);
+	}
+}
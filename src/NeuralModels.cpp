@@ -0,0 +1,121 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralModels.h"
+#include "NeuralFilter.h"
+#include "ConvolutionFilter.h"
+#include "AveragePoolFilter.h"
+#include "FullyConnectedFilter.h"
+using namespace aly;
+namespace tgr {
+#define O true
+#define X false
+	static const bool MNIST_TABLE[] = {
+		O, X, X, X, O, O, O, X, X, O, O, O, O, X, O, O,
+		O, O, X, X, X, O, O, O, X, X, O, O, O, O, X, O,
+		O, O, O, X, X, X, O, O, O, X, X, O, X, O, O, O,
+		X, O, O, O, X, X, O, O, O, O, X, X, O, X, O, O,
+		X, X, O, O, O, X, X, O, O, O, O, X, O, O, X, O,
+		X, X, X, O, O, O, X, X, O, O, O, O, X, O, O, O
+	};
+#undef O
+#undef X
+	void MakeXOR(NeuralSystem& sys) {
+		FullyConnectedFilterPtr firstFilter(new FullyConnectedFilter("First Layer", 2, 2, 2, 2, true));
+		sys.add(firstFilter);
+		FullyConnectedFilterPtr secondFilter(new FullyConnectedFilter("Second Layer", firstFilter->getOutputLayer(0), 2, 2, true));
+		sys.add(secondFilter);
+		FullyConnectedFilterPtr thirdFilter(new FullyConnectedFilter("Output Layer", secondFilter->getOutputLayer(0), 1, 1, true));
+		sys.add(thirdFilter);
+		thirdFilter->getOutputLayer(0)->setFunction(tgr::Linear());
+		sys.setInput(firstFilter->getInputLayer(0));
+		sys.setOutput(thirdFilter->getOutputLayer(0));
+	}
+	void MakeWaves(NeuralSystem& sys, int width, int height, int directions) {
+		ConvolutionFilterPtr firstFilter(new ConvolutionFilter(width, height, 5, 2, true));
+		sys.add(firstFilter);
+		FullyConnectedFilterPtr secondFilter(new FullyConnectedFilter("Output Layer", firstFilter->getOutputLayers(), directions, 1, true));
+		sys.add(secondFilter);
+		secondFilter->getOutputLayer(0)->setFunction(tgr::Linear());
+		sys.setInput(firstFilter->getInputLayer(0));
+		sys.setOutput(secondFilter->getOutputLayer(0));
+	}
+	void MakeLeNet5(NeuralSystem& sys, int width, int height) {
+		ConvolutionFilterPtr conv1(new ConvolutionFilter(width, height, 5, 6, false));
+		conv1->setName("conv1");
+		sys.add(conv1, Tanh());
+		std::vector<NeuralLayerPtr> all;
+		for (int i = 0; i < conv1->getOutputSize(); i++) {
+			AveragePoolFilterPtr avg1(new AveragePoolFilter(conv1->getOutputLayer(i), 2, true));
+			avg1->setName(MakeString() << "Sub-Sample [" << i << "]");
+			sys.add(avg1, Tanh());
+			all.push_back(avg1->getOutputLayer(0));
+		}
+		ConvolutionFilterPtr conv2(new ConvolutionFilter(all, 5, 16, true));
+		conv2->setName("conv2");
+		std::vector<std::pair<int, int>> connectionTable;
+		for (int ii = 0; ii < 6; ii++) {
+			for (int jj = 0; jj < 16; jj++) {
+				if (MNIST_TABLE[jj + ii * 16]) {
+					connectionTable.push_back(std::pair<int, int>(ii, jj));
+				}
+			}
+		}
+		conv2->setConnectionMap(connectionTable);
+		sys.add(conv2, Tanh());
+		all.clear();
+		for (int i = 0; i < conv2->getOutputSize(); i++) {
+			AveragePoolFilterPtr avg2(new AveragePoolFilter(conv2->getOutputLayer(i), 2, true));
+			avg2->setName(MakeString() << "Sub-Sample [" << i << "]");
+			sys.add(avg2);
+			ConvolutionFilterPtr conv3(new ConvolutionFilter(avg2->getOutputLayer(0), 5, 1, true));
+			conv3->setName("conv3");
+			sys.add(conv3);
+			all.push_back(conv3->getOutputLayer(0));
+		}
+		FullyConnectedFilterPtr decisionFilter(new FullyConnectedFilter("Decision Layer", all, 10, 1, true));
+		sys.add(decisionFilter);
+		sys.setInput(conv1->getInputLayer(0));
+		sys.setOutput(decisionFilter->getOutputLayer(0));
+	}
+	void EstimateLeNet5(FootprintEstimator& estimator, int width, int height) {
+		int input = estimator.addInput("Input Layer", width, height);
+		std::vector<int> conv1 = estimator.addConvolution("conv1", std::vector<int>(1, input), 5, 6, false);
+		std::vector<int> all;
+		for (int i = 0; i < (int)conv1.size(); i++) {
+			all.push_back(estimator.addAveragePool(MakeString() << "Sub-Sample [" << i << "]", std::vector<int>(1, conv1[i]), 2, true)[0]);
+		}
+		std::vector<std::pair<int, int>> connectionTable;
+		for (int ii = 0; ii < 6; ii++) {
+			for (int jj = 0; jj < 16; jj++) {
+				if (MNIST_TABLE[jj + ii * 16]) {
+					connectionTable.push_back(std::pair<int, int>(ii, jj));
+				}
+			}
+		}
+		std::vector<int> conv2 = estimator.addConvolution("conv2", all, 5, 16, true, connectionTable);
+		all.clear();
+		for (int i = 0; i < (int)conv2.size(); i++) {
+			std::vector<int> avg2 = estimator.addAveragePool(MakeString() << "Sub-Sample [" << i << "]", std::vector<int>(1, conv2[i]), 2, true);
+			all.push_back(estimator.addConvolution("conv3", avg2, 5, 1, true)[0]);
+		}
+		estimator.addFullyConnected("Decision Layer", all, 10, 1, true);
+	}
+}
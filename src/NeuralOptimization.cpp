@@ -1,38 +1,268 @@
 #include "NeuralOptimization.h"
+#include <xmmintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
 namespace tgr {
-	bool GradientDescentOptimizer::optimize(int id, const std::vector<std::shared_ptr<Signal>>& signals) {
-		int N = (int)signals.size();
-		double delta = 0.0;
-#pragma omp parallel for reduction(+:delta)
-		for (int n = 0; n < N;n++) {
-			SignalPtr sig = signals[n];
-			float* w=sig->weight;
-			delta += std::abs(*sig->change);
-			*w = *w - learningRate*(*sig->change + weightDecay*(*w));
-		}
-		//if (N>0)std::cout <<"["<<id<<"] Weight Change="<<delta<< std::endl;
+	//Parameters are updated in cache sized chunks so each thread streams through its own part of the arena.
+	static const int OPTIMIZE_CHUNK = 4096;
+	template<class F> static void ForEachChunk(size_t size, const F& func) {
+		int N = (int)size;
+		int chunks = (N + OPTIMIZE_CHUNK - 1) / OPTIMIZE_CHUNK;
+#pragma omp parallel for if(chunks>1)
+		for (int c = 0; c < chunks; c++) {
+			int start = c*OPTIMIZE_CHUNK;
+			func(start, std::min(start + OPTIMIZE_CHUNK, N));
+		}
+	}
+	bool GradientDescentOptimizer::optimize(const ParameterRange& range) {
+		const __m128 lr = _mm_set1_ps(learningRate);
+		const __m128 wd = _mm_set1_ps(weightDecay);
+		float* w = range.weights;
+		const float* g = range.changes;
+		ForEachChunk(range.size, [&](int start, int end) {
+			int n = start;
+			for (; n + 4 <= end; n += 4) {
+				__m128 wn = _mm_loadu_ps(w + n);
+				__m128 gn = _mm_add_ps(_mm_loadu_ps(g + n), _mm_mul_ps(wd, wn));
+				_mm_storeu_ps(w + n, _mm_sub_ps(wn, _mm_mul_ps(lr, gn)));
+			}
+			for (; n < end; n++) {
+				w[n] = w[n] - learningRate*(g[n] + weightDecay*w[n]);
+			}
+		});
+		step++;
 		return true;
 	}	
-	bool MomentumOptimizer::optimize(int id, const std::vector<std::shared_ptr<Signal>>& signals) {
-		int N = (int)signals.size();
-		auto pos = velocityBufferMap.find(id);
-		if (pos == velocityBufferMap.end()) {
-			velocityBufferMap[id]=std::vector<float>(signals.size(), 0.0f);
-		}
-		double delta = 0.0;
-		std::vector<float>& velocityBuffer = velocityBufferMap.at(id);
-#pragma omp parallel for reduction(+:delta)
+	bool MomentumOptimizer::optimize(const ParameterRange& range) {
+		const __m128 lr = _mm_set1_ps(learningRate);
+		const __m128 wd = _mm_set1_ps(weightDecay);
+		const __m128 mu = _mm_set1_ps(momentum);
+		float* w = range.weights;
+		float* v = range.getState(0);
+		const float* g = range.changes;
+		ForEachChunk(range.size, [&](int start, int end) {
+			int n = start;
+			for (; n + 4 <= end; n += 4) {
+				__m128 wn = _mm_loadu_ps(w + n);
+				__m128 gn = _mm_add_ps(_mm_loadu_ps(g + n), _mm_mul_ps(wd, wn));
+				__m128 vn = _mm_sub_ps(_mm_mul_ps(mu, _mm_loadu_ps(v + n)), _mm_mul_ps(lr, gn));
+				_mm_storeu_ps(v + n, vn);
+				_mm_storeu_ps(w + n, _mm_add_ps(wn, vn));
+			}
+			for (; n < end; n++) {
+				float vel = momentum * v[n] - learningRate* (g[n] + w[n] * weightDecay);
+				w[n] = w[n] + vel;
+				v[n] = vel;
+			}
+		});
+		step++;
+		return true;
+	}
+	bool AdamOptimizer::optimize(const ParameterRange& range) {
+		step++;
+		//Bias correction is folded into the step size so the inner loop stays a single fused pass.
+		float correction = std::sqrt(1.0f - std::pow(beta2, (float)step)) / (1.0f - std::pow(beta1, (float)step));
+		float rate = learningRate*correction;
+		float l2 = (decoupled) ? 0.0f : weightDecay;
+		float shrink = (decoupled) ? learningRate*weightDecay : 0.0f;
+		const __m128 lr = _mm_set1_ps(rate);
+		const __m128 wd = _mm_set1_ps(l2);
+		const __m128 sh = _mm_set1_ps(shrink);
+		const __m128 b1 = _mm_set1_ps(beta1);
+		const __m128 b1c = _mm_set1_ps(1.0f - beta1);
+		const __m128 b2 = _mm_set1_ps(beta2);
+		const __m128 b2c = _mm_set1_ps(1.0f - beta2);
+		const __m128 eps = _mm_set1_ps(epsilon);
+		float* w = range.weights;
+		float* m = range.getState(0);
+		float* v = range.getState(1);
+		const float* g = range.changes;
+		ForEachChunk(range.size, [&](int start, int end) {
+			int n = start;
+			for (; n + 4 <= end; n += 4) {
+				__m128 wn = _mm_loadu_ps(w + n);
+				__m128 gn = _mm_add_ps(_mm_loadu_ps(g + n), _mm_mul_ps(wd, wn));
+				__m128 mn = _mm_add_ps(_mm_mul_ps(b1, _mm_loadu_ps(m + n)), _mm_mul_ps(b1c, gn));
+				__m128 vn = _mm_add_ps(_mm_mul_ps(b2, _mm_loadu_ps(v + n)), _mm_mul_ps(b2c, _mm_mul_ps(gn, gn)));
+				_mm_storeu_ps(m + n, mn);
+				_mm_storeu_ps(v + n, vn);
+				__m128 dn = _mm_div_ps(_mm_mul_ps(lr, mn), _mm_add_ps(_mm_sqrt_ps(vn), eps));
+				_mm_storeu_ps(w + n, _mm_sub_ps(_mm_sub_ps(wn, _mm_mul_ps(sh, wn)), dn));
+			}
+			for (; n < end; n++) {
+				float gn = g[n] + l2*w[n];
+				m[n] = beta1*m[n] + (1.0f - beta1)*gn;
+				v[n] = beta2*v[n] + (1.0f - beta2)*gn*gn;
+				w[n] = w[n] - shrink*w[n] - rate*m[n] / (std::sqrt(v[n]) + epsilon);
+			}
+		});
+		return true;
+	}
+	bool RMSPropOptimizer::optimize(const ParameterRange& range) {
+		const __m128 lr = _mm_set1_ps(learningRate);
+		const __m128 wd = _mm_set1_ps(weightDecay);
+		const __m128 rho = _mm_set1_ps(decay);
+		const __m128 rhoc = _mm_set1_ps(1.0f - decay);
+		const __m128 eps = _mm_set1_ps(epsilon);
+		float* w = range.weights;
+		float* s = range.getState(0);
+		const float* g = range.changes;
+		ForEachChunk(range.size, [&](int start, int end) {
+			int n = start;
+			for (; n + 4 <= end; n += 4) {
+				__m128 wn = _mm_loadu_ps(w + n);
+				__m128 gn = _mm_add_ps(_mm_loadu_ps(g + n), _mm_mul_ps(wd, wn));
+				__m128 sn = _mm_add_ps(_mm_mul_ps(rho, _mm_loadu_ps(s + n)), _mm_mul_ps(rhoc, _mm_mul_ps(gn, gn)));
+				_mm_storeu_ps(s + n, sn);
+				_mm_storeu_ps(w + n, _mm_sub_ps(wn, _mm_div_ps(_mm_mul_ps(lr, gn), _mm_add_ps(_mm_sqrt_ps(sn), eps))));
+			}
+			for (; n < end; n++) {
+				float gn = g[n] + weightDecay*w[n];
+				s[n] = decay*s[n] + (1.0f - decay)*gn*gn;
+				w[n] = w[n] - learningRate*gn / (std::sqrt(s[n]) + epsilon);
+			}
+		});
+		step++;
+		return true;
+	}
+	bool AdagradOptimizer::optimize(const ParameterRange& range) {
+		const __m128 lr = _mm_set1_ps(learningRate);
+		const __m128 wd = _mm_set1_ps(weightDecay);
+		const __m128 eps = _mm_set1_ps(epsilon);
+		float* w = range.weights;
+		float* s = range.getState(0);
+		const float* g = range.changes;
+		ForEachChunk(range.size, [&](int start, int end) {
+			int n = start;
+			for (; n + 4 <= end; n += 4) {
+				__m128 wn = _mm_loadu_ps(w + n);
+				__m128 gn = _mm_add_ps(_mm_loadu_ps(g + n), _mm_mul_ps(wd, wn));
+				__m128 sn = _mm_add_ps(_mm_loadu_ps(s + n), _mm_mul_ps(gn, gn));
+				_mm_storeu_ps(s + n, sn);
+				_mm_storeu_ps(w + n, _mm_sub_ps(wn, _mm_div_ps(_mm_mul_ps(lr, gn), _mm_add_ps(_mm_sqrt_ps(sn), eps))));
+			}
+			for (; n < end; n++) {
+				float gn = g[n] + weightDecay*w[n];
+				s[n] += gn*gn;
+				w[n] = w[n] - learningRate*gn / (std::sqrt(s[n]) + epsilon);
+			}
+		});
+		step++;
+		return true;
+	}
+	void LBFGSOptimizer::reset() {
+		sHistory.clear();
+		yHistory.clear();
+		hasGradient = false;
+		loss = 0.0;
+	}
+	void LBFGSOptimizer::computeDirection() {
+		//Two-loop recursion, approximating the inverse Hessian from the most recent curvature pairs.
+		int N = (int)gradient.size();
+		int M = (int)sHistory.size();
+		alpha.resize(M);
+		rho.resize(M);
+		direction.set(gradient);
+		for (int i = M - 1; i >= 0; i--) {
+			rho[i] = 1.0f / aly::dot(yHistory[i], sHistory[i]);
+			alpha[i] = rho[i] * aly::dot(sHistory[i], direction);
+			const aly::Vec<float>& y = yHistory[i];
+#pragma omp parallel for
+			for (int n = 0; n < N; n++) {
+				direction[n] -= alpha[i] * y[n];
+			}
+		}
+		if (M > 0) {
+			float gamma = aly::dot(sHistory[M - 1], yHistory[M - 1]) / aly::lengthSqr(yHistory[M - 1]);
+#pragma omp parallel for
+			for (int n = 0; n < N; n++) {
+				direction[n] *= gamma;
+			}
+		}
+		for (int i = 0; i < M; i++) {
+			float beta = rho[i] * aly::dot(yHistory[i], direction);
+			const aly::Vec<float>& s = sHistory[i];
+#pragma omp parallel for
+			for (int n = 0; n < N; n++) {
+				direction[n] += s[n] * (alpha[i] - beta);
+			}
+		}
+#pragma omp parallel for
+		for (int n = 0; n < N; n++) {
+			direction[n] = -direction[n];
+		}
+	}
+	bool LBFGSOptimizer::optimize(const ParameterRange& range) {
+		if (!objective) {
+			throw std::runtime_error("L-BFGS requires an objective function.");
+		}
+		int N = (int)range.size;
+		float* w = range.weights;
+		const float* g = range.changes;
+		if (!hasGradient || (int)gradient.size() != N) {
+			reset();
+			loss = objective();
+			gradient.resize(N);
+			std::memcpy(gradient.ptr(), g, N * sizeof(float));
+			hasGradient = true;
+		}
+		direction.resize(N);
+		computeDirection();
+		float slope = aly::dot(gradient, direction);
+		if (!(slope < 0.0f)) {
+			//Curvature history no longer gives a descent direction, fall back to steepest descent.
+			sHistory.clear();
+			yHistory.clear();
+			computeDirection();
+			slope = aly::dot(gradient, direction);
+		}
+		if (!(slope < 0.0f)) {
+			return false;
+		}
+		start.resize(N);
+		std::memcpy(start.ptr(), w, N * sizeof(float));
+		float stepSize = (sHistory.size() == 0) ? std::min(1.0f, 1.0f / std::sqrt(aly::lengthSqr(gradient))) : 1.0f;
+		double trial = loss;
+		bool accepted = false;
+		for (int iter = 0; iter < maxLineSearch; iter++) {
+#pragma omp parallel for
+			for (int n = 0; n < N; n++) {
+				w[n] = start[n] + stepSize*direction[n];
+			}
+			trial = objective();
+			if (trial <= loss + armijo*stepSize*slope) {
+				accepted = true;
+				break;
+			}
+			stepSize *= 0.5f;
+		}
+		if (!accepted) {
+			std::memcpy(w, start.ptr(), N * sizeof(float));
+			loss = objective();
+			std::memcpy(gradient.ptr(), g, N * sizeof(float));
+			sHistory.clear();
+			yHistory.clear();
+			return false;
+		}
+		aly::Vec<float> s(N), y(N);
+#pragma omp parallel for
 		for (int n = 0; n < N; n++) {
-			SignalPtr sig = signals[n];
-			float prev = velocityBuffer[n];
-			float* w=sig->weight;
-			float vel = momentum * prev - learningRate* (*sig->change + (*w) * weightDecay);
-			*w = *w + vel;
-			delta += std::abs(*sig->change);
-			velocityBuffer[n] = vel;
-		}
-		delta /= N;
-		//if(N>0)std::cout << "[" << id << "] Weight Change=" << delta <<" signals "<<signals.size()<< std::endl;
+			s[n] = w[n] - start[n];
+			y[n] = g[n] - gradient[n];
+			gradient[n] = g[n];
+		}
+		if (aly::dot(s, y) > 1E-10f) {
+			sHistory.push_back(s);
+			yHistory.push_back(y);
+			if ((int)sHistory.size() > history) {
+				sHistory.pop_front();
+				yHistory.pop_front();
+			}
+		}
+		loss = trial;
+		step++;
 		return true;
 	}
-}
\ No newline at end of file
+}
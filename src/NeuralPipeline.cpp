@@ -0,0 +1,146 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralPipeline.h"
+#include "NeuralProfiler.h"
+#include <algorithm>
+#include <chrono>
+#include <omp.h>
+namespace tgr {
+	NeuralPipeline::NeuralPipeline() :nextIteration(0), nextConsume(0), running(false), batchSize(0), width(0), height(0), shuffleInterval(1), stageTime(0), waitTime(0), stagedCount(0) {
+		states[0] = states[1] = SlotState::Free;
+	}
+	NeuralPipeline::~NeuralPipeline() {
+		stop();
+	}
+	void NeuralPipeline::start(const std::vector<int>& sampleIndexes, int B, int w, int h, int interval, unsigned int seed) {
+		stop();
+		resetStats();
+		width = w;
+		height = h;
+		int inputSize = w*h;
+		samples = sampleIndexes;
+		batchSize = std::max(1, std::min(B, (int)samples.size()));
+		shuffleInterval = std::max(1, interval);
+		rng.seed(seed);
+		for (NeuralBatch& batch : batches) {
+			batch.iteration = -1;
+			batch.inputSize = inputSize;
+			batch.indexes.resize(batchSize);
+			batch.inputs.resize((size_t)batchSize*inputSize);
+			batch.outputs.resize(batchSize);
+		}
+		states[0] = states[1] = SlotState::Free;
+		nextIteration = 0;
+		nextConsume = 0;
+		running = true;
+		producer = std::thread([this]() {
+			produce();
+		});
+	}
+	void NeuralPipeline::stop() {
+		{
+			std::lock_guard<std::mutex> lockMe(lock);
+			running = false;
+		}
+		consumed.notify_all();
+		produced.notify_all();
+		if (producer.joinable()) {
+			producer.join();
+		}
+	}
+	void NeuralPipeline::fill(NeuralBatch& batch, int iteration) {
+		TGR_PROFILE_SCOPE("stage batch", "pipeline");
+		auto start = std::chrono::steady_clock::now();
+		int S = (int)samples.size();
+		if (iteration%shuffleInterval == 0) {
+			if (shuffleStage) {
+				shuffleStage(samples, rng);
+			}
+			else {
+				std::shuffle(samples.begin(), samples.end(), rng);
+			}
+		}
+		batch.iteration = iteration;
+		for (int b = 0; b < batchSize; b++) {
+			batch.indexes[b] = samples[(b + iteration*batchSize) % S];
+		}
+		NeuralAugmentation* aug = augmentation.get();
+#pragma omp parallel for
+		for (int b = 0; b < batchSize; b++) {
+			int idx = batch.indexes[b];
+			if (inputStage)inputStage(batch.getInput(b), idx);
+			if (aug != nullptr)aug->apply(batch.getInput(b), width, height, iteration, idx);
+			if (outputStage)outputStage(batch.outputs[b], idx);
+		}
+		stagedCount += batchSize;
+		stageTime += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+	void NeuralPipeline::produce() {
+		//Staging overlaps training, so the producer's OpenMP team leaves most cores to the training thread.
+		omp_set_num_threads(std::max(1, (int)std::thread::hardware_concurrency() / 4));
+		int slot = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lockMe(lock);
+				consumed.wait(lockMe, [this, slot]() {return !running || states[slot] == SlotState::Free;});
+				if (!running)return;
+			}
+			//The slot is owned by the producer until it is published, so it is filled without holding the lock.
+			fill(batches[slot], nextIteration++);
+			{
+				std::lock_guard<std::mutex> lockMe(lock);
+				states[slot] = SlotState::Ready;
+			}
+			produced.notify_all();
+			slot = 1 - slot;
+		}
+	}
+	NeuralBatch* NeuralPipeline::acquire() {
+		auto start = std::chrono::steady_clock::now();
+		std::unique_lock<std::mutex> lockMe(lock);
+		int slot = nextConsume;
+		produced.wait(lockMe, [this, slot]() {return !running || states[slot] == SlotState::Ready;});
+		waitTime += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		if (states[slot] != SlotState::Ready)return nullptr;
+		states[slot] = SlotState::Acquired;
+		nextConsume = 1 - slot;
+		return &batches[slot];
+	}
+	void NeuralPipeline::release(NeuralBatch* batch) {
+		{
+			std::lock_guard<std::mutex> lockMe(lock);
+			states[batch - batches] = SlotState::Free;
+		}
+		consumed.notify_all();
+	}
+	double NeuralPipeline::getStagedPerSecond() const {
+		double t = 1E-9*stageTime.load();
+		return (t > 0.0) ? stagedCount.load() / t : 0.0;
+	}
+	void NeuralPipeline::resetStats() {
+		stageTime = 0;
+		waitTime = 0;
+		stagedCount = 0;
+		if (augmentation.get() != nullptr) {
+			augmentation->resetStats();
+		}
+	}
+}
@@ -0,0 +1,126 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralProfiler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <unordered_map>
+namespace tgr {
+	std::atomic<bool> NeuralProfiler::enabled(false);
+	ProfileBuffer::ProfileBuffer(int threadId, int log2Capacity) :events(size_t(1) << log2Capacity), head(0), tail(0), mask((uint64_t(1) << log2Capacity) - 1), threadId(threadId) {
+	}
+	void ProfileBuffer::copy(std::vector<ProfileEvent>& out) const {
+		uint64_t h = head.load(std::memory_order_acquire);
+		uint64_t capacity = mask + 1;
+		uint64_t first = std::max(tail.load(std::memory_order_acquire), (h > capacity) ? h - capacity : 0);
+		if (first >= h)return;
+		size_t base = out.size();
+		for (uint64_t i = first; i < h; i++) {
+			out.push_back(events[i&mask]);
+		}
+		//Anything below after+1-capacity may have been overwritten, including the slot being written now.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t after = head.load(std::memory_order_relaxed);
+		uint64_t valid = (after + 1 > capacity) ? after + 1 - capacity : 0;
+		if (valid > first) {
+			size_t drop = (size_t)(std::min(valid, h) - first);
+			out.erase(out.begin() + base, out.begin() + base + drop);
+		}
+	}
+	NeuralProfiler::NeuralProfiler() :epoch(std::chrono::steady_clock::now()), log2Capacity(16) {
+	}
+	NeuralProfiler& NeuralProfiler::getInstance() {
+		static NeuralProfiler profiler;
+		return profiler;
+	}
+	const char* NeuralProfiler::intern(const std::string& name) {
+		//Layer and filter names rarely change, so a per-thread cache keeps the registry lock off the hot path.
+		thread_local std::unordered_map<std::string, const char*> cache;
+		auto pos = cache.find(name);
+		if (pos != cache.end()) {
+			return pos->second;
+		}
+		std::lock_guard<std::mutex> lockMe(registryLock);
+		const char* str = names.insert(name).first->c_str();
+		cache[name] = str;
+		return str;
+	}
+	ProfileBuffer* NeuralProfiler::getThreadBuffer() {
+		thread_local ProfileBuffer* buffer = nullptr;
+		if (buffer == nullptr) {
+			std::lock_guard<std::mutex> lockMe(registryLock);
+			std::shared_ptr<ProfileBuffer> ptr(new ProfileBuffer((int)buffers.size(), log2Capacity));
+			buffers.push_back(ptr);
+			buffer = ptr.get();
+		}
+		return buffer;
+	}
+	void NeuralProfiler::setCapacity(int log2Events) {
+		std::lock_guard<std::mutex> lockMe(registryLock);
+		log2Capacity = std::max(4, std::min(log2Events, 24));
+	}
+	void NeuralProfiler::clear() {
+		std::lock_guard<std::mutex> lockMe(registryLock);
+		for (std::shared_ptr<ProfileBuffer>& buffer : buffers) {
+			buffer->clear();
+		}
+	}
+	static void WriteEscaped(std::ostream& os, const char* str) {
+		for (const char* c = str; *c != '\0'; c++) {
+			if (*c == '"' || *c == '\\') {
+				os << '\\';
+			}
+			os << *c;
+		}
+	}
+	void NeuralProfiler::writeChromeTrace(std::ostream& os) {
+		std::vector<std::shared_ptr<ProfileBuffer>> snapshot;
+		{
+			std::lock_guard<std::mutex> lockMe(registryLock);
+			snapshot = buffers;
+		}
+		std::vector<ProfileEvent> events;
+		os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		bool first = true;
+		for (std::shared_ptr<ProfileBuffer>& buffer : snapshot) {
+			int tid = buffer->getThreadId();
+			if (!first)os << ",";
+			first = false;
+			os << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":\"" << ((tid == 0) ? "main" : "worker") << " " << tid << "\"}}";
+			events.clear();
+			buffer->copy(events);
+			for (const ProfileEvent& evt : events) {
+				os << ",\n{\"name\":\"";
+				WriteEscaped(os, evt.name);
+				os << "\",\"cat\":\"" << evt.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid;
+				os << ",\"ts\":" << evt.start / 1000 << "." << std::abs(evt.start % 1000) / 100;
+				os << ",\"dur\":" << evt.duration / 1000 << "." << std::abs(evt.duration % 1000) / 100 << "}";
+			}
+		}
+		os << "\n]}" << std::endl;
+	}
+	bool WriteChromeTraceToFile(const std::string& file) {
+		std::ofstream os(file);
+		if (!os.is_open())return false;
+		NeuralProfiler::getInstance().writeChromeTrace(os);
+		return true;
+	}
+}
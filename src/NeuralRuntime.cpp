@@ -19,46 +19,204 @@
 * THE SOFTWARE.
 */
 #include "NeuralRuntime.h"
+#include "NeuralProfiler.h"
 #include <sstream>
 #include <fstream>
 #include <ostream>
 #include <random>
+#include <cstring>
+#include <set>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 using namespace aly;
 namespace tgr {
 	NeuralListener::~NeuralListener() {
 
+	}
+	std::shared_ptr<NeuralOptimization> NeuralRuntime::makeOptimizer() {
+		switch (optimizationMethod) {
+			case 0:
+				return std::shared_ptr<NeuralOptimization>(new GradientDescentOptimizer(learningRateInitial.toFloat(), weightDecay.toFloat()));
+			case 1:
+				return std::shared_ptr<NeuralOptimization>(new MomentumOptimizer(learningRateInitial.toFloat(),weightDecay.toFloat(),momentum.toFloat()));
+			case 2:
+				return std::shared_ptr<NeuralOptimization>(new AdamOptimizer(learningRateInitial.toFloat(), weightDecay.toFloat(), momentum.toFloat(), secondMoment.toFloat()));
+			case 3:
+				return std::shared_ptr<NeuralOptimization>(new AdamWOptimizer(learningRateInitial.toFloat(), weightDecay.toFloat(), momentum.toFloat(), secondMoment.toFloat()));
+			case 4:
+				return std::shared_ptr<NeuralOptimization>(new RMSPropOptimizer(learningRateInitial.toFloat(), weightDecay.toFloat(), secondMoment.toFloat()));
+			case 5:
+				return std::shared_ptr<NeuralOptimization>(new AdagradOptimizer(learningRateInitial.toFloat(), weightDecay.toFloat()));
+			case 6: {
+				LBFGSOptimizerPtr lbfgs(new LBFGSOptimizer());
+				lbfgs->setObjective([this]() {
+					return evaluateBatch();
+				});
+				return lbfgs;
+			}
+		}
+		throw std::runtime_error(MakeString() << "Unknown optimization method " << optimizationMethod);
+	}
+	int NeuralRuntime::getStateSize() {
+		return makeOptimizer()->getStateSize();
 	}
 	bool NeuralRuntime::init() {
 		lastResidual = 1E30f;
+		samplesPerSecond = 0.0;
+		samplesProcessed = 0;
+		samplesAtPublish = 0;
+		NeuralProfiler::setEnabled(profile);
+		NeuralProfiler::getInstance().clear();
+		//The recurring task has stopped, so nothing is pushing telemetry.
+		telemetry->clear();
+		series.clear();
 		for (NeuralLayerPtr layer : sys->getLayers()) {
 			layer->getGraph()->points.clear();
 		}
 
-		switch (optimizationMethod) {
-			case 0:
-				sys->setOptimizer(opt = std::shared_ptr<NeuralOptimization>(new GradientDescentOptimizer(learningRateInitial.toFloat(), weightDecay.toFloat())));
-				break;
-			case 1:
-				sys->setOptimizer(opt = std::shared_ptr<NeuralOptimization>(new MomentumOptimizer(learningRateInitial.toFloat(),weightDecay.toFloat(),momentum.toFloat())));
-				break;
-		}
+		sys->setOptimizer(opt = makeOptimizer());
+		//The line search compares evaluateBatch() losses, so it needs their true gradient.
+		sys->setExactGradient(opt->getType() == NeuralOptimizer::LBFGS);
+		replicas.clear();
 		sampleIndexes.clear();
 		for (int n = lowerSample.toInteger(); n <= upperSample.toInteger(); n++) {
 			sampleIndexes.push_back(n);
 		}
 		sys->initializeWeights(0.0f,1.0f);
 		sys->updateKnowledge();
+		//Snapshots still queued from a previous run must land before the history is cleared.
+		checkpoints->stop();
+		history->clear();
 		cache->clear();
+		history->setOptions(NeuralHistoryOptions(historyKeyframes.toInteger(), 1, historyHalfPrecision));
 		iteration = 0;
 		NeuralKnowledge& k = sys->getKnowledge();
 		k.setFile(MakeString() << GetDesktopDirectory() << ALY_PATH_SEPARATOR << "tiger" <<std::setw(5)<<std::setfill('0')<< iteration << ".bin");
 		k.setName("tiger");
-		cache->set(iteration, k);
-
+		history->add(iteration, k);
+		checkpoints->setPolicy(CheckpointPolicy(checkpointIterations.toInteger(), checkpointSeconds.toDouble(), checkpointImprovement));
+		checkpoints->reset();
+		checkpoints->start();
+		if (validator.get() != nullptr) {
+			validator->reset();
+			validator->setEarlyStopping(earlyStopping ? earlyStoppingPatience.toInteger() : 0);
+			validator->initialize();
+		}
+		pipeline.stop();
+		if (inputStager&&opt->getType() != NeuralOptimizer::LBFGS) {
+			static std::random_device rd;
+			pipeline.setInputStage(inputStager);
+			pipeline.setOutputStage(outputSampler);
+			pipeline.setShuffleStage(sampleShuffler);
+			if (augmentation.get() != nullptr) {
+				augmentation->setShift(augmentShift.toFloat());
+				augmentation->setRotation(augmentRotation.toFloat());
+				augmentation->setElastic(augmentElastic.toFloat(), augmentation->getElasticSigma());
+				augmentation->setNoise(augmentNoise.toFloat());
+			}
+			pipeline.setAugmentation(augmentation);
+			NeuralLayerPtr input = sys->getInput();
+			pipeline.start(sampleIndexes, batchSize.toInteger(), input->width, input->height, iterationsPerStep.toInteger(), rd());
+		}
 		return true;
 	}
 	void NeuralRuntime::cleanup(){
+		pipeline.stop();
+		checkpoints->stop();
+		if (validator.get() != nullptr) {
+			validator->stop();
+		}
+		snapshots.clear();
+		if (NeuralProfiler::isEnabled()) {
+			NeuralProfiler::setEnabled(false);
+			std::string traceFile = MakeString() << GetDesktopDirectory() << ALY_PATH_SEPARATOR << "tiger_trace.json";
+			if (WriteChromeTraceToFile(traceFile)) {
+				std::cout << "Wrote profile trace " << traceFile << std::endl;
+			}
+		}
+	}
+	double NeuralRuntime::evaluateBatch() {
+		int S = (int)sampleIndexes.size();
+		int R = std::min((int)std::thread::hardware_concurrency(), S);
+		NeuralArena& arena = sys->getArena();
+		if (!modelBuilder || R < 2) {
+			double loss = 0.0;
+			sys->reset();
+			for (int idx : sampleIndexes) {
+				if (inputSampler)inputSampler(sys->getInput(), idx);
+				sys->evaluate();
+				if (outputSampler) {
+					outputSampler(outputData, idx);
+					loss += 0.5*sys->accumulate(outputData)*outputData.size();
+				}
+				sys->backpropagate();
+			}
+			return loss;
+		}
+		//Each replica has its own responses and gradients, so samples are evaluated in parallel against a copy of the weights.
+		while ((int)replicas.size() < R) {
+			NeuralSystemPtr replica(new NeuralSystem(nullptr));
+			modelBuilder(*replica);
+			replica->initialize();
+			replica->setExactGradient(sys->isExactGradient());
+			if (replica->getArena().getStride() != arena.getStride()) {
+				throw std::runtime_error("Replica layout does not match the training system.");
+			}
+			replicas.push_back(replica);
+		}
+		std::vector<double> losses(R, 0.0);
+#pragma omp parallel for
+		for (int r = 0; r < R; r++) {
+			NeuralSystem& replica = *replicas[r];
+			std::memcpy(replica.getArena().getWeights(), arena.getWeights(), arena.getStride() * sizeof(float));
+			replica.getArena().markDirty();
+			replica.invalidate();
+			replica.reset();
+			std::vector<float> out;
+			for (int s = r; s < S; s += R) {
+				int idx = sampleIndexes[s];
+				if (inputSampler)inputSampler(replica.getInput(), idx);
+				replica.evaluate();
+				if (outputSampler) {
+					outputSampler(out, idx);
+					losses[r] += 0.5*replica.accumulate(out)*out.size();
+				}
+				replica.backpropagate();
+			}
+		}
+		sys->reset();
+		float* g = arena.getChanges();
+		int N = (int)arena.getStride();
+		double loss = 0.0;
+		for (int r = 0; r < R; r++) {
+			const float* rg = replicas[r]->getArena().getChanges();
+#pragma omp parallel for
+			for (int n = 0; n < N; n++) {
+				g[n] += rg[n];
+			}
+			loss += losses[r];
+		}
+		return loss;
+	}
+	void NeuralRuntime::setAugmentation(const NeuralAugmentationPtr& aug) {
+		augmentation = aug;
+		if (aug.get() != nullptr) {
+			augmentShift.setValue(aug->getShift());
+			augmentRotation.setValue(aug->getRotation());
+			augmentElastic.setValue(aug->getElasticAlpha());
+			augmentNoise.setValue(aug->getNoise());
+		}
 	}
 	void NeuralRuntime::setSampleRange(int mn, int mx) {
 		minSample.setValue(mn);
@@ -71,7 +229,7 @@ namespace tgr {
 	}
 	void NeuralRuntime::setup(const aly::ParameterPanePtr& controls) {
 		controls->addGroup("Training", true);
-		controls->addSelectionField("Optimizer", optimizationMethod, std::vector<std::string>{"Gradient Descent", "Momentum"},6.0f);
+		controls->addSelectionField("Optimizer", optimizationMethod, std::vector<std::string>{"Gradient Descent", "Momentum", "Adam", "AdamW", "RMSProp", "Adagrad", "L-BFGS"},6.0f);
 		controls->addNumberField("Epochs", iterationsPerEpoch);
 		controls->addRangeField("Samples", lowerSample, upperSample, minSample, maxSample);
 		controls->addNumberField("Batch Size", batchSize, Integer(0), Integer((maxSample.toInteger()- minSample.toInteger())+1));
@@ -79,71 +237,328 @@ namespace tgr {
 		controls->addNumberField("Attenuation", learningRateDelta, Float(0.0f), Float(1.0f));
 		controls->addNumberField("Weight Decay", weightDecay, Float(0.0f), Float(1.0f));
 		controls->addNumberField("Momentum", momentum, Float(0.0f), Float(1.0f));
+		controls->addNumberField("Second Moment", secondMoment, Float(0.0f), Float(1.0f));
+		controls->addNumberField("Checkpoint Every", checkpointIterations, Integer(0), Integer(1000));
+		controls->addNumberField("Checkpoint Seconds", checkpointSeconds, Float(0.0f), Float(3600.0f));
+		controls->addCheckBox("Checkpoint Best", checkpointImprovement);
+		controls->addNumberField("History Keyframes", historyKeyframes, Integer(1), Integer(256));
+		controls->addCheckBox("History FP16", historyHalfPrecision);
+		controls->addCheckBox("Max Throughput", throughput);
+		if (validator.get() != nullptr) {
+			controls->addGroup("Validation", false);
+			controls->addNumberField("Validate Every", validationIterations, Integer(0), Integer(10000));
+			controls->addCheckBox("Early Stopping", earlyStopping);
+			controls->addNumberField("Patience", earlyStoppingPatience, Integer(1), Integer(100));
+		}
+#ifdef TGR_PROFILE
+		controls->addCheckBox("Profile", profile);
+#endif
+		if (augmentation.get() != nullptr) {
+			controls->addGroup("Augmentation", false);
+			controls->addNumberField("Shift", augmentShift, Float(0.0f), Float(8.0f));
+			controls->addNumberField("Rotation", augmentRotation, Float(0.0f), Float(45.0f));
+			controls->addNumberField("Elastic", augmentElastic, Float(0.0f), Float(64.0f));
+			controls->addNumberField("Noise", augmentNoise, Float(0.0f), Float(1.0f));
+		}
+	}
+	SystemFootprint NeuralRuntime::getFootprint() const {
+		SystemFootprint fp = sys->getFootprint();
+		if (cache.get() != nullptr) {
+			fp.cacheBytes = cache->getUsedBytes();
+		}
+		return fp;
 	}
 	bool NeuralRuntime::step() {
 		static std::random_device rd;
 		int iter =iteration;
 		bool ret = true;
 		double res = 0;
-		sys->reset();
+		TGR_PROFILE_SCOPE("step", "runtime");
+		Clock::time_point stepStart = Clock::now();
+		bool fullBatch = (opt->getType() == NeuralOptimizer::LBFGS);
 		int B = std::min(batchSize.toInteger(),(int)sampleIndexes.size());
-		if (iteration == 0) {
-			opt->setLearningRate(opt->getLearningRate() / B);
+		int samples = fullBatch ? (int)sampleIndexes.size() : B;
+		if (fullBatch) {
+			//L-BFGS runs its own full batch evaluations during the line search.
+			TGR_PROFILE_SCOPE("optimize", "runtime");
+			sys->optimize();
+			res = std::static_pointer_cast<LBFGSOptimizer>(opt)->getLoss();
+			sys->getOutput()->setResidual(res);
 		}
-		if (iter%iterationsPerStep.toInteger() == 0) {
-			std::shuffle(sampleIndexes.begin(), sampleIndexes.end(), rd);
+		else {
+			sys->reset();
+			if (iteration == 0) {
+				opt->setLearningRate(opt->getLearningRate() / B);
+			}
 		}
-		for(int b=0;b<B;b++){
-			int idx = sampleIndexes[(b+iter*B)%sampleIndexes.size()];
-			if (inputSampler)inputSampler(sys->getInput(), idx);
-			sys->evaluate();
-			if (outputSampler) {
-				outputSampler(outputData, idx);
-				double err= sys->accumulate(outputData);
-				res += err;
-				//std::cout << "Evaluate ["<<idx<<"] Error=" << err <<" "<< std::endl;
+		if (pipeline.isRunning() && !fullBatch) {
+			NeuralBatch* batch;
+			{
+				TGR_PROFILE_SCOPE("acquire", "runtime");
+				batch = pipeline.acquire();
+			}
+			if (batch == nullptr) {
+				return false;
+			}
+			samples = batch->size();
+			for (int b = 0; b < batch->size(); b++) {
+				{
+					TGR_PROFILE_SCOPE("sample", "runtime");
+					sys->getInput()->set(batch->getInput(b), batch->inputSize);
+				}
+				{
+					TGR_PROFILE_SCOPE("evaluate", "runtime");
+					sys->evaluate();
+				}
+				if (outputSampler) {
+					TGR_PROFILE_SCOPE("accumulate", "runtime");
+					res += sys->accumulate(batch->getOutput(b));
+				}
+				{
+					TGR_PROFILE_SCOPE("backpropagate", "runtime");
+					sys->backpropagate();
+				}
+			}
+			pipeline.release(batch);
+			if (iter%iterationsPerStep.toInteger() == 0) {
+				std::cout << "Input pipeline " << pipeline.getStagedPerSecond() << " samples/s, stalled " << pipeline.getWaitSeconds() << " s";
+				if (augmentation.get() != nullptr) {
+					std::cout << ", augmentation " << augmentation->getSamplesPerSecond() << " samples/s per thread";
+				}
+				std::cout << std::endl;
 			}
-			sys->backpropagate();
 		}
-		std::cout << iter<<") Residual Error=" << res << " " << std::endl;
+		else if (!fullBatch) {
+			if (iter%iterationsPerStep.toInteger() == 0) {
+				std::shuffle(sampleIndexes.begin(), sampleIndexes.end(), rd);
+			}
+			for (int b = 0; b < B; b++) {
+				int idx = sampleIndexes[(b + iter*B) % sampleIndexes.size()];
+				if (inputSampler) {
+					TGR_PROFILE_SCOPE("sample", "runtime");
+					inputSampler(sys->getInput(), idx);
+				}
+				{
+					TGR_PROFILE_SCOPE("evaluate", "runtime");
+					sys->evaluate();
+				}
+				if (outputSampler) {
+					TGR_PROFILE_SCOPE("accumulate", "runtime");
+					outputSampler(outputData, idx);
+					double err = sys->accumulate(outputData);
+					res += err;
+					//std::cout << "Evaluate ["<<idx<<"] Error=" << err <<" "<< std::endl;
+				}
+				{
+					TGR_PROFILE_SCOPE("backpropagate", "runtime");
+					sys->backpropagate();
+				}
+			}
+		}
+		if (!throughput) {
+			std::cout << iter << ") Residual Error=" << res << " " << std::endl;
+		}
 		double delta = std::abs(lastResidual - res);
-		if (delta < 1E-5f) {
+		if (delta < 1E-5f&&!fullBatch) {
 			opt->setLearningRate(opt->getLearningRate()*learningRateDelta.toFloat());
 			std::cout << "Learning Rate=" << opt->getLearningRate()*B << std::endl;
 		}
 		lastResidual = res;
-		sys->optimize();
-		for (NeuralLayerPtr layer : sys->getLayers()) {
-			layer->getGraph()->points.push_back(float2(float(iter),float(layer->getResidual())));
+		if (!fullBatch) {
+			TGR_PROFILE_SCOPE("optimize", "runtime");
+			sys->optimize();
+		}
+		//Graphs are drawn on the UI thread, so metrics go through the telemetry ring rather than straight into GraphData.
+		const std::vector<NeuralLayerPtr>& layers = sys->getLayers();
+		for (int n = 0; n < (int)layers.size(); n++) {
+			TelemetryEvent evt = { iter, TelemetryMetric::Residual, n, float(layers[n]->getResidual()) };
+			telemetry->push(evt);
 		}
-		if (delta<1E-7f||iteration>=getMaxIteration()) {
+		TelemetryEvent rate = { iter, TelemetryMetric::LearningRate, -1, opt->getLearningRate() };
+		telemetry->push(rate);
+		if (delta<1E-7f||iteration>=getMaxIteration()||(validator.get()!=nullptr&&validator->shouldStop())) {
 			ret = false;
+			pipeline.stop();
 		}
-		if (onUpdate) {
+		samplesProcessed += samples;
+		TelemetryEvent stepTime = { iter, TelemetryMetric::StepSeconds, -1, (float)std::chrono::duration<double>(Clock::now() - stepStart).count() };
+		telemetry->push(stepTime);
+		//Snapshots are copied here, on the training thread, so the UI never reads buffers that are being written.
+		Clock::time_point now = Clock::now();
+		double elapsed = std::chrono::duration<double>(now - lastPublish).count();
+		bool refresh = (!ret || elapsed >= publishInterval);
+		if (refresh) {
+			TGR_PROFILE_SCOPE("publish", "runtime");
+			sys->publish(iter);
+			if (elapsed > 0.0 && iter > 0) {
+				samplesPerSecond = (samplesProcessed - samplesAtPublish) / elapsed;
+			}
+			samplesAtPublish = samplesProcessed;
+			lastPublish = now;
+			TelemetryEvent throughputEvt = { iter, TelemetryMetric::SamplesPerSecond, -1, (float)samplesPerSecond.load() };
+			telemetry->push(throughputEvt);
+			if (throughput) {
+				std::cout << iter << ") Residual Error=" << res << " " << samplesPerSecond.load() << " samples/s" << std::endl;
+			}
+		}
+		//In throughput mode the UI is only told about the iterations that were published.
+		if (onUpdate && (refresh || !throughput)) {
 			onUpdate(iter, !ret);
 		}
 		iteration++;
-		sys->updateKnowledge();
-		NeuralKnowledge& k = sys->getKnowledge();
-		k.setFile(MakeString() << GetDesktopDirectory() << ALY_PATH_SEPARATOR << "tiger" << std::setw(5) << std::setfill('0') << iteration << ".bin");
-		k.setName("tiger");
-		cache->set(iteration, k);
+		//The final iteration is always kept so the timeline ends on the trained weights.
+		bool checkpoint = (checkpoints->isDue(iteration, res) || !ret);
+		//Validation is skipped while the previous pass is still running, so it never holds up training.
+		bool validate = (validator.get() != nullptr && validationIterations.toInteger() > 0 && iteration%validationIterations.toInteger() == 0 && !validator->isBusy());
+		if (checkpoint || validate) {
+			std::shared_ptr<NeuralKnowledge> snapshot = acquireSnapshot();
+			{
+				TGR_PROFILE_SCOPE("snapshot", "runtime");
+				snapshot->set(*sys);
+			}
+			if (checkpoint) {
+				checkpoints->submit(iteration, snapshot);
+			}
+			if (validate) {
+				validator->submit(iteration, snapshot);
+			}
+		}
 		return ret;
 	}
+	std::shared_ptr<NeuralKnowledge> NeuralRuntime::acquireSnapshot() {
+		for (const std::shared_ptr<NeuralKnowledge>& snapshot : snapshots) {
+			if (snapshot.use_count() == 1) {
+				return snapshot;
+			}
+		}
+		snapshots.push_back(std::shared_ptr<NeuralKnowledge>(new NeuralKnowledge("tiger")));
+		return snapshots.back();
+	}
 	NeuralRuntime::NeuralRuntime(const std::shared_ptr<tgr::NeuralSystem>& system) :
-		RecurrentTask([this](uint64_t iteration) {return step();}, 5),sys(system),paused(false) {
+		RecurrentTask([this](uint64_t iteration) {
+		bool ret = step();
+		if (!ret) {
+			cleanup();
+			finished = true;
+		}
+		return ret;
+	}, 5),sys(system),paused(false) {
 		optimizationMethod = 1;
+		profile = false;
 		iterationsPerEpoch = Integer(200);
 		iterationsPerStep = Integer(10);
 		batchSize = Integer(32);
 		lowerSample = Integer(0);
 		upperSample = Integer(0);
+		augmentShift = Float(0.0f);
+		augmentRotation = Float(0.0f);
+		augmentElastic = Float(0.0f);
+		augmentNoise = Float(0.0f);
 		minSample = Integer(0);
 		maxSample = Integer(0);
 		learningRateInitial = Float(0.999f);
 		weightDecay = Float(0.0f);
 		momentum = Float(0.9f);
+		secondMoment = Float(0.999f);
 		learningRateDelta = Float(0.9f);
-		cache.reset(new NeuralCache());
+		history.reset(new NeuralHistory());
+		NeuralHistoryPtr h = history;
+		checkpoints.reset(new NeuralCheckpointWriter([h](int iteration, const std::shared_ptr<NeuralKnowledge>& k) {
+			//Named here so steps that only validate, or whose snapshot is dropped, never format a file name.
+			k->setFile(MakeString() << GetDesktopDirectory() << ALY_PATH_SEPARATOR << "tiger" << std::setw(5) << std::setfill('0') << iteration << ".bin");
+			h->add(iteration, *k);
+		}));
+		cache.reset(new NeuralCache([h](int frame) {
+			return h->get(frame);
+		}));
+		historyKeyframes = Integer(16);
+		historyHalfPrecision = false;
+		checkpointIterations = Integer(1);
+		checkpointSeconds = Float(0.0f);
+		checkpointImprovement = false;
+		publishInterval = 1.0 / 30.0;
+		telemetry.reset(new TelemetryRing());
+		validationIterations = Integer(0);
+		earlyStopping = false;
+		earlyStoppingPatience = Integer(5);
+		throughput = false;
+		throughputCore = std::max(0, (int)std::thread::hardware_concurrency() - 1);
+		stopRequested = false;
+		finished = false;
+		samplesPerSecond = 0.0;
+		samplesProcessed = 0;
+		samplesAtPublish = 0;
+	}
+	bool NeuralRuntime::updateTelemetry() {
+		drained.clear();
+		if (telemetry->drain(drained) == 0) {
+			return false;
+		}
+		std::set<int> changed;
+		for (const TelemetryEvent& evt : drained) {
+			series[std::make_pair(evt.metric, evt.layer)].add(evt.iteration, evt.value);
+			if (evt.metric == TelemetryMetric::Residual) {
+				changed.insert(evt.layer);
+			}
+		}
+		const std::vector<NeuralLayerPtr>& layers = sys->getLayers();
+		for (int n : changed) {
+			if (n >= 0 && n < (int)layers.size()) {
+				series[std::make_pair(TelemetryMetric::Residual, n)].getPoints(layers[n]->getGraph()->points);
+			}
+		}
+		return true;
+	}
+	const DecimatedSeries* NeuralRuntime::getSeries(TelemetryMetric metric, int layer) const {
+		auto pos = series.find(std::make_pair(metric, layer));
+		return (pos != series.end()) ? &pos->second : nullptr;
+	}
+	NeuralRuntime::~NeuralRuntime() {
+		stopRequested = true;
+		if (simulationThread.joinable()) {
+			simulationThread.join();
+		}
+	}
+	static void PinCurrentThread(int core) {
+#ifdef _WIN32
+		SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core);
+#else
+		cpu_set_t cores;
+		CPU_ZERO(&cores);
+		CPU_SET(core, &cores);
+		pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores);
+#endif
+	}
+	void NeuralRuntime::start() {
+		finished = false;
+		if (!throughput) {
+			RecurrentTask::execute();
+			return;
+		}
+		stopRequested = true;
+		if (simulationThread.joinable()) {
+			simulationThread.join();
+		}
+		stopRequested = false;
+		simulationThread = std::thread([this]() {
+			//Threads inherit affinity on Linux, so the OpenMP team is started before pinning to keep it spread across all cores.
+#pragma omp parallel
+			{
+			}
+			if (throughputCore >= 0 && throughputCore < (int)std::thread::hardware_concurrency()) {
+				PinCurrentThread(throughputCore);
+			}
+			while (!stopRequested && step()) {
+			}
+			cleanup();
+			finished = true;
+		});
+	}
+	void NeuralRuntime::stop() {
+		stopRequested = true;
+		if (simulationThread.joinable() && simulationThread.get_id() != std::this_thread::get_id()) {
+			simulationThread.join();
+		}
+		RecurrentTask::cancel();
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,41 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralSnapshot.h"
+namespace tgr {
+	void SnapshotBuffer::publish() {
+		//Release makes the back buffer's contents visible to the reader that acquires it.
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel)&INDEX_MASK;
+	}
+	bool SnapshotBuffer::update() {
+		if ((middle.load(std::memory_order_relaxed)&FRESH) == 0) {
+			return false;
+		}
+		front = middle.exchange(front, std::memory_order_acq_rel)&INDEX_MASK;
+		return true;
+	}
+	size_t SnapshotBuffer::getCapacityBytes() const {
+		size_t bytes = 0;
+		for (const LayerSnapshot& snap : buffers) {
+			bytes += (snap.responses.capacity() + snap.weights.capacity()) * sizeof(float);
+		}
+		return bytes;
+	}
+}
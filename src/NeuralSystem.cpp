@@ -21,33 +21,122 @@
 #include "NeuralSystem.h"
 #include "NeuralFilter.h"
 #include "NeuralFlowPane.h"
+#include "NeuralProfiler.h"
+#include <cstring>
+#include <list>
 
 using namespace aly;
 namespace tgr {
 	void NeuralSystem::backpropagate() {
 		for (int n = (int)filters.size() - 1; n >= 0; n--) {
+			TGR_PROFILE_SCOPE_STRING(filters[n]->getName(), "backpropagate");
 			filters[n]->backpropagate();
 		}
 	}
+	void NeuralSystem::mapKnowledge(const std::string& file, bool verify) {
+		NeuralModelFilePtr model(new NeuralModelFile(file, verify));
+		if (!arena.isAllocated()) {
+			throw std::runtime_error("System must be initialized before mapping " + file);
+		}
+		if (model->getHeader().stride != arena.getStride()) {
+			throw std::runtime_error("Model layout does not match the system:" + file);
+		}
+		for (const NeuralLayerPtr& layer : layers) {
+			const ArenaBlock& block = arena.getBlock(*layer);
+			const ModelLayerEntry* entry = model->findLayer(layer->getId());
+			if (entry == nullptr || entry->arenaOffset != block.offset || entry->weights != block.weights || entry->biasWeights != block.biasWeights) {
+				throw std::runtime_error(MakeString() << "Model layout does not match layer " << layer->getName() << ":" << file);
+			}
+		}
+		//The mapping is read-only, which is enforced by refusing to optimize while mapped.
+		float* weights = const_cast<float*>(model->getWeights());
+		for (const NeuralLayerPtr& layer : layers) {
+			layer->bindWeights(weights + arena.getBlock(*layer).offset);
+		}
+		mappedModel = model;
+		invalidate();
+	}
+	void NeuralSystem::unmapKnowledge() {
+		if (mappedModel.get() == nullptr)return;
+		std::memcpy(arena.getWeights(), mappedModel->getWeights(), arena.getStride() * sizeof(float));
+		arena.markDirty();
+		arena.rebindWeights(layers);
+		mappedModel.reset();
+		invalidate();
+	}
 	void NeuralSystem::setKnowledge(const NeuralKnowledge& k) {
+		unmapKnowledge();
 		knowledge = k;
-		for (NeuralLayerPtr layer : layers) {
-			layer->set(k.getWeights(*layer), k.getBiasWeights(*layer));
+		//Optimizer state is only restored when it was saved by the same kind of optimizer.
+		bool restoreState = (arena.isAllocated() && optimizer.get() != nullptr && k.getOptimizer() == (int)optimizer->getType() && k.getStateSize() == arena.getStateSize());
+		//Knowledge taken from this arena has the same layout, so only chunks that differ are copied.
+		bool sameLayout = arena.isAllocated() && k.getLayouts().size() == arena.getBlocks().size();
+		for (auto iter = arena.getBlocks().begin(); sameLayout && iter != arena.getBlocks().end(); iter++) {
+			auto pos = k.getLayouts().find(iter->first);
+			sameLayout = (pos != k.getLayouts().end() && pos->second.offset == iter->second.offset && pos->second.weights == iter->second.weights && pos->second.biasWeights == iter->second.biasWeights);
+		}
+		std::vector<size_t> changed;
+		if (sameLayout && arena.restoreWeights(k.getData(), &changed) && (!restoreState || arena.restoreState(k.getStateData()))) {
+			//Only layers whose weights actually changed need to be evaluated again.
+			for (size_t c : changed) {
+				size_t begin = c*KnowledgeStore::CHUNK_SIZE;
+				size_t end = begin + KnowledgeStore::CHUNK_SIZE;
+				for (const NeuralLayerPtr& layer : layers) {
+					const ArenaBlock& block = arena.getBlock(*layer);
+					if (block.offset < end && block.offset + block.size() > begin)layer->invalidate();
+				}
+			}
+			if (restoreState)optimizer->setStep(k.getStep());
+			return;
+		}
+		for (const NeuralLayerPtr& layer : layers) {
+			k.copyTo(*layer);
+		}
+		if (restoreState) {
+			for (const NeuralLayerPtr& layer : layers) {
+				const ArenaBlock& block = arena.getBlock(*layer);
+				for (int s = 0; s < arena.getStateSize(); s++) {
+					k.copyState(*layer, s, arena.getState(s) + block.offset);
+				}
+			}
+			arena.markDirty();
+			optimizer->setStep(k.getStep());
 		}
 	}
 	bool NeuralSystem::optimize() {
+		if (isMapped()) {
+			throw std::runtime_error("Cannot train weights mapped read-only from " + mappedModel->getFile());
+		}
+		if (optimizer.get() != nullptr&&arena.isAllocated()) {
+			bool ret = optimizer->optimize(arena.getRange());
+			arena.markDirty(0, arena.getTrainableSize());
+			for (const NeuralLayerPtr& layer : layers) {
+				if (layer->isTrainable())layer->invalidate();
+			}
+			return ret;
+		}
 		bool ret = false;
-		for (NeuralLayerPtr layer : layers) {
+		for (const NeuralLayerPtr& layer : layers) {
 			ret |= layer->optimize();
 		}
 		return ret;
 	}
 	void NeuralSystem::setOptimizer(const NeuralOptimizationPtr& opt) {
+		optimizer = opt;
 		for (auto layer : layers) {
 			if (layer->isTrainable()) {
 				layer->setOptimizer(opt);
 			}
 		}
+		if (initialized) {
+			if (arena.getStateSize() != opt->getStateSize()) {
+				arena.build(layers, opt->getStateSize());
+				mappedModel.reset();
+			}
+			else {
+				arena.zeroState();
+			}
+		}
 	}
 	double NeuralSystem::accumulate(const NeuralLayerPtr& layer, const Image1f& output) {
 		double residual = 0;
@@ -78,7 +167,7 @@ namespace tgr {
 		return residual;
 	}
 	void NeuralSystem::reset() {
-		for (NeuralLayerPtr layer : layers) {
+		for (const NeuralLayerPtr& layer : layers) {
 			layer->reset();
 		}
 	}
@@ -94,14 +183,87 @@ namespace tgr {
 	void NeuralSystem::getLayer(const NeuralLayerPtr& layer, std::vector<float>& input) {
 		layer->get(input);
 	}
-	NeuralSystem::NeuralSystem(const std::shared_ptr<aly::NeuralFlowPane>& pane) :flowPane(pane),initialized(false) {
+	NeuralSystem::NeuralSystem(const std::shared_ptr<aly::NeuralFlowPane>& pane) :flowPane(pane),initialized(false),exactGradient(false) {
 
 	}
-	void NeuralSystem::evaluate() {
+	void NeuralSystem::evaluate(bool visibleOnly) {
 		if (!initialized)initialize();
-		for (NeuralFilterPtr filter:filters) {
-			filter->evaluate();
+		if (visibleOnly) {
+			//Flags are indexed by layer id and reused across calls, so evaluation does not allocate once warm.
+			required.assign(layers.size(), 0);
+			visiting.clear();
+			for (const NeuralLayerPtr& layer : layers) {
+				if (layer->isVisible())visiting.push_back(layer.get());
+			}
+			while (!visiting.empty()) {
+				const NeuralLayer* layer = visiting.back();
+				visiting.pop_back();
+				if (required[layer->getId()])continue;
+				required[layer->getId()] = 1;
+				for (const NeuralLayer* dep : layer->getDependencies()) {
+					visiting.push_back(dep);
+				}
+			}
+		}
+		for (const NeuralFilterPtr& filter : filters) {
+			bool pending = false;
+			for (const NeuralLayerPtr& layer : filter->getOutputLayers()) {
+				pending |= (layer->isDirty() && (!visibleOnly || required[layer->getId()]));
+			}
+			if (!pending)continue;
+			TGR_PROFILE_SCOPE_STRING(filter->getName(), "evaluate");
+			if (visibleOnly) {
+				//Hidden layers stay stale until they are needed, so they are skipped individually.
+				for (const NeuralLayerPtr& layer : filter->getOutputLayers()) {
+					if (layer->isDirty() && required[layer->getId()])layer->evaluate();
+				}
+			}
+			else {
+				filter->evaluate();
+			}
+		}
+	}
+	void NeuralSystem::invalidate() {
+		for (const NeuralLayerPtr& layer : layers) {
+			layer->invalidate();
+		}
+	}
+	void NeuralSystem::publish(int64_t iteration) {
+		TGR_PROFILE_SCOPE("publish", "system");
+		for (const NeuralLayerPtr& layer : layers) {
+			layer->publish(iteration);
+		}
+	}
+	static size_t GetChunkBytes(const KnowledgeStore& store) {
+		size_t bytes = 0;
+		for (size_t c = 0; c < store.getChunkCount(); c++) {
+			if (store.getChunk(c).get() != nullptr)bytes += store.getChunk(c)->capacity() * sizeof(float);
+		}
+		return bytes;
+	}
+	SystemFootprint NeuralSystem::getFootprint() const {
+		SystemFootprint fp;
+		std::map<const NeuralLayer*, int> index;
+		for (const NeuralLayerPtr& layer : layers) {
+			index[layer.get()] = (int)fp.layers.size();
+			fp.layers.push_back(layer->getFootprint());
+			fp.total += fp.layers.back();
+		}
+		for (const NeuralFilterPtr& filter : filters) {
+			FilterFootprint ff;
+			ff.name = filter->getName();
+			ff.total.name = ff.name;
+			for (const NeuralLayerPtr& layer : filter->getOutputLayers()) {
+				auto pos = index.find(layer.get());
+				if (pos == index.end())continue;
+				ff.layers.push_back(pos->second);
+				ff.total += fp.layers[pos->second];
+			}
+			fp.filters.push_back(ff);
 		}
+		//Chunks the arena has not written since the snapshot are shared with it, and counted once here.
+		fp.knowledgeBytes = GetChunkBytes(knowledge.getData()) + GetChunkBytes(knowledge.getStateData());
+		return fp;
 	}
 	NeuralKnowledge& NeuralSystem::updateKnowledge() {
 		knowledge.set(*this);
@@ -111,7 +273,7 @@ namespace tgr {
 		roots.clear();
 		leafs.clear();
 		std::list<NeuralLayerPtr> q;
-		for (NeuralLayerPtr layer : layers) {
+		for (const NeuralLayerPtr& layer : layers) {
 			layer->setVisited(false);
 			if (layer->isRoot()) {
 				roots.push_back(layer);
@@ -127,7 +289,7 @@ namespace tgr {
 			layer->setId(index++);
 			layer->setVisited(true);
 			order.push_back(layer);
-			for (NeuralLayerPtr child : layer->getChildren()) {
+			for (const NeuralLayerPtr& child : layer->getChildren()) {
 				if (child->visitedDependencies()) {
 					q.push_back(child);
 				}
@@ -135,18 +297,22 @@ namespace tgr {
 		}
 		layers = order;
 		order.clear();
-		for (NeuralLayerPtr layer : layers) {
+		for (const NeuralLayerPtr& layer : layers) {
 			layer->setVisited(false);
 			if (layer->isLeaf()) {
 				leafs.push_back(layer);
 			}
 		}
+		//Building the arena copies the current weights, mapped or not, into the new storage.
+		arena.build(layers, (optimizer.get() != nullptr) ? optimizer->getStateSize() : 0);
+		mappedModel.reset();
 		initializeWeights(0.0f, 1.0f);
 		knowledge.set(*this);
 		initialized = true;
 	}
 	void NeuralSystem::initializeWeights(float minW, float maxW) {
-		for (NeuralLayerPtr layer : layers) {
+		unmapKnowledge();
+		for (const NeuralLayerPtr& layer : layers) {
 			layer->initializeWeights(minW, maxW);
 		}
 	}
@@ -170,7 +336,7 @@ namespace tgr {
 		TreeItemPtr root = TreeItemPtr(new TreeItem("Neural Layers"));
 		tree->addItem(root);
 		root->setExpanded(true);
-		for (NeuralLayerPtr n : roots) {
+		for (const NeuralLayerPtr& n : roots) {
 			n->initialize(tree, root);
 		}
 	}
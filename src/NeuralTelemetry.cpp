@@ -0,0 +1,94 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralTelemetry.h"
+#include <algorithm>
+namespace tgr {
+	TelemetryRing::TelemetryRing(int log2Capacity) :events(size_t(1) << log2Capacity), mask((uint64_t(1) << log2Capacity) - 1), head(0), tail(0), dropped(0) {
+	}
+	size_t TelemetryRing::drain(std::vector<TelemetryEvent>& out) {
+		uint64_t t = tail.load(std::memory_order_relaxed);
+		uint64_t h = head.load(std::memory_order_acquire);
+		for (uint64_t i = t; i < h; i++) {
+			out.push_back(events[i&mask]);
+		}
+		tail.store(h, std::memory_order_release);
+		return size_t(h - t);
+	}
+	void TelemetryRing::clear() {
+		tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+		dropped.store(0);
+	}
+	DecimatedSeries::DecimatedSeries(size_t maxBuckets) :origin(0), width(1), maxBuckets(std::max(maxBuckets, size_t(2))) {
+	}
+	void DecimatedSeries::clear() {
+		buckets.clear();
+		origin = 0;
+		width = 1;
+	}
+	void DecimatedSeries::add(int64_t iteration, float value) {
+		if (buckets.size() == 0) {
+			origin = iteration;
+		}
+		int64_t index = (iteration - origin) / width;
+		if (buckets.size() > 0 && buckets.back().index == index) {
+			Bucket& b = buckets.back();
+			b.minValue = std::min(b.minValue, value);
+			b.maxValue = std::max(b.maxValue, value);
+			return;
+		}
+		Bucket b = { index, value, value };
+		buckets.push_back(b);
+		if (buckets.size() > maxBuckets) {
+			merge();
+		}
+	}
+	void DecimatedSeries::merge() {
+		width *= 2;
+		size_t n = 0;
+		for (size_t i = 0; i < buckets.size(); i++) {
+			Bucket b = buckets[i];
+			b.index /= 2;
+			if (n > 0 && buckets[n - 1].index == b.index) {
+				Bucket& last = buckets[n - 1];
+				last.minValue = std::min(last.minValue, b.minValue);
+				last.maxValue = std::max(last.maxValue, b.maxValue);
+			}
+			else {
+				buckets[n++] = b;
+			}
+		}
+		buckets.resize(n);
+	}
+	void DecimatedSeries::getPoints(std::vector<aly::float2>& points) const {
+		points.clear();
+		points.reserve(buckets.size() * 2);
+		for (const Bucket& b : buckets) {
+			float x = float(origin + b.index*width);
+			if (b.minValue == b.maxValue) {
+				points.push_back(aly::float2(x, b.minValue));
+			}
+			else {
+				points.push_back(aly::float2(x, b.minValue));
+				points.push_back(aly::float2(x + 0.5f*width, b.maxValue));
+			}
+		}
+	}
+}
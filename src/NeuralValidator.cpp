@@ -0,0 +1,174 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralValidator.h"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <omp.h>
+namespace tgr {
+	NeuralValidator::NeuralValidator(const NeuralModelBuilder& builder, const Stager& stager, const Labeler& labeler, int sampleCount, int classes) :
+		builder(builder), stager(stager), labeler(labeler), sampleCount(sampleCount), classes(classes), busy(false), stopRequested(false), patience(0), minDelta(0.0), bestLoss(1E30), sinceBest(0), stopTraining(false) {
+	}
+	NeuralValidator::~NeuralValidator() {
+		stop();
+	}
+	void NeuralValidator::initialize(int threads) {
+		join();
+		if (threads <= 0) {
+			//Leaves most cores to training.
+			threads = std::max(1, (int)std::thread::hardware_concurrency() / 4);
+		}
+		threads = std::min(threads, std::max(sampleCount, 1));
+		while ((int)replicas.size() < threads) {
+			NeuralSystemPtr replica(new NeuralSystem(nullptr));
+			builder(*replica);
+			replica->initialize();
+			replicas.push_back(replica);
+		}
+		replicas.resize(threads);
+	}
+	void NeuralValidator::stop() {
+		stopRequested = true;
+		join();
+	}
+	void NeuralValidator::join() {
+		if (worker.joinable()) {
+			worker.join();
+		}
+	}
+	void NeuralValidator::reset() {
+		stop();
+		std::lock_guard<std::mutex> lockMe(lock);
+		latest = ValidationResult();
+		bestLoss = 1E30;
+		sinceBest = 0;
+		stopTraining = false;
+		stopRequested = false;
+	}
+	ValidationResult NeuralValidator::getLatest() {
+		std::lock_guard<std::mutex> lockMe(lock);
+		return latest;
+	}
+	bool NeuralValidator::submit(int iteration, const std::shared_ptr<NeuralKnowledge>& k) {
+		if (busy.load() || replicas.size() == 0 || sampleCount == 0) {
+			return false;
+		}
+		//The previous evaluation has finished, so this only reclaims the thread.
+		join();
+		busy = true;
+		worker = std::thread(&NeuralValidator::run, this, iteration, k);
+		return true;
+	}
+	void NeuralValidator::run(int iteration, std::shared_ptr<NeuralKnowledge> k) {
+		auto start = std::chrono::steady_clock::now();
+		int R = (int)replicas.size();
+		std::vector<double> losses(R, 0.0);
+		std::vector<std::vector<int>> confusions(R, std::vector<int>(classes*classes, 0));
+		std::vector<std::thread> threads;
+		for (int r = 0; r < R; r++) {
+			threads.push_back(std::thread([this, r, R, &k, &losses, &confusions]() {
+				//Layers evaluate with OpenMP. One thread per replica keeps validation from competing with training for every core.
+				omp_set_num_threads(1);
+				NeuralSystem& replica = *replicas[r];
+				replica.setKnowledge(*k);
+				NeuralLayerPtr input = replica.getInput();
+				NeuralLayerPtr output = replica.getOutput();
+				std::vector<float> staged(input->size());
+				std::vector<int>& confusion = confusions[r];
+				for (int s = r; s < sampleCount && !stopRequested; s += R) {
+					stager(staged.data(), s);
+					input->set(staged.data(), staged.size());
+					replica.evaluate();
+					int label = labeler(s);
+					const Knowledge& responses = output->getResponses();
+					int N = (int)responses.size();
+					int predicted = 0;
+					double err = 0.0;
+					for (int n = 0; n < N; n++) {
+						float v = responses[n];
+						float target = (n == label) ? 1.0f : 0.0f;
+						err += (v - target)*(v - target);
+						if (v > responses[predicted]) {
+							predicted = n;
+						}
+					}
+					losses[r] += 0.5*err;
+					if (label >= 0 && label < classes && predicted < classes) {
+						confusion[label*classes + predicted]++;
+					}
+				}
+			}));
+		}
+		for (std::thread& t : threads) {
+			t.join();
+		}
+		//A canceled pass only covers part of the set, so it is not reported.
+		if (stopRequested) {
+			busy = false;
+			return;
+		}
+		ValidationResult result;
+		result.iteration = iteration;
+		result.samples = sampleCount;
+		result.classes = classes;
+		result.confusion.assign(classes*classes, 0);
+		double loss = 0.0;
+		for (int r = 0; r < R; r++) {
+			loss += losses[r];
+			for (int c = 0; c < classes*classes; c++) {
+				result.confusion[c] += confusions[r][c];
+			}
+		}
+		int correct = 0;
+		for (int c = 0; c < classes; c++) {
+			correct += result.confusion[c*classes + c];
+		}
+		result.loss = loss / sampleCount;
+		result.accuracy = correct / double(sampleCount);
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		{
+			std::lock_guard<std::mutex> lockMe(lock);
+			latest = result;
+			if (result.loss < bestLoss - minDelta) {
+				bestLoss = result.loss;
+				sinceBest = 0;
+			}
+			else {
+				sinceBest++;
+				if (patience > 0 && sinceBest >= patience) {
+					stopTraining = true;
+				}
+			}
+		}
+		std::cout << "Validation [" << iteration << "] Accuracy=" << std::setprecision(4) << 100.0*result.accuracy << "% Loss=" << result.loss << " (" << result.seconds << " s)" << std::endl;
+		for (int c = 0; c < classes; c++) {
+			for (int p = 0; p < classes; p++) {
+				std::cout << std::setw(6) << result.getCount(c, p);
+			}
+			std::cout << std::endl;
+		}
+		if (onResult) {
+			onResult(result);
+		}
+		busy = false;
+	}
+}
@@ -38,23 +38,23 @@ namespace tgr {
 	int64_t Signal::ID_COUNT = 0;
 	std::vector<Neuron*> Neuron::getInputNeurons()  const {
 		std::vector<Neuron*> out;
-		for (SignalPtr sig : input) {
-			auto in = sig->getForward(this);
+		for (const SignalPtr& sig : input) {
+			const std::vector<Neuron*>& in = sig->getForward(this);
 				out.insert(out.end(), in.begin(), in.end());
 		}
 		return out;
 	}
 	void Neuron::getInputNeurons(std::vector<Neuron*>& out) const {
 		out.clear();
-		for (SignalPtr sig : input) {
-			auto in = sig->getForward(this);
+		for (const SignalPtr& sig : input) {
+			const std::vector<Neuron*>& in = sig->getForward(this);
 			out.insert(out.end(), in.begin(), in.end());
 		}
 	}
 	std::vector<const Neuron*> Neuron::getOutputNeurons() const {
 		std::vector<const Neuron*> out;
-		for (SignalPtr sig : output) {
-			for (auto pr : sig->forwardMapping) {
+		for (const SignalPtr& sig : output) {
+			for (const auto& pr : sig->forwardMapping) {
 				out.push_back(pr.first);
 			}
 		}
@@ -62,8 +62,8 @@ namespace tgr {
 	}
 	void Neuron::getOutputNeurons(std::vector<const Neuron*>& out) const {
 		out.clear();
-		for (SignalPtr sig : output) {
-			for (auto pr : sig->forwardMapping) {
+		for (const SignalPtr& sig : output) {
+			for (const auto& pr : sig->forwardMapping) {
 				out.push_back(pr.first);
 			}
 		}
@@ -72,13 +72,13 @@ namespace tgr {
 		/*
 		std::cout << "====== Neuron " << id << " ======" << std::endl;
 		std::cout << "Input: " << input.size() << " Output: " << output.size() << std::endl;
-		for (SignalPtr sig : output) {
+		for (const SignalPtr& sig : output) {
 			std::cout << "***** Output Signal: " << sig->id << std::endl;
 			for (Neuron* inner : sig->getBackward(this)) {
 				std::cout << "***** Output Neuron: " << inner->id << std::endl;
 			}
 		}
-		for (SignalPtr sig : input) {
+		for (const SignalPtr& sig : input) {
 			std::cout << "+++++ Input Signal: " << sig->id << std::endl;
 			for (Neuron* inner : sig->getForward(this)) {
 				std::cout << "+++++ Input Neuron: " << inner->id << std::endl;
@@ -89,12 +89,12 @@ namespace tgr {
 	std::string Neuron::getType() const {
 		return aly::MakeString() << transform.type();
 	}
-	float Neuron::backpropagate() {
+	float Neuron::backpropagate(bool exact) {
 		float sum1 = 0.0f,sum2;
 		int count = 0;
 		if (output.size() > 0) {
 			//std::cout << "dw= [";
-			for (SignalPtr sig : output) {
+			for (const SignalPtr& sig : output) {
 				sum2 = 0.0f;
 				for (Neuron* inner : sig->getBackward(this)) {
 					sum2 += *inner->change;
@@ -104,10 +104,15 @@ namespace tgr {
 				//std::cout << std::setfill(' ') << std::setw(5) << aly::round(*sig->weight, 3) << " * [" << aly::round(sum2, 3) << "] ";
 			}
 			//Normalize change so that derivative doesn't blow up
-			*change = sum1*transform.change(*value) / count;
+			*change = sum1*transform.change(*value);
+			if (!exact)*change /= count;
+		}
+		//evaluate() averages its inputs, so the exact derivative carries the same 1/count.
+		if (exact && input.size() > 0) {
+			*change /= (float)getInputNeuronSize();
 		}
 		//std::cout << "] " << change << std::endl;
-		for (SignalPtr sig : input) {
+		for (const SignalPtr& sig : input) {
 			sum2 = 0.0f;
 			for (Neuron* inner : sig->getForward(this)) {
 				sum2 += *inner->value;
@@ -122,7 +127,7 @@ namespace tgr {
 		int count = 0;
 		if (input.size() > 0) {
 			//if (debug)std::cout << "w= [";
-			for (SignalPtr sig : input) {
+			for (const SignalPtr& sig : input) {
 				sum2 = 0.0f;
 				for (Neuron* inner : sig->getForward(this)) {
 					sum2 += *inner->value;
@@ -0,0 +1,266 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "ShardDataset.h"
+#include "HalfFloat.h"
+#include "IDXDataset.h"
+#include "NeuralLayer.h"
+#include <AlloyMath.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+namespace tgr {
+	static const char SHARD_MAGIC[4] = { 'T', 'G', 'R', 'S' };
+	static const uint32_t SHARD_VERSION = 1;
+	static size_t GetValueSize(ShardEncoding encoding) {
+		switch (encoding) {
+			case ShardEncoding::UInt8: return 1;
+			case ShardEncoding::Float16: return 2;
+			case ShardEncoding::Float32: return 4;
+		}
+		throw std::runtime_error("Unknown shard encoding.");
+	}
+	std::string ShardWriter::GetShardFile(const std::string& prefix, int shard) {
+		std::stringstream ss;
+		ss << prefix << "-" << std::setw(5) << std::setfill('0') << shard << ".tgrs";
+		return ss.str();
+	}
+	std::string ShardWriter::GetShardPrefix(const std::string& file) {
+		size_t suffix = std::string("-00000.tgrs").size();
+		return (file.size() > suffix) ? file.substr(0, file.size() - suffix) : file;
+	}
+	ShardWriter::ShardWriter(const std::string& prefix, ShardEncoding encoding, int width, int height, int recordsPerShard, float scaleMin, float scaleMax) :
+		prefix(prefix), encoding(encoding), recordsPerShard(std::max(1, recordsPerShard)) {
+		std::memset(&header, 0, sizeof(ShardHeader));
+		std::memcpy(header.magic, SHARD_MAGIC, sizeof(SHARD_MAGIC));
+		header.version = SHARD_VERSION;
+		header.encoding = (uint32_t)encoding;
+		header.width = width;
+		header.height = height;
+		header.channels = 1;
+		header.recordStride = (width*height*GetValueSize(encoding) + 63) & ~(size_t)63;
+		header.scaleMin = scaleMin;
+		header.scaleMax = scaleMax;
+		record.resize(header.recordStride);
+	}
+	ShardWriter::~ShardWriter() {
+		//Destructors must not throw. Call close() to see write errors.
+		try {
+			close();
+		}
+		catch (std::exception& e) {
+			std::cout << "Shard writer: " << e.what() << std::endl;
+		}
+	}
+	void ShardWriter::openShard() {
+		std::string file = GetShardFile(prefix, (int)files.size());
+		out.open(file, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) {
+			throw std::runtime_error("Could not create shard " + file);
+		}
+		files.push_back(file);
+		index.clear();
+		out.write((const char*)&header, sizeof(ShardHeader));
+	}
+	void ShardWriter::closeShard() {
+		if (!out.is_open())return;
+		ShardHeader h = header;
+		h.recordCount = index.size();
+		h.indexOffset = sizeof(ShardHeader) + h.recordCount*h.recordStride;
+		out.write((const char*)index.data(), index.size() * sizeof(ShardIndexEntry));
+		out.seekp(0);
+		out.write((const char*)&h, sizeof(ShardHeader));
+		out.close();
+		if (out.fail()) {
+			throw std::runtime_error("Could not write shard " + files.back());
+		}
+		index.clear();
+	}
+	void ShardWriter::add(const float* data, int label, uint32_t source) {
+		if (!out.is_open()) {
+			openShard();
+		}
+		size_t N = (size_t)header.width*header.height*header.channels;
+		switch (encoding) {
+			case ShardEncoding::UInt8: {
+				float scale = 255.0f / std::max(header.scaleMax - header.scaleMin, 1E-30f);
+				for (size_t n = 0; n < N; n++) {
+					record[n] = (uint8_t)aly::clamp((int)std::floor((data[n] - header.scaleMin)*scale + 0.5f), 0, 255);
+				}
+			}
+				break;
+			case ShardEncoding::Float16: {
+				uint16_t* dst = (uint16_t*)record.data();
+				for (size_t n = 0; n < N; n++) {
+					dst[n] = FloatToHalf(data[n]);
+				}
+			}
+				break;
+			case ShardEncoding::Float32:
+				std::memcpy(record.data(), data, N * sizeof(float));
+				break;
+		}
+		out.write((const char*)record.data(), record.size());
+		ShardIndexEntry entry = { label, source };
+		index.push_back(entry);
+		if ((int)index.size() >= recordsPerShard) {
+			closeShard();
+		}
+	}
+	void ShardWriter::close() {
+		closeShard();
+		if (files.size() == 0)return;
+		//Shards left over from a longer earlier run with the same prefix would otherwise be opened as part of this set.
+		for (int n = (int)files.size();; n++) {
+			std::string file = GetShardFile(prefix, n);
+			if (!std::ifstream(file).good())break;
+			if (std::remove(file.c_str()) != 0) {
+				throw std::runtime_error("Could not remove stale shard " + file);
+			}
+		}
+	}
+	ShardDataset::ShardDataset() :count(0), imageWidth(0), imageHeight(0) {
+	}
+	ShardDataset::ShardDataset(const std::string& prefix) : ShardDataset() {
+		open(prefix);
+	}
+	void ShardDataset::open(const std::string& prefix) {
+		std::vector<std::string> files;
+		while (true) {
+			std::string file = ShardWriter::GetShardFile(prefix, (int)files.size());
+			if (!std::ifstream(file).good())break;
+			files.push_back(file);
+		}
+		if (files.size() == 0) {
+			throw std::runtime_error("No shards found for " + prefix);
+		}
+		open(files);
+	}
+	void ShardDataset::open(const std::vector<std::string>& files) {
+		shards.clear();
+		count = 0;
+		for (const std::string& file : files) {
+			std::unique_ptr<Shard> shard(new Shard());
+			shard->file.open(file);
+			const uint8_t* ptr = shard->file.ptr();
+			const ShardHeader* header = (const ShardHeader*)ptr;
+			if (shard->file.size() < sizeof(ShardHeader) || std::memcmp(header->magic, SHARD_MAGIC, sizeof(SHARD_MAGIC)) != 0 || header->version != SHARD_VERSION) {
+				throw std::runtime_error("Not a shard file:" + file);
+			}
+			size_t recordSize = (size_t)header->width*header->height*header->channels*GetValueSize((ShardEncoding)header->encoding);
+			if (header->recordStride < recordSize || header->indexOffset < sizeof(ShardHeader) + header->recordCount*header->recordStride || header->indexOffset + header->recordCount * sizeof(ShardIndexEntry) > shard->file.size()) {
+				throw std::runtime_error("Shard file is truncated:" + file);
+			}
+			if (shards.size() == 0) {
+				imageWidth = header->width;
+				imageHeight = header->height;
+			}
+			else if ((int)header->width != imageWidth || (int)header->height != imageHeight) {
+				throw std::runtime_error("Shard record size does not match the first shard:" + file);
+			}
+			shard->header = header;
+			shard->records = ptr + sizeof(ShardHeader);
+			shard->index = (const ShardIndexEntry*)(ptr + header->indexOffset);
+			shard->first = count;
+			shard->count = (int)header->recordCount;
+			count += shard->count;
+			shards.push_back(std::move(shard));
+		}
+	}
+	int ShardDataset::findShard(int idx) const {
+		if (idx < 0 || idx >= count) {
+			throw std::runtime_error(aly::MakeString() << "Shard record " << idx << " out of range [0," << count << ")");
+		}
+		int lo = 0;
+		int hi = (int)shards.size() - 1;
+		while (lo < hi) {
+			int mid = (lo + hi + 1) / 2;
+			if (shards[mid]->first <= idx) {
+				lo = mid;
+			}
+			else {
+				hi = mid - 1;
+			}
+		}
+		return lo;
+	}
+	int ShardDataset::getLabel(int idx) const {
+		const Shard& shard = *shards[findShard(idx)];
+		return shard.index[idx - shard.first].label;
+	}
+	uint32_t ShardDataset::getSource(int idx) const {
+		const Shard& shard = *shards[findShard(idx)];
+		return shard.index[idx - shard.first].source;
+	}
+	void ShardDataset::copyTo(int idx, float* dst) const {
+		Shard& shard = *shards[findShard(idx)];
+		const ShardHeader& header = *shard.header;
+		if (!shard.touched.exchange(true)) {
+			shard.file.prefetch(sizeof(ShardHeader), (size_t)header.recordCount*header.recordStride);
+		}
+		const uint8_t* src = shard.records + (size_t)(idx - shard.first)*header.recordStride;
+		int N = (int)(header.width*header.height*header.channels);
+		switch ((ShardEncoding)header.encoding) {
+			case ShardEncoding::UInt8:
+				ConvertBytes(src, dst, N, (header.scaleMax - header.scaleMin) / 255.0f, header.scaleMin);
+				break;
+			case ShardEncoding::Float16: {
+				const uint16_t* h = (const uint16_t*)src;
+				for (int n = 0; n < N; n++) {
+					dst[n] = HalfToFloat(h[n]);
+				}
+			}
+				break;
+			case ShardEncoding::Float32:
+				std::memcpy(dst, src, N * sizeof(float));
+				break;
+		}
+	}
+	void ShardDataset::copyTo(int idx, NeuralLayer& layer) const {
+		if (layer.width != width() || layer.height != height() || layer.responses.size() < (size_t)(width()*height())) {
+			throw std::runtime_error(aly::MakeString() << "Shard record size " << width() << "x" << height() << " does not match layer " << layer.getName());
+		}
+		copyTo(idx, layer.responses.ptr());
+		layer.setRegionDirty(true);
+	}
+	void ShardDataset::shuffle(std::vector<int>& indexes, std::mt19937& rng) const {
+		std::vector<std::vector<int>> groups(shards.size());
+		for (int idx : indexes) {
+			groups[findShard(idx)].push_back(idx);
+		}
+		std::vector<int> order(shards.size());
+		for (int s = 0; s < (int)order.size(); s++) {
+			order[s] = s;
+			//Pages of a shard may have been evicted since the last pass, so prefetch again on next touch.
+			shards[s]->touched = false;
+		}
+		std::shuffle(order.begin(), order.end(), rng);
+		indexes.clear();
+		for (int s : order) {
+			std::shuffle(groups[s].begin(), groups[s].end(), rng);
+			indexes.insert(indexes.end(), groups[s].begin(), groups[s].end());
+		}
+	}
+}
@@ -27,20 +27,12 @@
 #include "AlloyDrawUtil.h"
 #include "FullyConnectedFilter.h"
 #include "MNIST.h"
+#include "NeuralModels.h"
+#include "IDXDataset.h"
+#include "AlloyFileUtil.h"
+#include <cstring>
 using namespace aly;
 using namespace tgr;
-#define O true
-#define X false
-static const bool MNIST_TABLE[] = {
-	O, X, X, X, O, O, O, X, X, O, O, O, O, X, O, O,
-	O, O, X, X, X, O, O, O, X, X, O, O, O, O, X, O,
-	O, O, O, X, X, X, O, O, O, X, X, O, X, O, O, O,
-	X, O, O, O, X, X, O, O, O, O, X, X, O, X, O, O,
-	X, X, O, O, O, X, X, O, O, O, O, X, O, O, X, O,
-	X, X, X, O, O, O, X, X, O, O, O, O, X, O, O, O
-};
-#undef O
-#undef X
 TigerApp::TigerApp(int example) :
 	Application(1800, 800, "Tiger Machine",true),exampleIndex(example), selectedLayer(nullptr){
 }
@@ -49,15 +41,26 @@ void TigerApp::setSampleIndex(int idx){
 	sampleIndex.setValue(idx);
 	tweenRegion->setValue(idx);
 	valueRegion->setNumberValue(sampleIndex);
-	sys->getInput()->set(trainInputData[idx]);
-	sys->evaluate();
+	//The runtime owns the system while training. The sample is applied by finishTraining().
+	if (running) return;
+	if (worker->inputSampler)worker->inputSampler(sys->getInput(), idx);
+	sys->evaluate(true);
 }
 void TigerApp::setNeuralTime(int idx) {
-	auto elem = worker->getCache()->get(idx);
-	if (elem.get() != nullptr) {
-		sys->setKnowledge(*elem->getKnowledge());
-		sys->evaluate();
+	if (running) {
+		pendingTime = idx;
+		return;
+	}
+	NeuralHistoryPtr history = worker->getHistory();
+	NeuralCachePtr cache = worker->getCache();
+	int frame = history->getFloor(idx);
+	std::shared_ptr<NeuralKnowledge> k = cache->get(frame);
+	if (k.get() != nullptr) {
+		sys->setKnowledge(*k);
+		sys->evaluate(true);
 	}
+	//Scrubbing moves one frame at a time, so keep the frames on either side decoded.
+	cache->prefetch(history->getNeighbors(frame, 4));
 }
 void TigerApp::setSampleRange(int mn, int mx){
 	minIndex = mn;
@@ -97,6 +100,8 @@ bool TigerApp::init(Composite& rootNode) {
 	
 	trainFile=getFullPath("data/train-images.idx3-ubyte");
 	trainLabelFile = getFullPath("data/train-labels.idx1-ubyte");
+	evalFile = getFullPath("data/t10k-images.idx3-ubyte");
+	evalLabelFile = getFullPath("data/t10k-labels.idx1-ubyte");
 	controls->addFileField("Train Images",trainFile);
 	controls->addFileField("Train Labels", trainLabelFile);
 
@@ -236,7 +241,7 @@ bool TigerApp::init(Composite& rootNode) {
 	stopButton->borderColor = MakeColor(getContext()->theme.LIGHTEST);
 	playButton->onMouseDown = [this](AlloyContext* context, const InputEvent& e) {
 		if (e.button == GLFW_MOUSE_BUTTON_LEFT) {
-			worker->cancel();
+			worker->stop();
 			stopButton->setVisible(true);
 			playButton->setVisible(false);
 			timelineSlider->setTimeValue(0);
@@ -245,7 +250,9 @@ bool TigerApp::init(Composite& rootNode) {
 			timelineSlider->setMaxValue((int)worker->getMaxIteration());
 			timelineSlider->setVisible(true);
 			worker->init();
-			worker->execute();
+			pendingTime = -1;
+			running = true;
+			worker->start();
 			return true;
 		}
 		return false;
@@ -254,8 +261,9 @@ bool TigerApp::init(Composite& rootNode) {
 		if (e.button == GLFW_MOUSE_BUTTON_LEFT) {
 			stopButton->setVisible(false);
 			playButton->setVisible(true);
-			worker->cancel();
-			//running = false;
+			worker->stop();
+			worker->cleanup();
+			finishTraining();
 			return true;
 		}
 		return false;
@@ -336,16 +344,8 @@ bool TigerApp::init(Composite& rootNode) {
 		
 	});
 	initialize();
+	//Called on the training thread. Training is wrapped up in draw() once the task has exited.
 	worker->onUpdate = [this](int iteration, bool lastIteration) {
-		graphRegion->updateGraphBounds();
-		if (lastIteration || (int)iteration == timelineSlider->getMaxValue().toInteger()) {
-			running = false;
-			stopButton->setVisible(false);
-			playButton->setVisible(true);
-			AlloyApplicationContext()->addDeferredTask([this]() {
-				setSampleIndex(sampleIndex.toInteger());
-			});
-		}
 		AlloyApplicationContext()->addDeferredTask([this]() {
 			timelineSlider->setUpperValue((int)worker->getIteration());
 			timelineSlider->setTimeValue((int)worker->getIteration());
@@ -413,21 +413,19 @@ bool TigerApp::initializeWaves() {
 	int dir = 4;
 	float freq = 0.1f;
 	int shifts = 4;
-	ConvolutionFilterPtr firstFilter(new ConvolutionFilter(w, h, 5, 2, true));
-	sys->add(firstFilter);
-
-	FullyConnectedFilterPtr secondFilter(new FullyConnectedFilter("Output Layer", firstFilter->getOutputLayers(), dir, 1, true));
-	sys->add(secondFilter);
-
-	secondFilter->getOutputLayer(0)->setFunction(tgr::Linear());
-	sys->setInput(firstFilter->getInputLayer(0));
-	sys->setOutput(secondFilter->getOutputLayer(0));
+	MakeWaves(*sys, w, h, dir);
 	worker.reset(new NeuralRuntime(sys));
-
+	worker->setModelBuilder([=](NeuralSystem& replica) {
+		MakeWaves(replica, w, h, dir);
+	});
 	worker->inputSampler = [this](const NeuralLayerPtr& input, int idx) {
 		aly::Image1f& inputData = trainInputData[idx];
 		input->set(inputData);
 	};
+	worker->inputStager = [this](float* input, int idx) {
+		const aly::Image1f& inputData = trainInputData[idx];
+		std::memcpy(input, inputData.ptr(), inputData.size() * sizeof(float));
+	};
 	worker->outputSampler = [this,dir](std::vector<float>& outputData, int idx) {
 		int out = trainOutputData[idx];
 		outputData.resize(dir);
@@ -463,22 +461,17 @@ bool TigerApp::initializeWaves() {
 }
 
 bool TigerApp::initializeXOR() {
-	FullyConnectedFilterPtr firstFilter(new FullyConnectedFilter("First Layer",2,2, 2, 2,true));
-	sys->add(firstFilter);
-
-	FullyConnectedFilterPtr secondFilter(new FullyConnectedFilter("Second Layer",firstFilter->getOutputLayer(0), 2, 2, true));
-	sys->add(secondFilter);
-
-	FullyConnectedFilterPtr thirdFilter(new FullyConnectedFilter("Output Layer", secondFilter->getOutputLayer(0), 1, 1, true));
-	sys->add(thirdFilter);
-	thirdFilter->getOutputLayer(0)->setFunction(tgr::Linear());
-	sys->setInput(firstFilter->getInputLayer(0));
-	sys->setOutput(thirdFilter->getOutputLayer(0));
+	MakeXOR(*sys);
 	worker.reset(new NeuralRuntime(sys));
+	worker->setModelBuilder(MakeXOR);
 	worker->inputSampler = [this](const NeuralLayerPtr& input, int idx) {
 		aly::Image1f& inputData = trainInputData[idx];
 		input->set(inputData);
 	};
+	worker->inputStager = [this](float* input, int idx) {
+		const aly::Image1f& inputData = trainInputData[idx];
+		std::memcpy(input, inputData.ptr(), inputData.size() * sizeof(float));
+	};
 	worker->outputSampler = [this](std::vector<float>& outputData, int idx) {
 		int out = trainOutputData[idx];
 		outputData.resize(1);
@@ -505,64 +498,87 @@ bool TigerApp::initializeXOR() {
 	return true;
 }
 bool TigerApp::initializeLeNet5() {
-	parse_mnist_images(trainFile, trainInputData, 0.0f, 1.0f, 2, 2);
-	parse_mnist_labels(trainLabelFile, trainOutputData);
-	if (trainInputData.size() > 0) {
-		trainInputData.erase(trainInputData.begin() + 100, trainInputData.end());
-		trainOutputData.erase(trainOutputData.begin() + 100, trainOutputData.end());
-		const Image1f& ref = trainInputData[0];
-		ConvolutionFilterPtr conv1(new ConvolutionFilter(ref.width, ref.height, 5, 6,false));
-		conv1->setName("conv1");
-		sys->add(conv1,Tanh());
-		std::vector<NeuralLayerPtr> all;
-		for (int i = 0; i < conv1->getOutputSize(); i++) {
-			AveragePoolFilterPtr avg1(new AveragePoolFilter(conv1->getOutputLayer(i), 2, true));
-			avg1->setName(MakeString() << "Sub-Sample [" << i << "]");
-			sys->add(avg1, Tanh());
-			all.push_back(avg1->getOutputLayer(0));
-		}
-
-		ConvolutionFilterPtr conv2(new ConvolutionFilter(all, 5, 16, true));
-		conv1->setName("conv2");
-		std::vector<std::pair<int, int>> connectionTable;
-		for (int ii = 0; ii < 6; ii++) {
-			for (int jj = 0; jj < 16; jj++) {
-				if (MNIST_TABLE[jj + ii * 16]) {
-					connectionTable.push_back(std::pair<int, int>(ii, jj));
-				}
-			}
-		}
-		conv2->setConnectionMap(connectionTable);
-		sys->add(conv2, Tanh());
-
-		all.clear();
-		for (int i = 0; i < conv2->getOutputSize(); i++) {
-			AveragePoolFilterPtr avg2(new AveragePoolFilter(conv2->getOutputLayer(i), 2, true));
-			avg2->setName(MakeString() << "Sub-Sample [" << i << "]");
-			sys->add(avg2);
-			ConvolutionFilterPtr conv3(new ConvolutionFilter(avg2->getOutputLayer(0), 5, 1, true));
-			conv1->setName("conv3");
-			sys->add(conv3);
-			all.push_back(conv3->getOutputLayer(0));
-		}
-		FullyConnectedFilterPtr decisionFilter(new FullyConnectedFilter("Decision Layer", all, 10, 1, true));
-		sys->add(decisionFilter);
-		sys->setInput(conv1->getInputLayer(0));
-		sys->setOutput(decisionFilter->getOutputLayer(0));
+	std::function<void(float* input, int idx)> stager;
+	std::function<int(int idx)> labeler;
+	int width = 0;
+	int height = 0;
+	int count = 0;
+	trainShards.reset();
+	if (GetFileExtension(trainFile) == "tgrs") {
+		//TigerShard pads by the same 2 pixels as the IDX path below by default. Shards carry their own labels.
+		ShardDatasetPtr shards(new ShardDataset(ShardWriter::GetShardPrefix(trainFile)));
+		trainShards = shards;
+		width = shards->width();
+		height = shards->height();
+		count = shards->size();
+		stager = [shards](float* input, int idx) {
+			shards->copyTo(idx, input);
+		};
+		labeler = [shards](int idx) {
+			return shards->getLabel(idx);
+		};
+	}
+	else {
+		trainImages.reset(new IDXDataset(trainFile, 0.0f, 1.0f, 2, 2));
+		trainLabels.reset(new IDXDataset(trainLabelFile));
+		IDXDatasetPtr images = trainImages;
+		IDXDatasetPtr labels = trainLabels;
+		width = images->width();
+		height = images->height();
+		count = std::min(images->size(), labels->size());
+		stager = [images](float* input, int idx) {
+			images->copyTo(idx, input);
+		};
+		labeler = [labels](int idx) {
+			return (int)labels->getLabel(idx);
+		};
+	}
+	if (FileExists(evalFile) && FileExists(evalLabelFile)) {
+		evalImages.reset(new IDXDataset(evalFile, 0.0f, 1.0f, 2, 2));
+		evalLabels.reset(new IDXDataset(evalLabelFile));
+	}
+	if (count > 0) {
 		worker.reset(new NeuralRuntime(sys));
-		worker->inputSampler = [this](const NeuralLayerPtr& input, int idx) {
-			aly::Image1f& inputData = trainInputData[idx];
-			input->set(inputData);
+		//Estimated before building, since building the graph is what runs out of memory on large inputs.
+		FootprintEstimator estimator(worker->getStateSize());
+		EstimateLeNet5(estimator, width, height);
+		std::cout << "LeNet5 [" << width << "x" << height << "] needs about " << estimator.getFootprint().getBytes() / (1024.0*1024.0) << " MB" << std::endl;
+		MakeLeNet5(*sys, width, height);
+		worker->setModelBuilder([=](NeuralSystem& replica) {
+			MakeLeNet5(replica, width, height);
+		});
+		worker->inputSampler = [stager](const NeuralLayerPtr& input, int idx) {
+			stager(input->getResponses().ptr(), idx);
+			input->setRegionDirty(true);
 		};
-		worker->outputSampler = [this](std::vector<float>& outputData, int idx) {
-			int out = trainOutputData[idx];
+		worker->inputStager = stager;
+		if (trainShards.get() != nullptr) {
+			ShardDatasetPtr shards = trainShards;
+			worker->sampleShuffler = [shards](std::vector<int>& samples, std::mt19937& rng) {
+				shards->shuffle(samples, rng);
+			};
+		}
+		worker->setAugmentation(NeuralAugmentationPtr(new NeuralAugmentation(2.0f, 10.0f, 0.0f, 4.0f, 0.0f)));
+		worker->outputSampler = [labeler](std::vector<float>& outputData, int idx) {
+			int out = labeler(idx);
 			outputData.resize(10);
 			for (int i = 0; i <(int)outputData.size(); i++) {
 				outputData[i] = (out == i) ? 1.0f : 0.0f;
 			}
 		};
+		if (evalImages.get() != nullptr && evalImages->size() > 0) {
+			IDXDatasetPtr images = evalImages;
+			IDXDatasetPtr labels = evalLabels;
+			worker->setValidator(NeuralValidatorPtr(new NeuralValidator([=](NeuralSystem& replica) {
+				MakeLeNet5(replica, width, height);
+			}, [images](float* input, int idx) {
+				images->copyTo(idx, input);
+			}, [labels](int idx) {
+				return (int)labels->getLabel(idx);
+			}, std::min(evalImages->size(), evalLabels->size()), 10)));
+		}
 		sys->initialize();
-		setSampleRange(0, (int)trainInputData.size() - 1);
+		setSampleRange(0, count - 1);
 		setSampleIndex(1);
 		worker->setSelectedSamples(0, 5);
 		return true;
@@ -578,7 +594,31 @@ void TigerApp::initialize() {
 	}
 	sys->initialize(expandTree);
 }
+void TigerApp::finishTraining() {
+	running = false;
+	stopButton->setVisible(false);
+	playButton->setVisible(true);
+	setSampleIndex(sampleIndex.toInteger());
+	if (pendingTime >= 0) {
+		int t = pendingTime;
+		pendingTime = -1;
+		setNeuralTime(t);
+	}
+}
 void TigerApp::draw(AlloyContext* context) {
+	if (worker.get() != nullptr && worker->updateTelemetry()) {
+		graphRegion->updateGraphBounds();
+	}
+	//Joins the task before the UI takes the system back.
+	if (running && worker->isFinished()) {
+		worker->stop();
+		finishTraining();
+	}
+	//Layers scrolled or expanded into view were skipped while hidden and may still be stale.
+	if (!running && sys.get() != nullptr && sys->isInitialized()) {
+		sys->evaluate(true);
+		sys->publish((int64_t)worker->getIteration());
+	}
 	/*
 	if (running) {
 		if (!worker->step()) {
@@ -0,0 +1,530 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralSystem.h"
+#include "NeuralFilter.h"
+#include "NeuralOptimization.h"
+#include "NeuralKnowledge.h"
+#include "ConvolutionFilter.h"
+#include "AveragePoolFilter.h"
+#include "FullyConnectedFilter.h"
+#include "NeuralModels.h"
+#include "NeuralAllocation.h"
+#include "NeuralRuntime.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+using namespace aly;
+using namespace tgr;
+/*
+ * Self-contained micro-benchmark harness for the neural hot paths. Each case
+ * reports wall time per operation together with the floating point work and
+ * memory traffic it was declared to perform, so GFLOP/s and bytes/op can be
+ * compared across revisions.
+ *
+ * Usage: TigerBench [name filter] [--min-time=seconds] [--csv]
+ *        TigerBench --audit [--steps=N]
+ *        TigerBench --footprint[=WxH]
+ *        TigerBench --gradcheck [--checks=N]
+ *
+ * --audit drives a headless NeuralRuntime through LeNet5 training steps
+ * with each first-order optimizer and counts the heap allocations made by
+ * NeuralRuntime::step() after a warm-up, including the input pipeline,
+ * snapshot and telemetry. It exits with code 2 if any steady-state step
+ * allocates. The project defines TGR_AUDIT_ALLOCATIONS so the counter is
+ * compiled in.
+ *
+ * --footprint prints the estimated memory footprint of LeNet5 for a WxH input
+ * (default 32x32), then builds the network, trains one Adam step and prints
+ * the measured footprint.
+ *
+ * --gradcheck compares the exact-mode gradient of LeNet5 against central
+ * differences of the loss L-BFGS minimizes, 0.5*sum(err^2), at N random
+ * weights. It exits with code 2 if any relative error exceeds 1%.
+ */
+struct BenchmarkResult {
+	std::string name;
+	uint64_t iterations;
+	double nsPerOp;
+	double gflops;
+	double bytesPerOp;
+};
+class Benchmark {
+protected:
+	std::string name;
+	double flopsPerOp;
+	double bytesPerOp;
+	std::function<void()> setup;
+	std::function<void()> op;
+public:
+	typedef std::chrono::high_resolution_clock Clock;
+	Benchmark(const std::string& name, double flopsPerOp, double bytesPerOp, const std::function<void()>& op, const std::function<void()>& setup = nullptr) :
+		name(name), flopsPerOp(flopsPerOp), bytesPerOp(bytesPerOp), setup(setup), op(op) {
+	}
+	std::string getName() const {
+		return name;
+	}
+	BenchmarkResult run(double minTime) {
+		if (setup)setup();
+		//Warm caches and lazily allocated state before timing.
+		op();
+		uint64_t iterations = 1;
+		double elapsed = 0.0;
+		while (true) {
+			auto start = Clock::now();
+			for (uint64_t i = 0; i < iterations; i++) {
+				op();
+			}
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+			if (elapsed >= minTime || iterations >= (1ULL << 40))break;
+			double scale = (elapsed > 0.0) ? 1.5*minTime / elapsed : 10.0;
+			iterations = std::max(iterations + 1, (uint64_t)(iterations*std::min(scale, 10.0)));
+		}
+		BenchmarkResult result;
+		result.name = name;
+		result.iterations = iterations;
+		result.nsPerOp = 1E9*elapsed / iterations;
+		result.gflops = flopsPerOp / result.nsPerOp;
+		result.bytesPerOp = bytesPerOp;
+		return result;
+	}
+};
+template<class T> inline void DoNotOptimize(const T& value) {
+	static volatile const void* sink;
+	sink = &value;
+}
+static size_t CountConnections(const NeuralLayer& layer) {
+	size_t count = 0;
+	for (const Neuron& n : layer.getNeurons()) {
+		count += n.getInputNeuronSize();
+	}
+	return count;
+}
+static size_t CountConnections(const NeuralFilter& filter) {
+	size_t count = 0;
+	for (const NeuralLayerPtr& layer : filter.getOutputLayers()) {
+		count += CountConnections(*layer);
+	}
+	return count;
+}
+//Forward pass reads a weight, a pointer to the source neuron and its value for every connection.
+static double ForwardBytes(size_t connections, size_t neurons) {
+	return double(connections)*(sizeof(float) + sizeof(Neuron*) + sizeof(float)) + double(neurons)*sizeof(float);
+}
+static NeuralSystemPtr MakeSystem() {
+	return NeuralSystemPtr(new NeuralSystem(nullptr));
+}
+static void AddNeuronBenchmarks(std::vector<Benchmark>& benchmarks) {
+	NeuralSystemPtr sys = MakeSystem();
+	FullyConnectedFilterPtr filter(new FullyConnectedFilter("Neuron", 32, 32, 10, 1, true));
+	sys->add(filter);
+	sys->initialize();
+	Neuron* neuron = filter->getOutputLayer(0)->get(0);
+	size_t inputs = neuron->getInputNeuronSize();
+	benchmarks.push_back(Benchmark("Neuron::evaluate [1024 in]", 2.0*inputs, ForwardBytes(inputs, 1), [sys, neuron]() {
+		DoNotOptimize(neuron->evaluate());
+	}));
+	Neuron* input = filter->getInputLayer(0)->get(0);
+	size_t outputs = input->getOutputWeightSize();
+	benchmarks.push_back(Benchmark("Neuron::backpropagate [10 out]", 2.0*outputs + 2.0*input->getInputNeuronSize(), ForwardBytes(outputs, 1), [sys, input]() {
+		DoNotOptimize(input->backpropagate());
+	}));
+}
+static void AddLayerBenchmarks(std::vector<Benchmark>& benchmarks) {
+	for (int size : {8, 16, 24}) {
+		NeuralSystemPtr sys = MakeSystem();
+		FullyConnectedFilterPtr filter(new FullyConnectedFilter("Layer", size, size, size, size, true));
+		sys->add(filter);
+		sys->initialize();
+		NeuralLayerPtr layer = filter->getOutputLayer(0);
+		size_t connections = CountConnections(*layer);
+		std::string dims = MakeString() << " [" << size << "x" << size << " -> " << size << "x" << size << "]";
+		benchmarks.push_back(Benchmark("NeuralLayer::evaluate" + dims, 2.0*connections, ForwardBytes(connections, layer->size()), [sys, layer]() {
+			layer->evaluate();
+		}));
+		benchmarks.push_back(Benchmark("NeuralLayer::backpropagate" + dims, 4.0*connections, 2.0*ForwardBytes(connections, layer->size()), [sys, layer]() {
+			layer->backpropagate();
+		}));
+	}
+}
+static void AddFilterBenchmarks(std::vector<Benchmark>& benchmarks) {
+	{
+		//LeNet5 C1: 32x32 input, 5x5 kernels, 6 feature maps.
+		NeuralSystemPtr sys = MakeSystem();
+		ConvolutionFilterPtr filter(new ConvolutionFilter(32, 32, 5, 6, false));
+		sys->add(filter, Tanh());
+		sys->initialize();
+		size_t connections = CountConnections(*filter);
+		size_t neurons = 6 * 28 * 28;
+		benchmarks.push_back(Benchmark("ConvolutionFilter::evaluate [32x32 k5 f6]", 2.0*connections, ForwardBytes(connections, neurons), [sys, filter]() {
+			filter->evaluate();
+		}));
+		benchmarks.push_back(Benchmark("ConvolutionFilter::backpropagate [32x32 k5 f6]", 4.0*connections, 2.0*ForwardBytes(connections, neurons), [sys, filter]() {
+			filter->backpropagate();
+		}));
+	}
+	{
+		//LeNet5 S2: 28x28 feature map, 2x2 pooling.
+		NeuralSystemPtr sys = MakeSystem();
+		NeuralLayerPtr input(new NeuralLayer("Input Layer", 28, 28, 1, false, Linear()));
+		AveragePoolFilterPtr filter(new AveragePoolFilter(input, 2, true));
+		sys->add(filter, Tanh());
+		sys->initialize();
+		size_t connections = CountConnections(*filter);
+		size_t neurons = 14 * 14;
+		benchmarks.push_back(Benchmark("AveragePoolFilter::evaluate [28x28 k2]", 2.0*connections, ForwardBytes(connections, neurons), [sys, filter]() {
+			filter->evaluate();
+		}));
+		benchmarks.push_back(Benchmark("AveragePoolFilter::backpropagate [28x28 k2]", 4.0*connections, 2.0*ForwardBytes(connections, neurons), [sys, filter]() {
+			filter->backpropagate();
+		}));
+	}
+	{
+		//LeNet5 output: 16 feature maps of 5x5 fully connected to 10 classes.
+		NeuralSystemPtr sys = MakeSystem();
+		std::vector<NeuralLayerPtr> inputs;
+		for (int i = 0; i < 16; i++) {
+			inputs.push_back(NeuralLayerPtr(new NeuralLayer(MakeString() << "Input [" << i << "]", 5, 5, 1, false, Tanh())));
+		}
+		FullyConnectedFilterPtr filter(new FullyConnectedFilter("Decision Layer", inputs, 10, 1, true));
+		sys->add(filter, Tanh());
+		sys->initialize();
+		size_t connections = CountConnections(*filter);
+		benchmarks.push_back(Benchmark("FullyConnectedFilter::evaluate [16x5x5 -> 10]", 2.0*connections, ForwardBytes(connections, 10), [sys, filter]() {
+			filter->evaluate();
+		}));
+		benchmarks.push_back(Benchmark("FullyConnectedFilter::backpropagate [16x5x5 -> 10]", 4.0*connections, 2.0*ForwardBytes(connections, 10), [sys, filter]() {
+			filter->backpropagate();
+		}));
+	}
+}
+static void AddOptimizerBenchmarks(std::vector<Benchmark>& benchmarks) {
+	const int N = 1 << 16;
+	//Same layout as a NeuralArena with two state slots: [weights | changes | state 0 | state 1].
+	std::shared_ptr<std::vector<float>> buffer(new std::vector<float>(4 * N, 0.0f));
+	for (int n = 0; n < N; n++) {
+		(*buffer)[n] = RandomUniform(-1.0f, 1.0f);
+		(*buffer)[N + n] = RandomUniform(-1E-3f, 1E-3f);
+	}
+	ParameterRange range(buffer->data(), buffer->data() + N, buffer->data() + 2 * N, N, N);
+	//Each update reads the weight and its change and writes the weight back.
+	double elemBytes = double(3 * sizeof(float));
+	std::shared_ptr<GradientDescentOptimizer> gd(new GradientDescentOptimizer(0.01f, 1E-4f));
+	benchmarks.push_back(Benchmark("GradientDescentOptimizer::optimize [65536]", 4.0*N, elemBytes*N, [gd, range, buffer]() {
+		gd->optimize(range);
+	}));
+	std::shared_ptr<MomentumOptimizer> momentum(new MomentumOptimizer(0.01f, 1E-4f, 0.9f));
+	benchmarks.push_back(Benchmark("MomentumOptimizer::optimize [65536]", 7.0*N, (elemBytes + 2 * sizeof(float))*N, [momentum, range, buffer]() {
+		momentum->optimize(range);
+	}));
+	std::shared_ptr<AdamOptimizer> adam(new AdamOptimizer(0.001f, 1E-4f));
+	benchmarks.push_back(Benchmark("AdamOptimizer::optimize [65536]", 16.0*N, (elemBytes + 4 * sizeof(float))*N, [adam, range, buffer]() {
+		adam->optimize(range);
+	}));
+	std::shared_ptr<RMSPropOptimizer> rmsprop(new RMSPropOptimizer(0.001f, 1E-4f));
+	benchmarks.push_back(Benchmark("RMSPropOptimizer::optimize [65536]", 10.0*N, (elemBytes + 2 * sizeof(float))*N, [rmsprop, range, buffer]() {
+		rmsprop->optimize(range);
+	}));
+}
+static void AddKnowledgeBenchmarks(std::vector<Benchmark>& benchmarks) {
+	NeuralSystemPtr sys = MakeSystem();
+	ConvolutionFilterPtr conv(new ConvolutionFilter(32, 32, 5, 6, false));
+	sys->add(conv, Tanh());
+	FullyConnectedFilterPtr fc(new FullyConnectedFilter("Decision Layer", conv->getOutputLayers(), 10, 1, true));
+	sys->add(fc, Tanh());
+	sys->initialize();
+	NeuralKnowledge& k = sys->updateKnowledge();
+	std::string file = "tiger_bench.bin";
+	WriteNeuralKnowledgeToFile(file, k);
+	std::ifstream in(file, std::ios::binary | std::ios::ate);
+	double bytes = (double)in.tellg();
+	in.close();
+	size_t params = sys->getArena().getStride();
+	//Clean snapshots share the arena's chunks. Dirty ones copy weights and state, as after every optimizer step.
+	benchmarks.push_back(Benchmark("NeuralSystem::updateKnowledge [clean]", 0.0, 0.0, [sys]() {
+		sys->updateKnowledge();
+	}));
+	benchmarks.push_back(Benchmark("NeuralSystem::updateKnowledge [dirty]", 0.0, 2.0*sizeof(float)*params, [sys]() {
+		sys->getArena().markDirty();
+		sys->updateKnowledge();
+	}));
+	benchmarks.push_back(Benchmark("WriteNeuralKnowledgeToFile [binary]", 0.0, bytes, [sys, file]() {
+		WriteNeuralKnowledgeToFile(file, sys->getKnowledge());
+	}));
+	std::shared_ptr<NeuralKnowledge> loaded(new NeuralKnowledge());
+	benchmarks.push_back(Benchmark("ReadNeuralKnowledgeFromFile [binary]", 0.0, bytes, [sys, file, loaded]() {
+		ReadNeuralKnowledgeFromFile(file, *loaded);
+	}));
+	benchmarks.push_back(Benchmark("NeuralSystem::setKnowledge [shared]", 0.0, 0.0, [sys]() {
+		sys->setKnowledge(sys->getKnowledge());
+	}));
+	benchmarks.push_back(Benchmark("NeuralSystem::setKnowledge [loaded]", 0.0, 2.0*sizeof(float)*params, [sys, loaded]() {
+		sys->getArena().markDirty();
+		sys->setKnowledge(*loaded);
+	}, [file, loaded]() {
+		ReadNeuralKnowledgeFromFile(file, *loaded);
+	}));
+}
+static int RunAllocationAudit(int steps) {
+	if (!AllocationAudit::isSupported()) {
+		std::cout << "Allocation audit requires a build with TGR_AUDIT_ALLOCATIONS defined." << std::endl;
+		return 1;
+	}
+	//The first steps size the snapshot pool, pipeline batches and optimizer state, so only the steps after them are counted.
+	const int warmup = 4;
+	const int sampleCount = 64;
+	std::vector<std::pair<std::string, int>> optimizers = {
+		{ "GradientDescent", 0 },
+		{ "Momentum", 1 },
+		{ "Adam", 2 },
+		{ "AdamW", 3 },
+		{ "RMSProp", 4 },
+		{ "Adagrad", 5 }
+	};
+	int failures = 0;
+	std::cout << std::left << std::setw(20) << "Optimizer" << std::right << std::setw(16) << "Allocations" << std::setw(16) << "Bytes" << std::endl;
+	std::cout << std::string(52, '-') << std::endl;
+	for (auto& pr : optimizers) {
+		NeuralSystemPtr sys = MakeSystem();
+		MakeLeNet5(*sys, 32, 32);
+		sys->initialize();
+		std::vector<std::vector<float>> samples(sampleCount, std::vector<float>(sys->getInput()->size()));
+		for (std::vector<float>& sample : samples) {
+			for (float& v : sample) {
+				v = RandomUniform(0.0f, 1.0f);
+			}
+		}
+		int classes = (int)sys->getOutput()->size();
+		//Headless runtime on the staged path, so every step goes through the pipeline, snapshot and checkpoint writer.
+		NeuralRuntime runtime(sys);
+		runtime.inputStager = [&samples](float* input, int idx) {
+			std::memcpy(input, samples[idx].data(), samples[idx].size() * sizeof(float));
+		};
+		runtime.outputSampler = [classes](std::vector<float>& output, int idx) {
+			output.assign(classes, 0.0f);
+			output[idx % classes] = 1.0f;
+		};
+		runtime.setSampleRange(0, sampleCount - 1);
+		runtime.setSelectedSamples(0, sampleCount - 1);
+		runtime.setOptimizationMethod(pr.second);
+		runtime.setIterationsPerEpoch(warmup + steps + 1);
+		runtime.setThroughput(true);
+		runtime.setPublishInterval(0.0);
+		runtime.init();
+		uint64_t allocations = 0;
+		uint64_t bytes = 0;
+		int completed = 0;
+		for (int s = 0; s < warmup + steps; s++) {
+			bool more;
+			if (s < warmup) {
+				more = runtime.step();
+			}
+			else {
+				AllocationScope scope;
+				more = runtime.step();
+				allocations += scope.getCount();
+				bytes += scope.getBytes();
+				completed++;
+			}
+			//Waiting here, outside the scope, returns every snapshot to the pool before the next step.
+			runtime.getCheckpoints()->flush();
+			if (!more)break;
+		}
+		runtime.cleanup();
+		if (allocations > 0 || completed < steps)failures++;
+		std::cout << std::left << std::setw(20) << pr.first << std::right << std::setw(16) << allocations << std::setw(16) << bytes << ((allocations > 0) ? "  FAIL" : "") << ((completed < steps) ? "  STOPPED" : "") << std::endl;
+	}
+	std::cout << ((failures > 0) ? "FAIL " : "PASS ") << steps << " steady-state steps per optimizer, " << failures << " optimizers allocated or stopped early" << std::endl;
+	return (failures > 0) ? 2 : 0;
+}
+static int RunFootprint(int width, int height) {
+	NeuralOptimizationPtr opt(new AdamOptimizer(0.001f, 1E-4f));
+	FootprintEstimator estimator(opt->getStateSize());
+	EstimateLeNet5(estimator, width, height);
+	SystemFootprint estimate = estimator.getFootprint();
+	std::cout << "Estimated LeNet5 [" << width << "x" << height << "]" << std::endl;
+	WriteFootprintReport(std::cout, estimate);
+	NeuralSystemPtr sys = MakeSystem();
+	MakeLeNet5(*sys, width, height);
+	sys->initialize();
+	sys->setOptimizer(opt);
+	std::vector<float> target(sys->getOutput()->size(), 0.0f);
+	sys->evaluate();
+	sys->accumulate(target);
+	sys->backpropagate();
+	sys->optimize();
+	//Three publishes with changes in between fill every snapshot buffer.
+	for (int i = 0; i < 3; i++) {
+		sys->invalidate();
+		sys->evaluate();
+		sys->publish(i);
+	}
+	sys->updateKnowledge();
+	SystemFootprint measured = sys->getFootprint();
+	std::cout << std::endl << "Measured LeNet5 [" << width << "x" << height << "]" << std::endl;
+	WriteFootprintReport(std::cout, measured);
+	std::cout << std::endl << "Estimate is " << std::fixed << std::setprecision(1) << 100.0*estimate.total.getBytes() / std::max(measured.total.getBytes(), (size_t)1) << "% of the measured layer total" << std::endl;
+	return 0;
+}
+//Same loss and summed gradient as NeuralRuntime::evaluateBatch(), without the sampler callbacks.
+static double EvaluateLoss(NeuralSystem& sys, const std::vector<std::vector<float>>& samples, const std::vector<std::vector<float>>& targets, bool backpropagate) {
+	double loss = 0.0;
+	sys.reset();
+	for (size_t s = 0; s < samples.size(); s++) {
+		sys.getInput()->set(samples[s].data(), samples[s].size());
+		sys.evaluate();
+		loss += 0.5*sys.accumulate(targets[s])*targets[s].size();
+		if (backpropagate)sys.backpropagate();
+	}
+	return loss;
+}
+static int RunGradientCheck(int checks) {
+	const int sampleCount = 2;
+	const float delta = 1E-3f;
+	const double tolerance = 1E-2;
+	NeuralSystemPtr sys = MakeSystem();
+	MakeLeNet5(*sys, 32, 32);
+	sys->initialize();
+	sys->initializeWeights(0.0f, 1.0f);
+	sys->setExactGradient(true);
+	std::vector<std::vector<float>> samples(sampleCount, std::vector<float>(sys->getInput()->size()));
+	std::vector<std::vector<float>> targets(sampleCount, std::vector<float>(sys->getOutput()->size(), 0.0f));
+	for (int s = 0; s < sampleCount; s++) {
+		for (float& v : samples[s]) {
+			v = RandomUniform(0.0f, 1.0f);
+		}
+		targets[s][s % targets[s].size()] = 1.0f;
+	}
+	double loss = EvaluateLoss(*sys, samples, targets, true);
+	NeuralArena& arena = sys->getArena();
+	std::vector<float> gradient(arena.getChanges(), arena.getChanges() + arena.getTrainableSize());
+	float* weights = arena.getWeights();
+	std::mt19937 rng(7);
+	std::uniform_int_distribution<size_t> pick(0, gradient.size() - 1);
+	int failures = 0;
+	double worst = 0.0;
+	std::cout << "Loss=" << loss << " over " << sampleCount << " samples" << std::endl;
+	std::cout << std::setw(10) << "Weight" << std::setw(16) << "Analytic" << std::setw(16) << "Numeric" << std::setw(16) << "Rel. Error" << std::endl;
+	std::cout << std::string(58, '-') << std::endl;
+	for (int c = 0; c < checks; c++) {
+		size_t n = pick(rng);
+		float w = weights[n];
+		weights[n] = w + delta;
+		double plus = EvaluateLoss(*sys, samples, targets, false);
+		weights[n] = w - delta;
+		double minus = EvaluateLoss(*sys, samples, targets, false);
+		weights[n] = w;
+		double numeric = (plus - minus) / (2.0*delta);
+		double analytic = gradient[n];
+		//Tiny gradients are dominated by float rounding in the differences, so they are compared absolutely.
+		double err = std::abs(analytic - numeric) / std::max(std::max(std::abs(analytic), std::abs(numeric)), 1E-3);
+		worst = std::max(worst, err);
+		if (err > tolerance)failures++;
+		std::cout << std::setw(10) << n << std::setw(16) << analytic << std::setw(16) << numeric << std::setw(16) << err << ((err > tolerance) ? "  FAIL" : "") << std::endl;
+	}
+	std::cout << ((failures > 0) ? "FAIL " : "PASS ") << checks << " weights checked, worst relative error " << worst << std::endl;
+	return (failures > 0) ? 2 : 0;
+}
+int main(int argc, char *argv[]) {
+	std::string filter;
+	double minTime = 0.5;
+	bool csv = false;
+	bool audit = false;
+	int auditSteps = 16;
+	bool footprint = false;
+	bool gradcheck = false;
+	int gradientChecks = 32;
+	int footprintWidth = 32;
+	int footprintHeight = 32;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.find("--min-time=") == 0) {
+			minTime = std::atof(arg.substr(11).c_str());
+		}
+		else if (arg == "--csv") {
+			csv = true;
+		}
+		else if (arg == "--audit") {
+			audit = true;
+		}
+		else if (arg.find("--footprint") == 0) {
+			footprint = true;
+			if (arg.find("--footprint=") == 0) {
+				std::string dims = arg.substr(12);
+				size_t x = dims.find('x');
+				footprintWidth = std::atoi(dims.substr(0, x).c_str());
+				footprintHeight = (x != std::string::npos) ? std::atoi(dims.substr(x + 1).c_str()) : footprintWidth;
+			}
+		}
+		else if (arg == "--gradcheck") {
+			gradcheck = true;
+		}
+		else if (arg.find("--checks=") == 0) {
+			gradientChecks = std::max(1, std::atoi(arg.substr(9).c_str()));
+		}
+		else if (arg.find("--steps=") == 0) {
+			auditSteps = std::max(1, std::atoi(arg.substr(8).c_str()));
+		}
+		else {
+			filter = arg;
+		}
+	}
+	try {
+		if (audit) {
+			return RunAllocationAudit(auditSteps);
+		}
+		if (footprint) {
+			return RunFootprint(footprintWidth, footprintHeight);
+		}
+		if (gradcheck) {
+			return RunGradientCheck(gradientChecks);
+		}
+		std::vector<Benchmark> benchmarks;
+		AddNeuronBenchmarks(benchmarks);
+		AddLayerBenchmarks(benchmarks);
+		AddFilterBenchmarks(benchmarks);
+		AddOptimizerBenchmarks(benchmarks);
+		AddKnowledgeBenchmarks(benchmarks);
+		if (csv) {
+			std::cout << "name,iterations,ns/op,GFLOP/s,bytes/op" << std::endl;
+		}
+		else {
+			std::cout << std::left << std::setw(52) << "Benchmark" << std::right << std::setw(12) << "Iterations" << std::setw(16) << "ns/op" << std::setw(12) << "GFLOP/s" << std::setw(16) << "bytes/op" << std::endl;
+			std::cout << std::string(108, '-') << std::endl;
+		}
+		for (Benchmark& b : benchmarks) {
+			if (filter.size() > 0 && b.getName().find(filter) == std::string::npos)continue;
+			BenchmarkResult r = b.run(minTime);
+			if (csv) {
+				std::cout << "\"" << r.name << "\"," << r.iterations << "," << r.nsPerOp << "," << r.gflops << "," << r.bytesPerOp << std::endl;
+			}
+			else {
+				std::cout << std::left << std::setw(52) << r.name << std::right << std::setw(12) << r.iterations << std::fixed << std::setprecision(1) << std::setw(16) << r.nsPerOp << std::setprecision(3) << std::setw(12) << r.gflops << std::setprecision(0) << std::setw(16) << r.bytesPerOp << std::endl;
+			}
+		}
+		std::remove("tiger_bench.bin");
+	}
+	catch (std::exception& e) {
+		std::cout << "Benchmark Error: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,327 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "NeuralSystem.h"
+#include "NeuralModels.h"
+#include "NeuralKnowledge.h"
+#include "IDXDataset.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <omp.h>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+using namespace aly;
+using namespace tgr;
+/*
+ * Measures inference on a trained LeNet5 outside the GUI. A pass runs every
+ * sample of the dataset once, split into requests that worker threads take in
+ * order. Each worker owns a replica of the network. The single-sample pass
+ * sends one sample per request, the batched pass sends --batch samples per
+ * request, and latency is measured per request.
+ *
+ * Usage: TigerInfer [options] <model> <images.idx> <labels.idx>
+ *
+ * The model is a .tgrm file, which every replica maps in place, or a
+ * knowledge file written by WriteNeuralKnowledgeToFile.
+ *
+ * Options:
+ *   --threads=N         worker threads (default all cores)
+ *   --omp=N             OpenMP threads per worker (default 1)
+ *   --batch=N           samples per request in the batched pass (default 64)
+ *   --warmup=N          untimed requests per worker before each pass (default 8)
+ *   --pad=P             border added to each side of the images (default 2)
+ *   --csv               print one line per pass as comma separated values, with the peak RSS after each pass
+ *
+ * Regression gates, which make the tool exit with code 2 when missed:
+ *   --min-accuracy=A    accuracy in percent
+ *   --max-p99=ms        p99 latency of the single-sample pass
+ *   --min-throughput=S  samples per second of the batched pass
+ */
+struct InferOptions {
+	int threads = 0;
+	int ompThreads = 1;
+	int batch = 64;
+	int warmup = 8;
+	int padding = 2;
+	bool csv = false;
+	double minAccuracy = -1.0;
+	double maxP99 = -1.0;
+	double minThroughput = -1.0;
+};
+struct InferResult {
+	std::string name;
+	int batch;
+	int samples;
+	int correct;
+	double seconds;
+	double p50;
+	double p95;
+	double p99;
+	//Peak RSS of the process at the end of the pass.
+	size_t peakBytes;
+	double getAccuracy() const {
+		return (samples > 0) ? 100.0*correct / samples : 0.0;
+	}
+	double getThroughput() const {
+		return (seconds > 0.0) ? samples / seconds : 0.0;
+	}
+};
+static bool EndsWith(const std::string& str, const std::string& suffix) {
+	return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+//Peak resident set size of the process in bytes.
+static size_t GetPeakMemory() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return (size_t)counters.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return (size_t)usage.ru_maxrss;
+#else
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+//Nearest rank percentile of sorted values.
+static double Percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.size() == 0)return 0.0;
+	size_t rank = (size_t)std::ceil(p*sorted.size());
+	return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+static int Classify(NeuralSystem& sys, const IDXDataset& images, int n) {
+	images.copyTo(n, *sys.getInput());
+	sys.evaluate();
+	const Knowledge& responses = sys.getOutput()->getResponses();
+	int predicted = 0;
+	for (int i = 1; i < (int)responses.size(); i++) {
+		if (responses[i] > responses[predicted]) {
+			predicted = i;
+		}
+	}
+	return predicted;
+}
+static InferResult RunPass(const std::string& name, std::vector<NeuralSystemPtr>& replicas, const IDXDataset& images, const IDXDataset& labels, int batch, const InferOptions& options) {
+	typedef std::chrono::steady_clock Clock;
+	int N = std::min(images.size(), labels.size());
+	int requests = (N + batch - 1) / batch;
+	int R = (int)replicas.size();
+	std::atomic<int> next(0);
+	std::vector<std::vector<double>> latencies(R);
+	std::vector<int> correct(R, 0);
+	std::vector<std::thread> workers;
+	Clock::time_point start;
+	std::atomic<int> ready(0);
+	std::atomic<bool> go(false);
+	for (int r = 0; r < R; r++) {
+		workers.push_back(std::thread([&, r]() {
+			omp_set_num_threads(options.ompThreads);
+			NeuralSystem& sys = *replicas[r];
+			for (int w = 0; w < options.warmup; w++) {
+				Classify(sys, images, (r*options.warmup + w) % N);
+			}
+			latencies[r].reserve(requests / R + 1);
+			ready++;
+			while (!go.load()) {
+				std::this_thread::yield();
+			}
+			int req;
+			while ((req = next.fetch_add(1)) < requests) {
+				int first = req*batch;
+				int last = std::min(first + batch, N);
+				auto t0 = Clock::now();
+				for (int n = first; n < last; n++) {
+					if (Classify(sys, images, n) == labels.getLabel(n)) {
+						correct[r]++;
+					}
+				}
+				latencies[r].push_back(std::chrono::duration<double, std::milli>(Clock::now() - t0).count());
+			}
+		}));
+	}
+	//Warm-up runs before the clock starts so every worker begins timed work together.
+	while (ready.load() < R) {
+		std::this_thread::yield();
+	}
+	start = Clock::now();
+	go = true;
+	for (std::thread& t : workers) {
+		t.join();
+	}
+	InferResult result;
+	result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	result.name = name;
+	result.batch = batch;
+	result.samples = N;
+	result.correct = 0;
+	std::vector<double> all;
+	all.reserve(requests);
+	for (int r = 0; r < R; r++) {
+		result.correct += correct[r];
+		all.insert(all.end(), latencies[r].begin(), latencies[r].end());
+	}
+	std::sort(all.begin(), all.end());
+	result.p50 = Percentile(all, 0.50);
+	result.p95 = Percentile(all, 0.95);
+	result.p99 = Percentile(all, 0.99);
+	result.peakBytes = GetPeakMemory();
+	return result;
+}
+static void Print(const InferResult& r, int threads, bool csv) {
+	if (csv) {
+		std::cout << r.name << "," << threads << "," << r.batch << "," << r.samples << "," << r.getAccuracy() << "," << r.getThroughput() << "," << r.p50 << "," << r.p95 << "," << r.p99 << "," << r.peakBytes / (1024.0*1024.0) << std::endl;
+	}
+	else {
+		std::cout << std::left << std::setw(16) << r.name << std::right << std::setw(8) << r.batch << std::fixed << std::setprecision(2) << std::setw(12) << r.getAccuracy() << std::setprecision(1) << std::setw(14) << r.getThroughput() << std::setprecision(3) << std::setw(12) << r.p50 << std::setw(12) << r.p95 << std::setw(12) << r.p99 << std::endl;
+	}
+}
+int main(int argc, char *argv[]) {
+	InferOptions options;
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg.find("--threads=") == 0) {
+			options.threads = std::atoi(arg.substr(10).c_str());
+		}
+		else if (arg.find("--omp=") == 0) {
+			options.ompThreads = std::max(1, std::atoi(arg.substr(6).c_str()));
+		}
+		else if (arg.find("--batch=") == 0) {
+			options.batch = std::max(1, std::atoi(arg.substr(8).c_str()));
+		}
+		else if (arg.find("--warmup=") == 0) {
+			options.warmup = std::max(0, std::atoi(arg.substr(9).c_str()));
+		}
+		else if (arg.find("--pad=") == 0) {
+			options.padding = std::atoi(arg.substr(6).c_str());
+		}
+		else if (arg == "--csv") {
+			options.csv = true;
+		}
+		else if (arg.find("--min-accuracy=") == 0) {
+			options.minAccuracy = std::atof(arg.substr(15).c_str());
+		}
+		else if (arg.find("--max-p99=") == 0) {
+			options.maxP99 = std::atof(arg.substr(10).c_str());
+		}
+		else if (arg.find("--min-throughput=") == 0) {
+			options.minThroughput = std::atof(arg.substr(17).c_str());
+		}
+		else {
+			files.push_back(arg);
+		}
+	}
+	if (files.size() != 3) {
+		std::cout << "Usage: TigerInfer [options] <model> <images.idx> <labels.idx>" << std::endl;
+		return 1;
+	}
+	int failures = 0;
+	try {
+		IDXDataset images(files[1], 0.0f, 1.0f, options.padding, options.padding);
+		IDXDataset labels(files[2]);
+		if (images.size() != labels.size()) {
+			throw std::runtime_error(MakeString() << "Image count " << images.size() << " does not match label count " << labels.size());
+		}
+		if (images.size() == 0) {
+			throw std::runtime_error("No samples in " + files[1]);
+		}
+		int threads = (options.threads > 0) ? options.threads : std::max(1, (int)std::thread::hardware_concurrency());
+		threads = std::min(threads, images.size());
+		bool mapped = EndsWith(files[0], ".tgrm");
+		NeuralKnowledge k;
+		if (!mapped) {
+			ReadNeuralKnowledgeFromFile(files[0], k);
+		}
+		//Replicas are built up front on this thread, since building networks concurrently is not safe.
+		std::vector<NeuralSystemPtr> replicas;
+		for (int r = 0; r < threads; r++) {
+			NeuralSystemPtr sys(new NeuralSystem(nullptr));
+			MakeLeNet5(*sys, images.width(), images.height());
+			sys->initialize();
+			if (mapped) {
+				//Every replica maps the same file, so the weights are held in memory once.
+				sys->mapKnowledge(files[0], r == 0);
+			}
+			else {
+				sys->setKnowledge(k);
+			}
+			replicas.push_back(sys);
+		}
+		std::vector<InferResult> results;
+		results.push_back(RunPass("single", replicas, images, labels, 1, options));
+		results.push_back(RunPass("batched", replicas, images, labels, options.batch, options));
+		if (options.csv) {
+			std::cout << "pass,threads,batch,samples,accuracy,samples/s,p50 ms,p95 ms,p99 ms,peak rss MB" << std::endl;
+		}
+		else {
+			std::cout << "Model " << files[0] << " (" << ((mapped) ? "mapped" : "loaded") << "), " << images.size() << " samples, " << threads << " threads x " << options.ompThreads << " OpenMP" << std::endl;
+			std::cout << std::left << std::setw(16) << "Pass" << std::right << std::setw(8) << "Batch" << std::setw(12) << "Accuracy %" << std::setw(14) << "Samples/s" << std::setw(12) << "p50 ms" << std::setw(12) << "p95 ms" << std::setw(12) << "p99 ms" << std::endl;
+			std::cout << std::string(86, '-') << std::endl;
+		}
+		for (const InferResult& r : results) {
+			Print(r, threads, options.csv);
+		}
+		if (!options.csv) {
+			std::cout << "Peak RSS " << std::fixed << std::setprecision(1) << results.back().peakBytes / (1024.0*1024.0) << " MB" << std::endl;
+		}
+		const InferResult& single = results[0];
+		const InferResult& batched = results[1];
+		if (options.minAccuracy >= 0.0 && single.getAccuracy() < options.minAccuracy) {
+			std::cout << "FAIL accuracy " << single.getAccuracy() << "% < " << options.minAccuracy << "%" << std::endl;
+			failures++;
+		}
+		if (options.maxP99 >= 0.0 && single.p99 > options.maxP99) {
+			std::cout << "FAIL p99 " << single.p99 << " ms > " << options.maxP99 << " ms" << std::endl;
+			failures++;
+		}
+		if (options.minThroughput >= 0.0 && batched.getThroughput() < options.minThroughput) {
+			std::cout << "FAIL throughput " << batched.getThroughput() << " samples/s < " << options.minThroughput << " samples/s" << std::endl;
+			failures++;
+		}
+	}
+	catch (std::exception& e) {
+		std::cout << "Inference Error: " << e.what() << std::endl;
+		return 1;
+	}
+	return (failures > 0) ? 2 : 0;
+}
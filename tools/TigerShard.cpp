@@ -0,0 +1,167 @@
+/*
+* Copyright(C) 2016, Blake C. Lucas, Ph.D. (img.science@gmail.com)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+* THE SOFTWARE.
+*/
+#include "ShardDataset.h"
+#include "IDXDataset.h"
+#include <AlloyImage.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+using namespace aly;
+using namespace tgr;
+/*
+ * Converts training data into shards for ShardDataset.
+ *
+ * Usage: TigerShard [options] <output prefix> <images.idx> <labels.idx>
+ *        TigerShard [options] --list=<file> <output prefix>
+ *
+ * A list file has one "<png file> <label>" pair per line. PNG images are
+ * converted to gray and must all have the same size.
+ *
+ * Options:
+ *   --fp16          store values as half floats instead of 8 bit
+ *   --records=N     records per shard (default 65536)
+ *   --pad=P         border of P background pixels added on each side
+ *                   (default 2, the border TigerApp adds to IDX input)
+ *   --min=V --max=V value range of the stored samples (default [0,1])
+ */
+struct ShardOptions {
+	ShardEncoding encoding = ShardEncoding::UInt8;
+	int recordsPerShard = 65536;
+	int padding = 2;
+	float scaleMin = 0.0f;
+	float scaleMax = 1.0f;
+};
+static void Pad(const float* src, int width, int height, int pad, float background, std::vector<float>& dst) {
+	int w = width + 2 * pad;
+	dst.assign((size_t)w*(height + 2 * pad), background);
+	for (int j = 0; j < height; j++) {
+		std::copy(src + j*width, src + (j + 1)*width, dst.begin() + (size_t)(j + pad)*w + pad);
+	}
+}
+static int ConvertIDX(const ShardOptions& options, const std::string& prefix, const std::string& imageFile, const std::string& labelFile) {
+	IDXDataset images(imageFile, options.scaleMin, options.scaleMax, options.padding, options.padding);
+	IDXDataset labels(labelFile);
+	if (images.size() != labels.size()) {
+		throw std::runtime_error(MakeString() << "Image count " << images.size() << " does not match label count " << labels.size());
+	}
+	ShardWriter writer(prefix, options.encoding, images.width(), images.height(), options.recordsPerShard, options.scaleMin, options.scaleMax);
+	std::vector<float> data(images.width()*images.height());
+	for (int n = 0; n < images.size(); n++) {
+		images.copyTo(n, data.data());
+		writer.add(data.data(), labels.getLabel(n), (uint32_t)n);
+	}
+	writer.close();
+	return (int)writer.getFiles().size();
+}
+static int ConvertList(const ShardOptions& options, const std::string& prefix, const std::string& listFile) {
+	std::ifstream in(listFile);
+	if (!in.is_open()) {
+		throw std::runtime_error("Could not open list " + listFile);
+	}
+	std::unique_ptr<ShardWriter> writer;
+	std::string line;
+	std::vector<float> gray, padded;
+	int width = 0, height = 0;
+	uint32_t source = 0;
+	while (std::getline(in, line)) {
+		std::stringstream ss(line);
+		std::string file;
+		int label;
+		if (!(ss >> file >> label))continue;
+		ImageRGBA img;
+		ReadImageFromFile(file, img);
+		if (writer.get() == nullptr) {
+			width = img.width;
+			height = img.height;
+			writer.reset(new ShardWriter(prefix, options.encoding, width + 2 * options.padding, height + 2 * options.padding, options.recordsPerShard, options.scaleMin, options.scaleMax));
+		}
+		else if (img.width != width || img.height != height) {
+			throw std::runtime_error(MakeString() << file << " is " << img.width << "x" << img.height << ", expected " << width << "x" << height);
+		}
+		gray.resize((size_t)width*height);
+		float scale = (options.scaleMax - options.scaleMin) / (3.0f*255.0f);
+		for (int j = 0; j < height; j++) {
+			for (int i = 0; i < width; i++) {
+				ubyte4 c = img(i, j);
+				gray[j*width + i] = options.scaleMin + scale*(float(c.x) + float(c.y) + float(c.z));
+			}
+		}
+		Pad(gray.data(), width, height, options.padding, options.scaleMin, padded);
+		writer->add(padded.data(), label, source++);
+	}
+	if (writer.get() == nullptr) {
+		throw std::runtime_error("No images listed in " + listFile);
+	}
+	writer->close();
+	return (int)writer->getFiles().size();
+}
+int main(int argc, char *argv[]) {
+	ShardOptions options;
+	std::string listFile;
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--fp16") {
+			options.encoding = ShardEncoding::Float16;
+		}
+		else if (arg.find("--records=") == 0) {
+			options.recordsPerShard = std::atoi(arg.substr(10).c_str());
+		}
+		else if (arg.find("--pad=") == 0) {
+			options.padding = std::atoi(arg.substr(6).c_str());
+		}
+		else if (arg.find("--min=") == 0) {
+			options.scaleMin = (float)std::atof(arg.substr(6).c_str());
+		}
+		else if (arg.find("--max=") == 0) {
+			options.scaleMax = (float)std::atof(arg.substr(6).c_str());
+		}
+		else if (arg.find("--list=") == 0) {
+			listFile = arg.substr(7);
+		}
+		else {
+			files.push_back(arg);
+		}
+	}
+	try {
+		int shards = 0;
+		if (listFile.size() > 0 && files.size() == 1) {
+			shards = ConvertList(options, files[0], listFile);
+		}
+		else if (listFile.size() == 0 && files.size() == 3) {
+			shards = ConvertIDX(options, files[0], files[1], files[2]);
+		}
+		else {
+			std::cout << "Usage: TigerShard [--fp16] [--records=N] [--pad=P] [--min=V] [--max=V] <output prefix> <images.idx> <labels.idx>" << std::endl;
+			std::cout << "       TigerShard [--fp16] [--records=N] [--pad=P] [--min=V] [--max=V] --list=<file> <output prefix>" << std::endl;
+			return 2;
+		}
+		ShardDataset dataset(files[0]);
+		std::cout << "Wrote " << dataset.size() << " records of " << dataset.width() << "x" << dataset.height() << " to " << shards << " shards" << std::endl;
+	}
+	catch (std::exception& e) {
+		std::cout << "Shard Error: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}